@@ -1,36 +1,492 @@
 #include "base64.hh"
 
-#include <openssl/bio.h>
-#include <openssl/buffer.h>
-#include <openssl/evp.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct alphabet_type {
+    const char *chars;
+    // 6 bit value of each character, 0xff for others
+    unsigned char values[256];
+
+    explicit alphabet_type(const char *chars) : chars(chars)
+    {
+        std::fill(values, values + 256, 0xff);
+        for(unsigned i = 0; i < 64; i++)
+            values[static_cast<unsigned char>(chars[i])]
+                = static_cast<unsigned char>(i);
+    }
+};
+
+const alphabet_type ALPHABETS[] = {
+    alphabet_type("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+                  "0123456789+/"),
+    alphabet_type("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+                  "0123456789-_")
+};
+
+// Encode kernels take a multiple of 3 bytes, decode kernels a multiple of 4
+// characters without padding.
+typedef void (*encode_function)(const unsigned char *, size_t, char *,
+                                const alphabet_type &);
+typedef bool (*decode_function)(const char *, size_t, unsigned char *,
+                                const alphabet_type &);
+
+void encode_scalar(const unsigned char *src, size_t n, char *dest,
+                   const alphabet_type &alphabet)
+{
+    const char *chars = alphabet.chars;
+    for(size_t i = 0; i < n; i += 3, dest += 4) {
+        const uint32_t v = uint32_t(src[i]) << 16 | uint32_t(src[i + 1]) << 8
+            | src[i + 2];
+        dest[0] = chars[v >> 18];
+        dest[1] = chars[(v >> 12) & 0x3f];
+        dest[2] = chars[(v >> 6) & 0x3f];
+        dest[3] = chars[v & 0x3f];
+    }
+}
+
+bool decode_scalar(const char *src, size_t n, unsigned char *dest,
+                   const alphabet_type &alphabet)
+{
+    const unsigned char *values = alphabet.values;
+    uint32_t invalid = 0;
+    for(size_t i = 0; i < n; i += 4, dest += 3) {
+        const uint32_t a = values[static_cast<unsigned char>(src[i])];
+        const uint32_t b = values[static_cast<unsigned char>(src[i + 1])];
+        const uint32_t c = values[static_cast<unsigned char>(src[i + 2])];
+        const uint32_t d = values[static_cast<unsigned char>(src[i + 3])];
+        invalid |= a | b | c | d;
+        const uint32_t v = a << 18 | b << 12 | c << 6 | d;
+        dest[0] = static_cast<unsigned char>(v >> 16);
+        dest[1] = static_cast<unsigned char>(v >> 8);
+        dest[2] = static_cast<unsigned char>(v);
+    }
+    return !(invalid & 0x80);
+}
+
+#if defined(__SSE2__)
+// Encoding after Muła, Lemire: "Faster Base64 Encoding and Decoding using
+// AVX2 Instructions". The shuffle puts 3 bytes into each 32 bit lane, the
+// multiplications move the four 6 bit indices into separate bytes.
+__attribute__((target("ssse3")))
+inline __m128i encode_indices_ssse3(__m128i in)
+{
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+                                           4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+// Offsets to add to the indices, selected by range: 0-25 -> 13, 26-51 -> 0,
+// 52-61 -> 1-10, 62 -> 11, 63 -> 12.
+__attribute__((target("ssse3")))
+inline __m128i encode_offsets(const alphabet_type &alphabet)
+{
+    return _mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        static_cast<char>(alphabet.chars[62] - 62),
+        static_cast<char>(alphabet.chars[63] - 63), 'A', 0, 0);
+}
+
+__attribute__((target("ssse3")))
+inline __m128i encode_ascii_ssse3(__m128i indices, __m128i offsets)
+{
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    range = _mm_or_si128(range, _mm_and_si128(less, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices);
+}
+
+__attribute__((target("ssse3")))
+void encode_ssse3(const unsigned char *src, size_t n, char *dest,
+                  const alphabet_type &alphabet)
+{
+    const __m128i offsets = encode_offsets(alphabet);
+    size_t i = 0;
+    // loads 16 bytes, uses 12
+    for(; i + 16 <= n; i += 12, dest += 16) {
+        const __m128i in = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest),
+                         encode_ascii_ssse3(encode_indices_ssse3(in), offsets));
+    }
+    encode_scalar(src + i, n - i, dest, alphabet);
+}
+
+__attribute__((target("avx2")))
+void encode_avx2(const unsigned char *src, size_t n, char *dest,
+                 const alphabet_type &alphabet)
+{
+    const __m256i offsets = _mm256_broadcastsi128_si256(
+        encode_offsets(alphabet));
+    const __m256i shuffle = _mm256_set_epi8(
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    size_t i = 0;
+    // 12 bytes in each lane
+    for(; i + 28 <= n; i += 24, dest += 32) {
+        __m256i in = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(src + i))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 12)),
+            1);
+        in = _mm256_shuffle_epi8(in, shuffle);
+        const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        const __m256i t1 = _mm256_mulhi_epu16(t0,
+                                              _mm256_set1_epi32(0x04000040));
+        const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        const __m256i t3 = _mm256_mullo_epi16(t2,
+                                              _mm256_set1_epi32(0x01000010));
+        const __m256i indices = _mm256_or_si256(t1, t3);
+
+        __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        range = _mm256_or_si256(range,
+                                _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest),
+                            _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range),
+                                            indices));
+    }
+    encode_ssse3(src + i, n - i, dest, alphabet);
+}
+
+// 6 bit values of 16 characters by range checks, invalid gets the
+// positions of characters outside the alphabet.
+__attribute__((target("ssse3")))
+inline __m128i decode_values_ssse3(__m128i c, __m128i c62, __m128i c63,
+                                   __m128i &invalid)
+{
+    const __m128i upper = _mm_sub_epi8(c, _mm_set1_epi8('A'));
+    const __m128i lower = _mm_sub_epi8(c, _mm_set1_epi8('a'));
+    const __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    const __m128i is_upper = _mm_cmpeq_epi8(
+        _mm_min_epu8(upper, _mm_set1_epi8(25)), upper);
+    const __m128i is_lower = _mm_cmpeq_epi8(
+        _mm_min_epu8(lower, _mm_set1_epi8(25)), lower);
+    const __m128i is_digit = _mm_cmpeq_epi8(
+        _mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    const __m128i is_62 = _mm_cmpeq_epi8(c, c62);
+    const __m128i is_63 = _mm_cmpeq_epi8(c, c63);
+    const __m128i valid = _mm_or_si128(
+        _mm_or_si128(_mm_or_si128(is_upper, is_lower),
+                     _mm_or_si128(is_digit, is_62)), is_63);
+    invalid = _mm_or_si128(invalid,
+                           _mm_andnot_si128(valid, _mm_set1_epi8(-1)));
+    return _mm_or_si128(
+        _mm_or_si128(
+            _mm_or_si128(
+                _mm_and_si128(is_upper, upper),
+                _mm_and_si128(is_lower,
+                              _mm_add_epi8(lower, _mm_set1_epi8(26)))),
+            _mm_and_si128(is_digit, _mm_add_epi8(digit, _mm_set1_epi8(52)))),
+        _mm_or_si128(_mm_and_si128(is_62, _mm_set1_epi8(62)),
+                     _mm_and_si128(is_63, _mm_set1_epi8(63))));
+}
+
+// four 6 bit values -> 3 bytes at the start of each 32 bit lane
+__attribute__((target("ssse3")))
+inline __m128i decode_pack_ssse3(__m128i values)
+{
+    const __m128i merged = _mm_maddubs_epi16(values,
+                                             _mm_set1_epi32(0x01400140));
+    const __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                                  14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3")))
+bool decode_ssse3(const char *src, size_t n, unsigned char *dest,
+                  const alphabet_type &alphabet)
+{
+    const __m128i c62 = _mm_set1_epi8(alphabet.chars[62]);
+    const __m128i c63 = _mm_set1_epi8(alphabet.chars[63]);
+    __m128i invalid = _mm_setzero_si128();
+    size_t i = 0;
+    // stores 16 bytes, 12 are valid: the next 8 characters overwrite the
+    // rest
+    for(; i + 24 <= n; i += 16, dest += 12) {
+        const __m128i values = decode_values_ssse3(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)),
+            c62, c63, invalid);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest),
+                         decode_pack_ssse3(values));
+    }
+    return _mm_movemask_epi8(invalid) == 0
+        && decode_scalar(src + i, n - i, dest, alphabet);
+}
+
+__attribute__((target("avx2")))
+bool decode_avx2(const char *src, size_t n, unsigned char *dest,
+                 const alphabet_type &alphabet)
+{
+    const __m256i c62 = _mm256_set1_epi8(alphabet.chars[62]);
+    const __m256i c63 = _mm256_set1_epi8(alphabet.chars[63]);
+    const __m256i shuffle = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    __m256i invalid = _mm256_setzero_si256();
+    size_t i = 0;
+    // stores 32 bytes, 24 are valid: the next 12 characters overwrite the
+    // rest
+    for(; i + 44 <= n; i += 32, dest += 24) {
+        const __m256i c = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(src + i));
+        const __m256i upper = _mm256_sub_epi8(c, _mm256_set1_epi8('A'));
+        const __m256i lower = _mm256_sub_epi8(c, _mm256_set1_epi8('a'));
+        const __m256i digit = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+        const __m256i is_upper = _mm256_cmpeq_epi8(
+            _mm256_min_epu8(upper, _mm256_set1_epi8(25)), upper);
+        const __m256i is_lower = _mm256_cmpeq_epi8(
+            _mm256_min_epu8(lower, _mm256_set1_epi8(25)), lower);
+        const __m256i is_digit = _mm256_cmpeq_epi8(
+            _mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+        const __m256i is_62 = _mm256_cmpeq_epi8(c, c62);
+        const __m256i is_63 = _mm256_cmpeq_epi8(c, c63);
+        const __m256i valid = _mm256_or_si256(
+            _mm256_or_si256(_mm256_or_si256(is_upper, is_lower),
+                            _mm256_or_si256(is_digit, is_62)), is_63);
+        invalid = _mm256_or_si256(
+            invalid, _mm256_andnot_si256(valid, _mm256_set1_epi8(-1)));
+        const __m256i values = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_or_si256(
+                    _mm256_and_si256(is_upper, upper),
+                    _mm256_and_si256(is_lower, _mm256_add_epi8(
+                                         lower, _mm256_set1_epi8(26)))),
+                _mm256_and_si256(is_digit, _mm256_add_epi8(
+                                     digit, _mm256_set1_epi8(52)))),
+            _mm256_or_si256(_mm256_and_si256(is_62, _mm256_set1_epi8(62)),
+                            _mm256_and_si256(is_63, _mm256_set1_epi8(63))));
+
+        const __m256i merged = _mm256_maddubs_epi16(
+            values, _mm256_set1_epi32(0x01400140));
+        const __m256i packed = _mm256_shuffle_epi8(
+            _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000)), shuffle);
+        // 12 bytes per lane -> 24 contiguous bytes
+        _mm256_storeu_si256(
+            reinterpret_cast<__m256i *>(dest),
+            _mm256_permutevar8x32_epi32(
+                packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7)));
+    }
+    return _mm256_movemask_epi8(invalid) == 0
+        && decode_ssse3(src + i, n - i, dest, alphabet);
+}
+#endif
+
+encode_function select_encode()
+{
+#if defined(__SSE2__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return encode_avx2;
+    if(__builtin_cpu_supports("ssse3"))
+        return encode_ssse3;
+#endif
+    return encode_scalar;
+}
+
+decode_function select_decode()
+{
+#if defined(__SSE2__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return decode_avx2;
+    if(__builtin_cpu_supports("ssse3"))
+        return decode_ssse3;
+#endif
+    return decode_scalar;
+}
+
+void encode_groups(const unsigned char *src, size_t n, char *dest,
+                   const alphabet_type &alphabet)
+{
+    static const encode_function kernel = select_encode();
+    kernel(src, n, dest, alphabet);
+}
+
+bool decode_groups(const char *src, size_t n, unsigned char *dest,
+                   const alphabet_type &alphabet)
+{
+    static const decode_function kernel = select_decode();
+    return kernel(src, n, dest, alphabet);
+}
+
+}
+
+size_t libaan::base64_encode(const unsigned char *src, size_t n, char *dest,
+                             base64_alphabet alphabet, bool padding)
+{
+    const auto &a = ALPHABETS[alphabet];
+    const size_t full = n / 3 * 3;
+    encode_groups(src, full, dest, a);
+    char *p = dest + full / 3 * 4;
+
+    const size_t rest = n - full;
+    if(rest) {
+        const uint32_t v = uint32_t(src[full]) << 16
+            | (rest == 2 ? uint32_t(src[full + 1]) << 8 : 0);
+        *p++ = a.chars[v >> 18];
+        *p++ = a.chars[(v >> 12) & 0x3f];
+        if(rest == 2)
+            *p++ = a.chars[(v >> 6) & 0x3f];
+        if(padding) {
+            *p++ = '=';
+            if(rest == 1)
+                *p++ = '=';
+        }
+    }
+    return static_cast<size_t>(p - dest);
+}
+
+bool libaan::base64_decode(const char *src, size_t n, unsigned char *dest,
+                           size_t &written, base64_alphabet alphabet)
+{
+    const auto &a = ALPHABETS[alphabet];
+    written = 0;
+
+    // padding completes the last group
+    size_t pad = 0;
+    if(n % 4 == 0)
+        while(pad < 2 && pad < n && src[n - 1 - pad] == '=')
+            pad++;
+    n -= pad;
+    const size_t rest = n % 4;
+    if(rest == 1 || (pad && pad != 4 - rest))
+        return false;
+
+    const size_t full = n - rest;
+    if(!decode_groups(src, full, dest, a))
+        return false;
+    written = full / 4 * 3;
+    if(rest == 0)
+        return true;
+
+    uint32_t v = 0, invalid = 0;
+    for(size_t i = 0; i < rest; i++) {
+        const uint32_t c = a.values[static_cast<unsigned char>(src[full + i])];
+        invalid |= c;
+        v |= c << (18 - 6 * i);
+    }
+    // bits beyond the last byte must be 0
+    if(invalid & 0x80 || (rest == 2 ? v & 0xffff : v & 0xff))
+        return false;
+    dest[written++] = static_cast<unsigned char>(v >> 16);
+    if(rest == 3)
+        dest[written++] = static_cast<unsigned char>(v >> 8);
+    return true;
+}
+
+size_t libaan::base64_encoder::update(const unsigned char *src, size_t n,
+                                      char *dest)
+{
+    const auto &a = ALPHABETS[alphabet];
+    size_t written = 0;
+    if(pending_count) {
+        while(pending_count < 3 && n > 0) {
+            pending[pending_count++] = *src++;
+            n--;
+        }
+        if(pending_count < 3)
+            return 0;
+        encode_groups(pending, 3, dest, a);
+        written = 4;
+        pending_count = 0;
+    }
+    const size_t full = n / 3 * 3;
+    encode_groups(src, full, dest + written, a);
+    written += full / 3 * 4;
+    pending_count = n - full;
+    std::memcpy(pending, src + full, pending_count);
+    return written;
+}
+
+size_t libaan::base64_encoder::final(char *dest)
+{
+    const size_t written = base64_encode(pending, pending_count, dest,
+                                         alphabet, padding);
+    pending_count = 0;
+    return written;
+}
+
+bool libaan::base64_decoder::update(const char *src, size_t n,
+                                    unsigned char *dest, size_t &written)
+{
+    written = 0;
+    if(failed)
+        return false;
+    while(pending_count < 4 && n > 0) {
+        pending[pending_count++] = *src++;
+        n--;
+    }
+    if(n == 0)
+        return true;
+
+    // more input follows, so the kept group has no padding
+    if(!decode_groups(pending, 4, dest, ALPHABETS[alphabet])) {
+        failed = true;
+        return false;
+    }
+    written = 3;
+
+    // keep the last 1 to 4 characters
+    const size_t keep = n % 4 ? n % 4 : 4;
+    if(!decode_groups(src, n - keep, dest + written, ALPHABETS[alphabet])) {
+        failed = true;
+        written = 0;
+        return false;
+    }
+    written += (n - keep) / 4 * 3;
+    std::memcpy(pending, src + n - keep, keep);
+    pending_count = keep;
+    return true;
+}
+
+bool libaan::base64_decoder::final(unsigned char *dest, size_t &written)
+{
+    written = 0;
+    if(failed)
+        return false;
+    failed = !base64_decode(pending, pending_count, dest, written, alphabet);
+    pending_count = 0;
+    return !failed;
+}
 
 size_t libaan::base64decode(const void* in, const size_t in_len, char* out, const size_t out_len)
 {
-    BIO *b64 = BIO_new(BIO_f_base64());
-    BIO *mem = BIO_new(BIO_s_mem());
-    const auto w = BIO_write(mem, in, in_len);
-    assert(w > 0 && (size_t)w == in_len);
-    BIO_push(b64, mem);
-    BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
-    const auto r = BIO_read(b64, out, out_len);
-    BIO_free_all(b64);
-    return r > 0 ? r : 0;
+    const auto src = static_cast<const char *>(in);
+    auto dest = reinterpret_cast<unsigned char *>(out);
+    size_t written;
+    if(out_len >= base64_decoded_size(in_len))
+        return base64_decode(src, in_len, dest, written) ? written : 0;
+
+    std::vector<unsigned char> buffer(base64_decoded_size(in_len));
+    if(!base64_decode(src, in_len, buffer.data(), written))
+        return 0;
+    written = std::min(written, out_len);
+    std::memcpy(out, buffer.data(), written);
+    return written;
 }
 
 size_t libaan::base64encode(const void* in, const size_t in_len, char* out, const size_t out_len)
 {
-    BIO *b64 = BIO_new(BIO_f_base64());
-    BIO *mem = BIO_new(BIO_s_mem());
-    mem = BIO_push(b64, mem);
-    BIO_set_flags(mem, BIO_FLAGS_BASE64_NO_NL);
-    const auto w = BIO_write(mem, in, in_len);
-    assert(w > 0 && (size_t)w == in_len);
-    (void)BIO_flush(mem);
-
-    BUF_MEM *buf;
-    BIO_get_mem_ptr(mem, &buf);
-    const auto r = std::min(buf->length, out_len);
-    memcpy(out, buf->data, r);
-    BIO_free_all(mem);
-    return r > 0 ? r : 0;
+    const auto src = static_cast<const unsigned char *>(in);
+    if(out_len >= base64_encoded_size(in_len))
+        return base64_encode(src, in_len, out);
+
+    std::vector<char> buffer(base64_encoded_size(in_len));
+    const size_t written = std::min(base64_encode(src, in_len, buffer.data()),
+                                    out_len);
+    std::memcpy(out, buffer.data(), written);
+    return written;
 }
@@ -1,6 +1,91 @@
+#ifndef _LIBAAN_BASE64_HH_
+#define _LIBAAN_BASE64_HH_
+
+#include <cstddef>
 #include <cstdint>
 
 namespace libaan {
+
+// RFC 4648 base64. Encoding and decoding run 12 (SSSE3) or 24 (AVX2) bytes
+// at a time if the cpu supports it.
+// Decoding is strict: only characters of the alphabet, padding is optional
+// but if present it must complete the last group of 4, unused bits of the
+// last character must be 0. Whitespace is not skipped.
+
+enum base64_alphabet {
+    // A-Z a-z 0-9 + /
+    BASE64_STANDARD,
+    // A-Z a-z 0-9 - _, URL and file name safe
+    BASE64_URL
+};
+
+// characters for n bytes
+inline size_t base64_encoded_size(size_t n, bool padding = true)
+{
+    return padding ? (n + 2) / 3 * 4 : n / 3 * 4 + (n % 3 ? n % 3 + 1 : 0);
+}
+// upper bound of the bytes in n characters
+inline size_t base64_decoded_size(size_t n) { return n / 4 * 3 + 2; }
+
+// Writes base64_encoded_size(n, padding) characters to dest and returns
+// their number.
+size_t base64_encode(const unsigned char *src, size_t n, char *dest,
+                     base64_alphabet alphabet = BASE64_STANDARD,
+                     bool padding = true);
+// Decodes n characters to dest, which needs base64_decoded_size(n) bytes.
+// written is the number of bytes. false for invalid input.
+bool base64_decode(const char *src, size_t n, unsigned char *dest,
+                   size_t &written,
+                   base64_alphabet alphabet = BASE64_STANDARD);
+
+// Encodes input given in chunks of any size, the concatenated output is the
+// same as for base64_encode of the whole input.
+class base64_encoder {
+public:
+    explicit base64_encoder(base64_alphabet alphabet = BASE64_STANDARD,
+                            bool padding = true)
+        : alphabet(alphabet), padding(padding) {}
+
+    // dest needs base64_encoded_size(n + 2) characters. Up to 2 bytes are
+    // kept for the next call. Returns the characters written.
+    size_t update(const unsigned char *src, size_t n, char *dest);
+    // the kept bytes, at most 4 characters
+    size_t final(char *dest);
+
+private:
+    base64_alphabet alphabet;
+    bool padding;
+    unsigned char pending[3];
+    size_t pending_count{0};
+};
+
+// Decodes input given in chunks of any size, with the rules of
+// base64_decode for the concatenated input. After invalid input all calls
+// return false.
+class base64_decoder {
+public:
+    explicit base64_decoder(base64_alphabet alphabet = BASE64_STANDARD)
+        : alphabet(alphabet) {}
+
+    // dest needs base64_decoded_size(n + 4) bytes. The last group of 4 is
+    // kept until more input follows, it may be padded.
+    bool update(const char *src, size_t n, unsigned char *dest,
+                size_t &written);
+    // the kept characters, at most 3 bytes
+    bool final(unsigned char *dest, size_t &written);
+
+private:
+    base64_alphabet alphabet;
+    char pending[4];
+    size_t pending_count{0};
+    bool failed{false};
+};
+
+// Standard alphabet with padding. Return the number of characters or bytes
+// written, at most out_len. base64decode returns 0 for invalid input.
 size_t base64decode(const void* in, const size_t in_len, char* out, const size_t out_len);
 size_t base64encode(const void* in, const size_t in_len, char* out, const size_t out_len);
+
 }
+
+#endif
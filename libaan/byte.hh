@@ -38,9 +38,40 @@ inline uint64_t ntohll(uint64_t n)
 #endif
 
 #include <cstddef>
+#include <cstring>
 
 namespace libaan {
 
+// Unsigned 40 bit integer packed into 5 bytes without alignment requirement,
+// e.g. for arrays of offsets into data larger than 4 GiB. Stored in host byte
+// order.
+class uint40_t {
+public:
+    uint40_t() = default;
+    uint40_t(uint64_t value)
+    {
+        const uint32_t low = static_cast<uint32_t>(value);
+        std::memcpy(bytes, &low, sizeof(low));
+        bytes[4] = static_cast<unsigned char>(value >> 32);
+    }
+
+    operator uint64_t() const
+    {
+        uint32_t low;
+        std::memcpy(&low, bytes, sizeof(low));
+        return low | static_cast<uint64_t>(bytes[4]) << 32;
+    }
+
+    uint40_t &operator++() { return *this = *this + 1u; }
+    uint40_t &operator--() { return *this = *this - 1u; }
+    uint40_t operator++(int) { const auto old = *this; ++*this; return old; }
+    uint40_t operator--(int) { const auto old = *this; --*this; return old; }
+
+private:
+    unsigned char bytes[5];
+};
+static_assert(sizeof(uint40_t) == 5, "uint40_t is not packed");
+
 inline std::size_t roundtonext8(std::size_t val) { return (val + 7ull) & ~7ull; }
 inline std::size_t roundtolast8(std::size_t val) { return val & ~7ull; }
 inline std::size_t roundtonext16(std::size_t val) { return (val + 15ull) & ~15ull; }
@@ -147,6 +178,11 @@ inline size_t count_trailing_1(uint64_t value)
     return lsb == 32u ? 32u + msb : lsb;
 }
 
+inline size_t popcount(uint64_t value)
+{
+    return static_cast<unsigned int>(__builtin_popcountll(value));
+}
+
 /*
 template<typename value_type>
 uint32_t pad32_trailing_0(value_type value)
@@ -9,8 +9,13 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <thread>
 
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 #ifdef LION_ENABLED
 #include <openssl/rc4.h>
 #endif
@@ -174,22 +179,557 @@ bool libaan::hash::do_hash(const EVP_MD *md,
                                           const std::string &in,
                                           std::string &out) const
 {
-    if(!md)
+    digest d(md);
+    return d.update(in) && d.finish(out);
+}
+
+const EVP_MD *libaan::digest::get_md(algorithm_type algorithm)
+{
+    switch(algorithm) {
+    case SHA1: return EVP_sha1();
+    case SHA256: return EVP_sha256();
+    case SHA512: return EVP_sha512();
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    case BLAKE2B512: return EVP_blake2b512();
+    case BLAKE2S256: return EVP_blake2s256();
+#else
+    case BLAKE2B512:
+    case BLAKE2S256:
+        break;
+#endif
+    }
+    return nullptr;
+}
+
+libaan::digest::digest(algorithm_type algorithm)
+    : digest(get_md(algorithm))
+{
+}
+
+libaan::digest::digest(const EVP_MD *md)
+    : md(md), ctx(EVP_MD_CTX_create())
+{
+    reset();
+}
+
+libaan::digest::~digest()
+{
+    if(ctx)
+        EVP_MD_CTX_destroy(ctx);
+}
+
+bool libaan::digest::reset()
+{
+    state = md && ctx && EVP_DigestInit_ex(ctx, md, nullptr) == 1;
+    return state;
+}
+
+bool libaan::digest::update(const void *data, size_t length)
+{
+    if(!state)
+        return false;
+    if(EVP_DigestUpdate(ctx, data, length) != 1)
+        state = false;
+    return state;
+}
+
+bool libaan::digest::finish(unsigned char *out)
+{
+    if(!state)
         return false;
+    unsigned int length;
+    if(EVP_DigestFinal_ex(ctx, out, &length) != 1) {
+        state = false;
+        return false;
+    }
+    // same md: keeps the allocated digest state
+    return reset();
+}
+
+bool libaan::digest::finish(std::string &out)
+{
+    out.resize(size());
+    if(!finish(reinterpret_cast<unsigned char *>(&out[0]))) {
+        out.clear();
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t SHA256_IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c,
+    0x1f83d9ab, 0x5be0cd19
+};
+
+// Compresses one 64 byte block into the state of each lane, state is
+// [lane][word].
+typedef void (*sha256_compress_function)(uint32_t (*state)[8],
+                                         const unsigned char *const *blocks);
+
+// Multi-buffer SHA-256: every lane hashes one message, the padded blocks of
+// the messages are fed to compress one block per lane at a time. A lane
+// whose message is done writes its digest and takes the next message, so
+// messages of different lengths do not wait for each other.
+template<size_t LANES>
+void sha256_lanes(const unsigned char *const *messages, const size_t *lengths,
+                  size_t count, unsigned char *out,
+                  sha256_compress_function compress)
+{
+    struct lane_type {
+        size_t message;
+        size_t block;
+        size_t blocks;
+        // blocks read from the message, the others from tail
+        size_t full;
+        // last partial block, 0x80, zeros and the length in bits
+        unsigned char tail[128];
+    };
+    static const unsigned char ZERO[64] = {};
+    uint32_t state[LANES][8] = {};
+    lane_type lanes[LANES];
+    const unsigned char *blocks[LANES];
+    size_t next = 0;
+
+    const auto start = [&](size_t i) {
+        auto &l = lanes[i];
+        l.block = l.blocks = 0;
+        if(next == count)
+            return false;
+        l.message = next++;
+        const size_t length = lengths[l.message];
+        const size_t rest = length % 64;
+        const size_t tail_blocks = rest + 9 <= 64 ? 1 : 2;
+        l.full = length / 64;
+        l.blocks = l.full + tail_blocks;
+        std::memset(l.tail, 0, tail_blocks * 64);
+        if(rest)
+            std::memcpy(l.tail, messages[l.message] + l.full * 64, rest);
+        l.tail[rest] = 0x80;
+        const uint64_t bits = __builtin_bswap64(uint64_t(length) * 8);
+        std::memcpy(l.tail + tail_blocks * 64 - 8, &bits, 8);
+        std::memcpy(state[i], SHA256_IV, sizeof(SHA256_IV));
+        return true;
+    };
+
+    size_t active = 0;
+    for(size_t i = 0; i < LANES; i++)
+        active += start(i);
+    while(active) {
+        for(size_t i = 0; i < LANES; i++) {
+            const auto &l = lanes[i];
+            blocks[i] = l.block == l.blocks ? ZERO
+                : l.block < l.full ? messages[l.message] + l.block * 64
+                : l.tail + (l.block - l.full) * 64;
+        }
+        compress(state, blocks);
+        for(size_t i = 0; i < LANES; i++) {
+            auto &l = lanes[i];
+            if(l.block == l.blocks || ++l.block < l.blocks)
+                continue;
+            for(unsigned w = 0; w < 8; w++) {
+                const uint32_t v = __builtin_bswap32(state[i][w]);
+                std::memcpy(out + l.message * 32 + 4 * w, &v, 4);
+            }
+            if(!start(i))
+                active--;
+        }
+    }
+}
+
+#if defined(__SSE2__)
+// 4 rounds with W[4i..4i+3] in w. If schedule, w is W[4i-16..4i-13] and is
+// computed from it and the next three vectors first.
+__attribute__((target("sha,sse4.1")))
+inline void sha256_rounds4_shani(__m128i &abef, __m128i &cdgh, __m128i &w,
+                                 __m128i w1, __m128i w2, __m128i w3,
+                                 const uint32_t *k, bool schedule)
+{
+    if(schedule)
+        w = _mm_sha256msg2_epu32(
+            _mm_add_epi32(_mm_sha256msg1_epu32(w, w1),
+                          _mm_alignr_epi8(w3, w2, 4)), w3);
+    const __m128i wk = _mm_add_epi32(
+        w, _mm_loadu_si128(reinterpret_cast<const __m128i *>(k)));
+    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+    abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0e));
+}
+
+// One lane: sha256rnds2 is throughput bound, interleaving a second message
+// does not help.
+__attribute__((target("sha,sse4.1")))
+void sha256_compress_shani(uint32_t (*state)[8],
+                           const unsigned char *const *blocks)
+{
+    const __m128i BSWAP = _mm_set_epi64x(0x0c0d0e0f08090a0bll,
+                                         0x0405060700010203ll);
+    const __m128i cdab = _mm_shuffle_epi32(_mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(state[0])), 0xb1);
+    const __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(state[0] + 4)), 0x1b);
+    const __m128i abef_save = _mm_alignr_epi8(cdab, efgh, 8);
+    const __m128i cdgh_save = _mm_blend_epi16(efgh, cdab, 0xf0);
+    __m128i abef = abef_save, cdgh = cdgh_save;
+    const auto p = reinterpret_cast<const __m128i *>(blocks[0]);
+    __m128i w0 = _mm_shuffle_epi8(_mm_loadu_si128(p), BSWAP);
+    __m128i w1 = _mm_shuffle_epi8(_mm_loadu_si128(p + 1), BSWAP);
+    __m128i w2 = _mm_shuffle_epi8(_mm_loadu_si128(p + 2), BSWAP);
+    __m128i w3 = _mm_shuffle_epi8(_mm_loadu_si128(p + 3), BSWAP);
+
+    for(unsigned i = 0; i < 64; i += 16) {
+        const bool schedule = i != 0;
+        sha256_rounds4_shani(abef, cdgh, w0, w1, w2, w3, SHA256_K + i,
+                             schedule);
+        sha256_rounds4_shani(abef, cdgh, w1, w2, w3, w0, SHA256_K + i + 4,
+                             schedule);
+        sha256_rounds4_shani(abef, cdgh, w2, w3, w0, w1, SHA256_K + i + 8,
+                             schedule);
+        sha256_rounds4_shani(abef, cdgh, w3, w0, w1, w2, SHA256_K + i + 12,
+                             schedule);
+    }
+
+    const __m128i feba = _mm_shuffle_epi32(_mm_add_epi32(abef, abef_save),
+                                           0x1b);
+    const __m128i dchg = _mm_shuffle_epi32(_mm_add_epi32(cdgh, cdgh_save),
+                                           0xb1);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state[0]),
+                     _mm_blend_epi16(feba, dchg, 0xf0));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state[0] + 4),
+                     _mm_alignr_epi8(dchg, feba, 8));
+}
+
+// rows of 8 words <-> columns
+__attribute__((target("avx2")))
+inline void transpose_8x8(__m256i *r)
+{
+    __m256i t[8], u[8];
+    for(unsigned i = 0; i < 8; i += 2) {
+        t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for(unsigned i = 0; i < 8; i += 4) {
+        u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for(unsigned i = 0; i < 4; i++) {
+        r[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+        r[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+    }
+}
+
+template<int N>
+__attribute__((target("avx2")))
+inline __m256i rotr(__m256i x)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(x, N), _mm256_slli_epi32(x, 32 - N));
+}
+
+// One message per 32 bit lane.
+__attribute__((target("avx2")))
+void sha256_compress_avx2(uint32_t (*state)[8],
+                          const unsigned char *const *blocks)
+{
+    const __m256i BSWAP = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    __m256i s[8], v[8], w[16];
+    for(unsigned i = 0; i < 8; i++)
+        s[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(state[i]));
+    transpose_8x8(s);
+    for(unsigned half = 0; half < 2; half++) {
+        __m256i *r = w + 8 * half;
+        for(unsigned i = 0; i < 8; i++)
+            r[i] = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i *>(blocks[i] + 32 * half));
+        transpose_8x8(r);
+        for(unsigned i = 0; i < 8; i++)
+            r[i] = _mm256_shuffle_epi8(r[i], BSWAP);
+    }
+    std::copy(s, s + 8, v);
+
+    for(unsigned t = 0; t < 64; t++) {
+        if(t >= 16) {
+            const __m256i w15 = w[(t + 1) & 15], w2 = w[(t + 14) & 15];
+            const __m256i s0 = _mm256_xor_si256(
+                _mm256_xor_si256(rotr<7>(w15), rotr<18>(w15)),
+                _mm256_srli_epi32(w15, 3));
+            const __m256i s1 = _mm256_xor_si256(
+                _mm256_xor_si256(rotr<17>(w2), rotr<19>(w2)),
+                _mm256_srli_epi32(w2, 10));
+            w[t & 15] = _mm256_add_epi32(
+                _mm256_add_epi32(w[t & 15], s0),
+                _mm256_add_epi32(w[(t + 9) & 15], s1));
+        }
+        const __m256i &a = v[0], &b = v[1], &c = v[2], &e = v[4], &f = v[5],
+            &g = v[6];
+        const __m256i S1 = _mm256_xor_si256(
+            _mm256_xor_si256(rotr<6>(e), rotr<11>(e)), rotr<25>(e));
+        const __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f),
+                                            _mm256_andnot_si256(e, g));
+        const __m256i t1 = _mm256_add_epi32(
+            _mm256_add_epi32(_mm256_add_epi32(v[7], S1), ch),
+            _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(SHA256_K[t])),
+                             w[t & 15]));
+        const __m256i S0 = _mm256_xor_si256(
+            _mm256_xor_si256(rotr<2>(a), rotr<13>(a)), rotr<22>(a));
+        const __m256i maj = _mm256_or_si256(
+            _mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+        const __m256i t2 = _mm256_add_epi32(S0, maj);
+        v[7] = v[6];
+        v[6] = v[5];
+        v[5] = v[4];
+        v[4] = _mm256_add_epi32(v[3], t1);
+        v[3] = v[2];
+        v[2] = v[1];
+        v[1] = v[0];
+        v[0] = _mm256_add_epi32(t1, t2);
+    }
+
+    for(unsigned i = 0; i < 8; i++)
+        s[i] = _mm256_add_epi32(s[i], v[i]);
+    transpose_8x8(s);
+    for(unsigned i = 0; i < 8; i++)
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(state[i]), s[i]);
+}
+#endif
+
+typedef void (*sha256_batch_function)(const unsigned char *const *,
+                                      const size_t *, size_t, unsigned char *);
+
+#if defined(__SSE2__)
+void sha256_batch_shani(const unsigned char *const *messages,
+                        const size_t *lengths, size_t count, unsigned char *out)
+{
+    sha256_lanes<1>(messages, lengths, count, out, sha256_compress_shani);
+}
+
+void sha256_batch_avx2(const unsigned char *const *messages,
+                       const size_t *lengths, size_t count, unsigned char *out)
+{
+    sha256_lanes<8>(messages, lengths, count, out, sha256_compress_avx2);
+}
+#endif
+
+// nullptr: no native kernel, use the digest context
+sha256_batch_function select_sha256_batch()
+{
+#if defined(__SSE2__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"))
+        return sha256_batch_shani;
+    if(__builtin_cpu_supports("avx2"))
+        return sha256_batch_avx2;
+#endif
+    return nullptr;
+}
+
+// nullptr for DIGEST and kernels the cpu does not support
+sha256_batch_function sha256_batch(libaan::hash_batch::kernel_type kernel)
+{
+    typedef libaan::hash_batch batch;
+    switch(kernel) {
+    case batch::AUTO: {
+        static const sha256_batch_function best = select_sha256_batch();
+        return best;
+    }
+    case batch::DIGEST:
+        break;
+#if defined(__SSE2__)
+    case batch::SHA_NI:
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"))
+            return sha256_batch_shani;
+        break;
+    case batch::AVX2:
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2"))
+            return sha256_batch_avx2;
+        break;
+#else
+    case batch::SHA_NI:
+    case batch::AVX2:
+        break;
+#endif
+    }
+    return nullptr;
+}
+
+}
 
-    EVP_MD_CTX mdctx;
-    EVP_MD_CTX_init(&mdctx);
-    EVP_DigestInit_ex(&mdctx, md, nullptr);
-    EVP_DigestUpdate(&mdctx,
-                     reinterpret_cast<const unsigned char *>(in.data()),
-                     in.length());
-    unsigned int md_len = -1;
-    EVP_DigestFinal_ex(&mdctx, reinterpret_cast<unsigned char *>(&out[0]),
-                       &md_len);
-    EVP_MD_CTX_cleanup(&mdctx);
+libaan::hash_batch::hash_batch(digest::algorithm_type algorithm)
+    : algorithm(algorithm), context(algorithm)
+{
+}
 
-    out.resize(md_len);
+bool libaan::hash_batch::set_kernel(kernel_type k)
+{
+    if((k == SHA_NI || k == AVX2)
+       && (algorithm != digest::SHA256 || !sha256_batch(k)))
+        return false;
+    kernel = k;
+    return true;
+}
 
+bool libaan::hash_batch::run(const unsigned char *const *messages,
+                             const size_t *lengths, size_t count,
+                             unsigned char *out)
+{
+    const sha256_batch_function sha256 = sha256_batch(kernel);
+    if(algorithm == digest::SHA256 && sha256) {
+        sha256(messages, lengths, count, out);
+        return true;
+    }
+    const size_t n = size();
+    for(size_t i = 0; i < count; i++)
+        if(!context.update(messages[i], lengths[i])
+           || !context.finish(out + i * n))
+            return false;
+    return true;
+}
+
+bool libaan::hash_batch::run(const std::vector<std::string> &messages,
+                             std::vector<std::string> &digests)
+{
+    const size_t n = size();
+    if(!n)
+        return false;
+    std::vector<const unsigned char *> pointers;
+    std::vector<size_t> lengths;
+    pointers.reserve(messages.size());
+    lengths.reserve(messages.size());
+    for(const auto &m: messages) {
+        pointers.push_back(reinterpret_cast<const unsigned char *>(m.data()));
+        lengths.push_back(m.length());
+    }
+    std::vector<unsigned char> out(messages.size() * n);
+    if(!run(pointers.data(), lengths.data(), messages.size(), out.data()))
+        return false;
+    digests.resize(messages.size());
+    for(size_t i = 0; i < messages.size(); i++)
+        digests[i].assign(reinterpret_cast<const char *>(&out[i * n]), n);
+    return true;
+}
+
+libaan::keyed_hmac::keyed_hmac(const void *key, size_t key_length,
+                               const EVP_MD *md)
+    : md(md), inner_pad(EVP_MD_CTX_create()), outer_pad(EVP_MD_CTX_create()),
+      ctx(EVP_MD_CTX_create())
+{
+    if(!md || !inner_pad || !outer_pad || !ctx)
+        return;
+
+    // RFC 2104: keys longer than a block are hashed first
+    unsigned char block[EVP_MAX_MD_SIZE > 128 ? EVP_MAX_MD_SIZE : 128] = {};
+    const size_t block_size = static_cast<size_t>(EVP_MD_block_size(md));
+    if(block_size > sizeof(block))
+        return;
+    if(key_length > block_size) {
+        unsigned int length;
+        if(EVP_Digest(key, key_length, block, &length, md, nullptr) != 1)
+            return;
+    } else if(key_length) {
+        std::memcpy(block, key, key_length);
+    }
+
+    for(size_t i = 0; i < block_size; i++)
+        block[i] ^= 0x36;
+    const bool inner = EVP_DigestInit_ex(inner_pad, md, nullptr) == 1
+        && EVP_DigestUpdate(inner_pad, block, block_size) == 1;
+    for(size_t i = 0; i < block_size; i++)
+        block[i] ^= 0x36 ^ 0x5c;
+    const bool outer = EVP_DigestInit_ex(outer_pad, md, nullptr) == 1
+        && EVP_DigestUpdate(outer_pad, block, block_size) == 1;
+    OPENSSL_cleanse(block, sizeof(block));
+    if(inner && outer)
+        reset();
+}
+
+libaan::keyed_hmac::keyed_hmac(const keyed_hmac &other)
+    : md(other.md), inner_pad(EVP_MD_CTX_create()),
+      outer_pad(EVP_MD_CTX_create()), ctx(EVP_MD_CTX_create())
+{
+    if(copy_pads(other))
+        reset();
+}
+
+libaan::keyed_hmac &libaan::keyed_hmac::operator=(const keyed_hmac &other)
+{
+    if(this != &other) {
+        md = other.md;
+        state = copy_pads(other) && reset();
+    }
+    return *this;
+}
+
+libaan::keyed_hmac::~keyed_hmac()
+{
+    for(auto c: { inner_pad, outer_pad, ctx })
+        if(c)
+            EVP_MD_CTX_destroy(c);
+}
+
+bool libaan::keyed_hmac::copy_pads(const keyed_hmac &other)
+{
+    return other.state && inner_pad && outer_pad && ctx
+        && EVP_MD_CTX_copy_ex(inner_pad, other.inner_pad) == 1
+        && EVP_MD_CTX_copy_ex(outer_pad, other.outer_pad) == 1;
+}
+
+bool libaan::keyed_hmac::reset()
+{
+    state = md && ctx && EVP_MD_CTX_copy_ex(ctx, inner_pad) == 1;
+    return state;
+}
+
+bool libaan::keyed_hmac::update(const void *data, size_t length)
+{
+    if(!state)
+        return false;
+    if(EVP_DigestUpdate(ctx, data, length) != 1)
+        state = false;
+    return state;
+}
+
+bool libaan::keyed_hmac::finish(unsigned char *out)
+{
+    if(!state)
+        return false;
+    unsigned char inner[EVP_MAX_MD_SIZE];
+    unsigned int length;
+    if(EVP_DigestFinal_ex(ctx, inner, &length) != 1
+       || EVP_MD_CTX_copy_ex(ctx, outer_pad) != 1
+       || EVP_DigestUpdate(ctx, inner, length) != 1
+       || EVP_DigestFinal_ex(ctx, out, &length) != 1) {
+        state = false;
+        return false;
+    }
+    return reset();
+}
+
+bool libaan::keyed_hmac::finish(std::string &out)
+{
+    out.resize(size());
+    if(!finish(reinterpret_cast<unsigned char *>(&out[0]))) {
+        out.clear();
+        return false;
+    }
     return true;
 }
 
@@ -221,13 +761,13 @@ libaan::hmac::~hmac()
     HMAC_CTX_cleanup(&ctx);
 }
 
-bool libaan::hmac::update(const std::string &cipher_text_in)
+bool libaan::hmac::update(const void *data, size_t length)
 {
     if(!state)
         return false;
 
-    if(HMAC_Update(&ctx, reinterpret_cast<const unsigned char *>
-                   (cipher_text_in.data()), cipher_text_in.length()) != 1) {
+    if(HMAC_Update(&ctx, static_cast<const unsigned char *>(data),
+                   length) != 1) {
         state = false;
         return false;
     }
@@ -292,32 +832,298 @@ void libaan::pkcs5_F(const unsigned char *password,
         out[j] ^= ulast[j];
 }
 
+namespace {
+
+// Low level access to the hash functions for PBKDF2: after the first
+// HMAC, every iteration hashes exactly one block after the inner and one
+// after the outer key pad.
+struct pbkdf2_sha1 {
+    typedef SHA_CTX ctx_type;
+    enum { BLOCK = SHA_CBLOCK, SIZE = SHA_DIGEST_LENGTH };
+    static int init(ctx_type *c) { return SHA1_Init(c); }
+    static int update(ctx_type *c, const void *p, size_t n)
+    {
+        return SHA1_Update(c, p, n);
+    }
+    static int final(ctx_type *c, unsigned char *out)
+    {
+        return SHA1_Final(out, c);
+    }
+    static void transform(ctx_type *c, const unsigned char *block)
+    {
+        SHA1_Transform(c, block);
+    }
+    // the digest of a finished message from the chaining state
+    static void digest(const ctx_type &c, unsigned char *out)
+    {
+        const uint32_t h[] = {
+            __builtin_bswap32(c.h0), __builtin_bswap32(c.h1),
+            __builtin_bswap32(c.h2), __builtin_bswap32(c.h3),
+            __builtin_bswap32(c.h4)
+        };
+        std::memcpy(out, h, SIZE);
+    }
+};
+
+struct pbkdf2_sha256 {
+    typedef SHA256_CTX ctx_type;
+    enum { BLOCK = SHA256_CBLOCK, SIZE = SHA256_DIGEST_LENGTH };
+    static int init(ctx_type *c) { return SHA256_Init(c); }
+    static int update(ctx_type *c, const void *p, size_t n)
+    {
+        return SHA256_Update(c, p, n);
+    }
+    static int final(ctx_type *c, unsigned char *out)
+    {
+        return SHA256_Final(out, c);
+    }
+    static void transform(ctx_type *c, const unsigned char *block)
+    {
+        SHA256_Transform(c, block);
+    }
+    static void digest(const ctx_type &c, unsigned char *out)
+    {
+        uint32_t h[8];
+        for(size_t i = 0; i < 8; i++)
+            h[i] = __builtin_bswap32(c.h[i]);
+        std::memcpy(out, h, SIZE);
+    }
+};
+
+struct pbkdf2_sha512 {
+    typedef SHA512_CTX ctx_type;
+    enum { BLOCK = SHA512_CBLOCK, SIZE = SHA512_DIGEST_LENGTH };
+    static int init(ctx_type *c) { return SHA512_Init(c); }
+    static int update(ctx_type *c, const void *p, size_t n)
+    {
+        return SHA512_Update(c, p, n);
+    }
+    static int final(ctx_type *c, unsigned char *out)
+    {
+        return SHA512_Final(out, c);
+    }
+    static void transform(ctx_type *c, const unsigned char *block)
+    {
+        SHA512_Transform(c, block);
+    }
+    static void digest(const ctx_type &c, unsigned char *out)
+    {
+        uint64_t h[8];
+        for(size_t i = 0; i < 8; i++)
+            h[i] = __builtin_bswap64(c.h[i]);
+        std::memcpy(out, h, SIZE);
+    }
+};
+
+// The states after the inner and outer key pads of HMAC-H, computed once.
+// block() only reads them, so it can run in several threads at once.
+template<typename H>
+class pbkdf2_keyed {
+public:
+    pbkdf2_keyed(const unsigned char *password, size_t password_length)
+    {
+        // RFC 2104: keys longer than a block are hashed first
+        unsigned char pad[H::BLOCK] = {};
+        typename H::ctx_type c;
+        if(password_length > H::BLOCK) {
+            state = H::init(&c) == 1
+                && H::update(&c, password, password_length) == 1
+                && H::final(&c, pad) == 1;
+            OPENSSL_cleanse(&c, sizeof(c));
+        } else if(password_length) {
+            std::memcpy(pad, password, password_length);
+        }
+        for(auto &b: pad)
+            b ^= 0x36;
+        state = state && H::init(&inner) == 1
+            && H::update(&inner, pad, H::BLOCK) == 1;
+        for(auto &b: pad)
+            b ^= 0x36 ^ 0x5c;
+        state = state && H::init(&outer) == 1
+            && H::update(&outer, pad, H::BLOCK) == 1;
+        OPENSSL_cleanse(pad, sizeof(pad));
+    }
+
+    ~pbkdf2_keyed()
+    {
+        OPENSSL_cleanse(&inner, sizeof(inner));
+        OPENSSL_cleanse(&outer, sizeof(outer));
+    }
+
+    // T_i = U_1 ^ ... ^ U_c, H::SIZE bytes
+    bool block(const unsigned char *salt, size_t salt_length, uint32_t i,
+               unsigned int iteration_count, unsigned char *t) const
+    {
+        // U_1 = PRF(P, S || INT(i))
+        const uint32_t big_endian_i = __builtin_bswap32(i);
+        typename H::ctx_type c = inner;
+        unsigned char block[H::BLOCK] = {};
+        bool ok = H::update(&c, salt, salt_length) == 1
+            && H::update(&c, &big_endian_i, 4) == 1
+            && H::final(&c, block) == 1;
+        c = outer;
+        ok = ok && H::update(&c, block, H::SIZE) == 1
+            && H::final(&c, block) == 1;
+
+        // U_j = PRF(P, U_j-1): a digest sized message after the pad block,
+        // so the padding of the single block to hash is always the same
+        if(ok) {
+            std::memset(block + H::SIZE, 0, H::BLOCK - H::SIZE);
+            block[H::SIZE] = 0x80;
+            const uint32_t bits = __builtin_bswap32((H::BLOCK + H::SIZE) * 8);
+            std::memcpy(block + H::BLOCK - 4, &bits, 4);
+            std::memcpy(t, block, H::SIZE);
+            for(unsigned int j = 1; j < iteration_count; j++) {
+                c = inner;
+                H::transform(&c, block);
+                H::digest(c, block);
+                c = outer;
+                H::transform(&c, block);
+                H::digest(c, block);
+                for(size_t k = 0; k < H::SIZE; k++)
+                    t[k] ^= block[k];
+            }
+        }
+
+        OPENSSL_cleanse(block, sizeof(block));
+        OPENSSL_cleanse(&c, sizeof(c));
+        return ok;
+    }
+
+    bool state{true};
+private:
+    typename H::ctx_type inner;
+    typename H::ctx_type outer;
+};
+
+// Writes the blocks T_1, T_2, ... of size bytes from block(i, t) to
+// derived_key. With threads > 1 the blocks are split into one contiguous
+// chunk per thread, the key is the same as the one derived serially.
+template<typename lambda_t>
+bool pbkdf2_blocks(size_t size, unsigned char *derived_key,
+                   uint64_t derived_key_length, unsigned threads,
+                   lambda_t block)
+{
+    const uint64_t blocks = (derived_key_length + size - 1) / size;
+    auto chunk = [&](uint64_t begin, uint64_t end) {
+        unsigned char t[EVP_MAX_MD_SIZE];
+        bool ok = true;
+        for(uint64_t b = begin; ok && b < end; b++) {
+            ok = block(static_cast<uint32_t>(b + 1), t);
+            std::memcpy(derived_key + b * size, t,
+                        std::min<uint64_t>(size, derived_key_length - b * size));
+        }
+        OPENSSL_cleanse(t, sizeof(t));
+        return ok;
+    };
+
+    if(threads <= 1 || blocks <= 1)
+        return chunk(0, blocks);
+
+    threads = static_cast<unsigned>(std::min<uint64_t>(threads, blocks));
+    const uint64_t per_thread = (blocks + threads - 1) / threads;
+    std::vector<char> ok(threads);
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for(unsigned i = 1; i < threads; i++)
+        workers.emplace_back([&, i]() {
+                ok[i] = chunk(std::min(blocks, i * per_thread),
+                              std::min(blocks, (i + 1) * per_thread));
+            });
+    ok[0] = chunk(0, std::min(blocks, per_thread));
+    for(auto &worker: workers)
+        worker.join();
+    return std::all_of(ok.begin(), ok.end(), [](char c) { return c; });
+}
+
+// RFC 2898 PBKDF2 with HMAC-H. Every iteration after the first is one
+// transform from a copy of each pad state.
+template<typename H>
+bool pbkdf2_hmac(const unsigned char *password, size_t password_length,
+                 const unsigned char *salt, size_t salt_length,
+                 unsigned int iteration_count, unsigned char *derived_key,
+                 uint64_t derived_key_length, unsigned threads)
+{
+    const pbkdf2_keyed<H> prf(password, password_length);
+    return prf.state && pbkdf2_blocks(
+        H::SIZE, derived_key, derived_key_length, threads,
+        [&](uint32_t i, unsigned char *t) {
+            return prf.block(salt, salt_length, i, iteration_count, t);
+        });
+}
+
+// any other digest, through keyed_hmac
+bool pbkdf2_evp(const EVP_MD *md, const unsigned char *password,
+                size_t password_length, const unsigned char *salt,
+                size_t salt_length, unsigned int iteration_count,
+                unsigned char *derived_key, uint64_t derived_key_length,
+                unsigned threads)
+{
+    const libaan::keyed_hmac keyed(password, password_length, md);
+    const size_t size = keyed.size();
+    return keyed.state && pbkdf2_blocks(
+        size, derived_key, derived_key_length, threads,
+        [&](uint32_t i, unsigned char *t) {
+            // a copy of the pad states for every block (and thread)
+            libaan::keyed_hmac prf(keyed);
+            const uint32_t big_endian_i = __builtin_bswap32(i);
+            unsigned char u[EVP_MAX_MD_SIZE];
+            prf.update(salt, salt_length);
+            prf.update(&big_endian_i, 4);
+            prf.finish(u);
+            std::memcpy(t, u, size);
+            for(unsigned int j = 1; j < iteration_count; j++) {
+                prf.update(u, size);
+                prf.finish(u);
+                for(size_t k = 0; k < size; k++)
+                    t[k] ^= u[k];
+            }
+            OPENSSL_cleanse(u, sizeof(u));
+            return prf.state;
+        });
+}
+
+}
+
 bool libaan::pbkdf2(const unsigned char *password,
                     unsigned int password_length,
                     const unsigned char *salt,
                     uint64_t salt_length,
                     unsigned int iteration_count,
                     unsigned char *derived_key,
-                    uint64_t derived_key_length)
+                    uint64_t derived_key_length,
+                    digest::algorithm_type prf,
+                    unsigned threads)
 {
-    unsigned long i, l, r;
-    unsigned char final[PRF_OUTPUT_LENGTH] = { 0, };
-    if (derived_key_length >
-        ((((uint64_t)1) << 32) - 1) * PRF_OUTPUT_LENGTH)
+    const EVP_MD *md = digest::get_md(prf);
+    if(!md)
+        return false;
+    // at most 2^32 - 1 blocks
+    if(derived_key_length >
+       ((uint64_t(1) << 32) - 1) * static_cast<uint64_t>(EVP_MD_size(md)))
         return false;
 
-    l = derived_key_length / PRF_OUTPUT_LENGTH;
-    r = derived_key_length % PRF_OUTPUT_LENGTH;
-    for (i = 1; i <= l; i++)
-        pkcs5_F(password, password_length, salt, salt_length, iteration_count,
-                i, derived_key + (i - 1) * PRF_OUTPUT_LENGTH);
-    if (r) {
-        pkcs5_F(password, password_length, salt, salt_length, iteration_count,
-                i, final);
-        for (l = 0; l < r; l++)
-            *(derived_key + (i - 1) *PRF_OUTPUT_LENGTH + l) = final[l];
+    switch(prf) {
+    case digest::SHA1:
+        return pbkdf2_hmac<pbkdf2_sha1>(password, password_length, salt,
+                                        salt_length, iteration_count,
+                                        derived_key, derived_key_length,
+                                        threads);
+    case digest::SHA256:
+        return pbkdf2_hmac<pbkdf2_sha256>(password, password_length, salt,
+                                          salt_length, iteration_count,
+                                          derived_key, derived_key_length,
+                                          threads);
+    case digest::SHA512:
+        return pbkdf2_hmac<pbkdf2_sha512>(password, password_length, salt,
+                                          salt_length, iteration_count,
+                                          derived_key, derived_key_length,
+                                          threads);
+    default:
+        return pbkdf2_evp(md, password, password_length, salt, salt_length,
+                          iteration_count, derived_key, derived_key_length,
+                          threads);
     }
-    return true;
 }
 
 #ifndef NO_GOOD
@@ -561,14 +1367,13 @@ bool libaan::camellia_256::do_decrypt(EVP_CIPHER_CTX *ctx,
 
 bool libaan::camellia_256::generate_key(const std::string &pw, std::string &key)
 {
-    const size_t iteration_count = 1000;
     if(!salt.length())
         return false;
 
     key.resize(KEY_SIZE);
 
-    if(!pbkdf2(pw, salt, iteration_count, key)) {
-        std::cout << "pbkdf2 key generation failed.\n";
+    if(!derive_key(kdf, pw, salt, key, cache)) {
+        std::cout << "key generation failed.\n";
         return false;
     }
 
@@ -624,6 +1429,16 @@ bool libaan::camellia_256::encrypt(const std::string &pw, const std::string &pla
     if(!generate_key(pw, key))
         return false;
 
+    return encrypt_with_key(key, plain, cipher);
+}
+
+bool libaan::camellia_256::encrypt_with_key(const std::string &key,
+                                            const std::string &plain,
+                                            std::string &cipher)
+{
+    if(iv.length() != BLOCK_SIZE || key.length() != KEY_SIZE)
+        return false;
+
     if(!plain.length()) {
         cipher.resize(0);
         std::cerr << "camellia_256::encrypt: skipping encryption. empty input.\n";
@@ -631,7 +1446,7 @@ bool libaan::camellia_256::encrypt(const std::string &pw, const std::string &pla
     }
     EVP_CIPHER_CTX ctx;
     if(!EVP_EncryptInit(&ctx, EVP_camellia_256_cbc(),
-                        reinterpret_cast<unsigned char *>(&key[0]),
+                        reinterpret_cast<const unsigned char *>(key.data()),
                         reinterpret_cast<unsigned char *>(&iv[0]))) {
         std::cout << "EVP_EncryptInit failed\n";
         return false;
@@ -657,6 +1472,16 @@ bool libaan::camellia_256::decrypt(const std::string &pw, const std::string &cip
     if(!generate_key(pw, key))
         return false;
 
+    return decrypt_with_key(key, cipher, plain);
+}
+
+bool libaan::camellia_256::decrypt_with_key(const std::string &key,
+                                            const std::string &cipher,
+                                            std::string &plain)
+{
+    if(iv.length() != BLOCK_SIZE || key.length() != KEY_SIZE)
+        return false;
+
     if(!cipher.length()) {
         plain.resize(0);
         std::cerr << "camellia_256::decrypt: skipping decryption. empty input.\n";
@@ -665,7 +1490,7 @@ bool libaan::camellia_256::decrypt(const std::string &pw, const std::string &cip
 
     EVP_CIPHER_CTX ctx;
     if(!EVP_DecryptInit(&ctx, EVP_camellia_256_cbc(),
-                        reinterpret_cast<unsigned char *>(&key[0]),
+                        reinterpret_cast<const unsigned char *>(key.data()),
                         reinterpret_cast<unsigned char *>(&iv[0]))) {
         std::cout << "EVP_DecryptInit failed\n";
         return false;
@@ -680,6 +1505,134 @@ bool libaan::camellia_256::decrypt(const std::string &pw, const std::string &cip
     return ret;
 }
 
+namespace {
+
+const unsigned char *bytes(const std::string &s)
+{
+    return reinterpret_cast<const unsigned char *>(s.data());
+}
+
+}
+
+const size_t libaan::aead_cipher::KEY_SIZE;
+const size_t libaan::aead_cipher::NONCE_SIZE;
+const size_t libaan::aead_cipher::TAG_SIZE;
+
+const EVP_CIPHER *libaan::aead_cipher::get_cipher(algorithm_type algorithm)
+{
+    switch(algorithm) {
+    case AES_256_GCM: return EVP_aes_256_gcm();
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(OPENSSL_NO_CHACHA) \
+    && !defined(OPENSSL_NO_POLY1305)
+    case CHACHA20_POLY1305: return EVP_chacha20_poly1305();
+#else
+    case CHACHA20_POLY1305:
+        break;
+#endif
+    }
+    return nullptr;
+}
+
+libaan::aead_cipher::aead_cipher(algorithm_type algorithm)
+    : cipher(get_cipher(algorithm)), ctx(EVP_CIPHER_CTX_new())
+{
+    state = cipher && ctx;
+}
+
+libaan::aead_cipher::~aead_cipher()
+{
+    if(ctx)
+        EVP_CIPHER_CTX_free(ctx);
+}
+
+// associated data (out == nullptr) or data, in pieces that fit an int
+bool libaan::aead_cipher::update(bool encrypting, const unsigned char *in,
+                                 size_t length, unsigned char *out)
+{
+    const size_t PIECE = size_t(1) << 30;
+    for(size_t done = 0; done < length; done += PIECE) {
+        const int n = static_cast<int>(std::min(PIECE, length - done));
+        int written;
+        const int ok = encrypting
+            ? EVP_EncryptUpdate(ctx, out ? out + done : nullptr, &written,
+                                in + done, n)
+            : EVP_DecryptUpdate(ctx, out ? out + done : nullptr, &written,
+                                in + done, n);
+        // GCM and ChaCha20-Poly1305 are stream modes, nothing is buffered
+        if(ok != 1 || (out && written != n))
+            return false;
+    }
+    return true;
+}
+
+bool libaan::aead_cipher::encrypt(const std::string &key,
+                                  const std::string &nonce,
+                                  const std::string &associated_data,
+                                  const std::string &plain,
+                                  std::string &sealed)
+{
+    if(!state || key.length() != KEY_SIZE || nonce.length() != NONCE_SIZE)
+        return false;
+
+    sealed.resize(plain.length() + TAG_SIZE);
+    auto out = reinterpret_cast<unsigned char *>(&sealed[0]);
+    int length;
+    const bool ok = EVP_EncryptInit_ex(ctx, cipher, nullptr, nullptr,
+                                       nullptr) == 1
+        && EVP_EncryptInit_ex(ctx, nullptr, nullptr, bytes(key),
+                              bytes(nonce)) == 1
+        && update(true, bytes(associated_data), associated_data.length(),
+                  nullptr)
+        && update(true, bytes(plain), plain.length(), out)
+        && EVP_EncryptFinal_ex(ctx, out + plain.length(), &length) == 1
+        && length == 0
+        && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, TAG_SIZE,
+                               out + plain.length()) == 1;
+    if(!ok) {
+        OPENSSL_cleanse(&sealed[0], sealed.length());
+        sealed.clear();
+    }
+    return ok;
+}
+
+bool libaan::aead_cipher::decrypt(const std::string &key,
+                                  const std::string &nonce,
+                                  const std::string &associated_data,
+                                  const std::string &sealed,
+                                  std::string &plain)
+{
+    plain.clear();
+    if(!state || key.length() != KEY_SIZE || nonce.length() != NONCE_SIZE
+       || sealed.length() < TAG_SIZE)
+        return false;
+
+    const size_t cipher_length = sealed.length() - TAG_SIZE;
+    std::string tag = sealed.substr(cipher_length);
+    plain.resize(cipher_length);
+    // no data still needs a valid pointer
+    unsigned char dummy;
+    auto out = cipher_length ? reinterpret_cast<unsigned char *>(&plain[0])
+        : &dummy;
+    int length;
+    const bool ok = EVP_DecryptInit_ex(ctx, cipher, nullptr, nullptr,
+                                       nullptr) == 1
+        && EVP_DecryptInit_ex(ctx, nullptr, nullptr, bytes(key),
+                              bytes(nonce)) == 1
+        && update(false, bytes(associated_data), associated_data.length(),
+                  nullptr)
+        && update(false, bytes(sealed), cipher_length, out)
+        && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, TAG_SIZE,
+                               &tag[0]) == 1
+        && EVP_DecryptFinal_ex(ctx, out + cipher_length, &length) == 1;
+    if(!ok) {
+        // nothing unauthenticated leaves this function
+        if(cipher_length)
+            OPENSSL_cleanse(&plain[0], plain.length());
+        plain.clear();
+    }
+    return ok;
+}
+
 
 #ifdef LION_ENABLED
 
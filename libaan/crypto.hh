@@ -6,11 +6,14 @@
 #include <unistd.h>
 #include <random>
 #include <string>
+#include <vector>
 
 #include <openssl/evp.h>
 #include <openssl/hmac.h>
 #include <openssl/sha.h>
 
+#include "kdf.hh"
+
 namespace libaan {
 
 bool read_random_bytes_noblock(size_t count, std::string & bytes);
@@ -37,12 +40,161 @@ struct password_from_stdin {
 };
 
 
+/* Incremental message digest. The EVP_MD_CTX is allocated once and reused:
+   finish() starts the next message.
+   Usage:
+   {
+       digest d(digest::SHA256);
+       d.update(p, n);
+       d.update(q, m);
+       std::string md;
+       if(d.finish(md)) {}
+   }
+*/
+class digest {
+public:
+    enum algorithm_type {
+        SHA1,
+        SHA256,
+        SHA512,
+        // need OpenSSL 1.1
+        BLAKE2B512,
+        BLAKE2S256
+    };
+
+    // nullptr if not supported by the OpenSSL version
+    static const EVP_MD *get_md(algorithm_type algorithm);
+
+    explicit digest(algorithm_type algorithm = SHA256);
+    explicit digest(const EVP_MD *md);
+    ~digest();
+    digest(const digest &) = delete;
+    digest &operator=(const digest &) = delete;
+
+    bool update(const void *data, size_t length);
+    bool update(const std::string &data)
+    {
+        return update(data.data(), data.length());
+    }
+    // writes size() bytes
+    bool finish(unsigned char *out);
+    // out is resized to size()
+    bool finish(std::string &out);
+    // drops the data of the current message
+    bool reset();
+
+    size_t size() const
+    {
+        return md ? static_cast<size_t>(EVP_MD_size(md)) : 0;
+    }
+
+    // false after a failed call, until reset()
+    bool state{false};
+private:
+    const EVP_MD *md;
+    EVP_MD_CTX *ctx;
+};
+
+/* Digests of many independent messages. SHA-256 runs natively: with the SHA
+   extensions one message at a time without the EVP overhead per message,
+   otherwise 8 messages at once in the AVX2 lanes, where a lane takes the
+   next message as soon as its message ends. Other algorithms and cpus go
+   through one reused digest context.
+*/
+class hash_batch {
+public:
+    // SHA-256 implementations, AUTO picks the fastest the cpu supports
+    enum kernel_type {
+        AUTO,
+        DIGEST,
+        SHA_NI,
+        AVX2
+    };
+
+    explicit hash_batch(digest::algorithm_type algorithm = digest::SHA256);
+
+    // for tests and benchmarks. false if the cpu does not support the
+    // kernel or the algorithm is not SHA256, the kernel is not changed then
+    bool set_kernel(kernel_type k);
+
+    // out needs count * size() bytes, the digest of message i is at
+    // out + i * size()
+    bool run(const unsigned char *const *messages, const size_t *lengths,
+             size_t count, unsigned char *out);
+    // one digest per message
+    bool run(const std::vector<std::string> &messages,
+             std::vector<std::string> &digests);
+
+    size_t size() const { return context.size(); }
+private:
+    digest::algorithm_type algorithm;
+    kernel_type kernel{AUTO};
+    digest context;
+};
+
+/* HMAC with the key schedule done once: the states after the inner and
+   outer key pad blocks are kept, every message starts from copies of them
+   instead of hashing the pads again. Copies of an object are independent,
+   e.g. one per thread.
+   Usage:
+   {
+       keyed_hmac h(key, EVP_sha256());
+       for(const auto &m: messages) {
+           std::string mac;
+           h.update(m);
+           if(h.finish(mac)) {}
+       }
+   }
+*/
+class keyed_hmac {
+public:
+    keyed_hmac(const void *key, size_t key_length, const EVP_MD *md);
+    explicit keyed_hmac(const std::string &key, const EVP_MD *md = EVP_sha1())
+        : keyed_hmac(key.data(), key.length(), md) {}
+    keyed_hmac(const keyed_hmac &other);
+    keyed_hmac &operator=(const keyed_hmac &other);
+    ~keyed_hmac();
+
+    bool update(const void *data, size_t length);
+    bool update(const std::string &data)
+    {
+        return update(data.data(), data.length());
+    }
+    // writes size() bytes and starts the next message
+    bool finish(unsigned char *out);
+    // out is resized to size()
+    bool finish(std::string &out);
+    // drops the data of the current message
+    bool reset();
+
+    size_t size() const
+    {
+        return md ? static_cast<size_t>(EVP_MD_size(md)) : 0;
+    }
+
+    // false after a failed call, until reset()
+    bool state{false};
+private:
+    bool copy_pads(const keyed_hmac &other);
+
+    const EVP_MD *md;
+    // hash states after the key xor ipad/opad blocks
+    EVP_MD_CTX *inner_pad;
+    EVP_MD_CTX *outer_pad;
+    // the current message
+    EVP_MD_CTX *ctx;
+};
+
 class hmac {
 public:
     static const std::size_t SIZE;
 
     hmac(const std::string &key, std::string &hmac_out);
-    bool update(const std::string &cipher_text_in);
+    bool update(const std::string &cipher_text_in)
+    {
+        return update(cipher_text_in.data(), cipher_text_in.length());
+    }
+    bool update(const void *data, size_t length);
 
     // hmac_out is only written in destructor. It is empty on failure
     ~hmac();
@@ -72,14 +224,14 @@ private:
 
 // Generate a key from a password.
 //
-// TODO: sha1 must be replaced
-//
 // http://www.ietf.org/rfc/rfc2898.txt
 // This value needs to be the output size of your pseudo-random function (PRF)
 const size_t PRF_OUTPUT_LENGTH = 20;
 
 /* This is an implementation of the PKCS#5 PBKDF2 PRF using HMAC-SHA1.
  * always gives 20-byte outputs.
+ * Reference implementation, pbkdf2() below does not use it. Note that
+ * pkcs5_F runs ic + 1 iterations.
  */
 
 // internal helper functions.
@@ -100,26 +252,37 @@ void pkcs5_F(const unsigned char *password, size_t password_length,
              const unsigned char *salt, size_t salt_length, size_t ic,
              size_t bix, unsigned char *out);
 
+// PBKDF2 with HMAC-prf. The key pads are hashed once per call, not once
+// per iteration. SHA1 is the default for existing keys, SHA256 or SHA512
+// should be used for new ones.
+// With threads > 1 the output blocks (one per digest size of the key) are
+// derived concurrently, at most one thread per block. The key is the same
+// as the one derived serially.
 bool pbkdf2(const unsigned char *password, unsigned int password_length,
             const unsigned char *salt, uint64_t salt_length,
             unsigned int iteration_count, unsigned char *derived_key,
-            uint64_t derived_key_length);
+            uint64_t derived_key_length,
+            digest::algorithm_type prf = digest::SHA1, unsigned threads = 1);
 
 // c++ wrapper for pbkdf2, derived_key should be resized to wanted size
 inline bool pbkdf2(const std::string &pw, const std::string &salt,
-                   unsigned int iteration_count, std::string &derived_key)
+                   unsigned int iteration_count, std::string &derived_key,
+                   digest::algorithm_type prf = digest::SHA1,
+                   unsigned threads = 1)
 {
     return pbkdf2(
 reinterpret_cast<const unsigned char *>(pw.c_str()), pw.length(),
         reinterpret_cast<const unsigned char *>(salt.c_str()), salt.length(),
         iteration_count, reinterpret_cast<unsigned char *>(&derived_key[0]),
-        derived_key.length());
+        derived_key.length(), prf, threads);
 }
 
 
 
 // De-/Encryption of variable length strings with camellia block cipher in
 // CBC mode. Blocks are padded automatically by openssl.
+// The key is derived from the password and salt with kdf, or taken from
+// cache if set.
 class camellia_256 {
 public:
     static const uint8_t KEY_SIZE = 32; //256bit camellia
@@ -137,6 +300,12 @@ public:
                  std::string &cipher);
     bool decrypt(const std::string &pw, const std::string &cipher,
                  std::string &plain);
+    // with a KEY_SIZE bytes key the caller derived, kdf and cache are not
+    // used
+    bool encrypt_with_key(const std::string &key, const std::string &plain,
+                          std::string &cipher);
+    bool decrypt_with_key(const std::string &key, const std::string &cipher,
+                          std::string &plain);
 
     bool new_random_iv();
 private:
@@ -150,6 +319,64 @@ private:
 public:
     std::string iv;
     std::string salt;
+    kdf_params kdf;
+    // optional, not owned
+    key_cache *cache{nullptr};
+};
+
+/* Authenticated encryption with associated data: the ciphertext and its
+   tag are computed in one pass over the data, there is no separate HMAC
+   pass as with camellia_256. OpenSSL uses AES-NI and PCLMULQDQ for
+   AES-256-GCM where the cpu has them; ChaCha20-Poly1305 is fast without
+   AES instructions and needs OpenSSL 1.1.
+   A nonce must never be used twice with the same key, e.g. a new
+   read_random_bytes_noblock(NONCE_SIZE, nonce) for every encrypt().
+   Usage:
+   {
+       aead_cipher c(aead_cipher::AES_256_GCM);
+       std::string sealed, plain;
+       if(c.encrypt(key, nonce, header, plain_in, sealed)) {}
+       if(c.decrypt(key, nonce, header, sealed, plain)) {}
+   }
+*/
+class aead_cipher {
+public:
+    enum algorithm_type {
+        AES_256_GCM,
+        // needs OpenSSL 1.1
+        CHACHA20_POLY1305
+    };
+    static const size_t KEY_SIZE = 32;
+    static const size_t NONCE_SIZE = 12;
+    static const size_t TAG_SIZE = 16;
+
+    // nullptr if not supported by the OpenSSL version
+    static const EVP_CIPHER *get_cipher(algorithm_type algorithm);
+
+    explicit aead_cipher(algorithm_type algorithm = AES_256_GCM);
+    ~aead_cipher();
+    aead_cipher(const aead_cipher &) = delete;
+    aead_cipher &operator=(const aead_cipher &) = delete;
+
+    // sealed is the ciphertext followed by the TAG_SIZE bytes tag.
+    // key has KEY_SIZE bytes, nonce NONCE_SIZE bytes.
+    bool encrypt(const std::string &key, const std::string &nonce,
+                 const std::string &associated_data, const std::string &plain,
+                 std::string &sealed);
+    // false if the tag does not match key, nonce, associated_data and
+    // ciphertext, plain is empty then
+    bool decrypt(const std::string &key, const std::string &nonce,
+                 const std::string &associated_data, const std::string &sealed,
+                 std::string &plain);
+
+    // false if the algorithm is not supported
+    bool state{false};
+private:
+    bool update(bool encrypting, const unsigned char *in, size_t length,
+                unsigned char *out);
+
+    const EVP_CIPHER *cipher;
+    EVP_CIPHER_CTX *ctx;
 };
 
 #ifdef LION_ENABLED
@@ -6,6 +6,8 @@
 
 #include <fstream>
 
+#include <openssl/crypto.h>
+
 #include <iostream> // TODO: kill this
 
 /*
@@ -76,6 +78,61 @@ the MAC of each file"
 
 */
 
+namespace {
+
+// HMAC of timestamp + kdf + encrypted_file without building the
+// concatenation. kdf is empty and key is the password for VERSION_0020.
+bool file_hmac(const std::string &key, const std::string &timestamp,
+               const std::string &kdf, const std::string &encrypted_file,
+               std::string &hmac_out)
+{
+    {
+        libaan::hmac h(key, hmac_out);
+        h.update(timestamp);
+        h.update(kdf);
+        h.update(encrypted_file);
+    }
+    return !hmac_out.empty();
+}
+
+// VERSION_0030: the kdf derives one 32 byte master key, the camellia key
+// and the hmac key are HKDF-expand (HMAC-SHA256) outputs of it with
+// distinct labels. Checking a password guess against the hmac needs the
+// master key, i.e. one key derivation of the same cost as the camellia
+// key alone. Zeroed on destruction.
+struct file_keys {
+    static const size_t MASTER_KEY_SIZE = 32;
+
+    ~file_keys()
+    {
+        for(std::string *s: { &cipher, &mac })
+            if(!s->empty())
+                OPENSSL_cleanse(&(*s)[0], s->length());
+    }
+
+    bool derive(const libaan::kdf_params &kdf, libaan::key_cache *cache,
+                const std::string &password, const std::string &salt)
+    {
+        std::string master(MASTER_KEY_SIZE, 0);
+        bool ok = libaan::derive_key(kdf, password, salt, master, cache);
+        if(ok) {
+            // T(1) = HMAC(master, label || 0x01), 32 bytes per key
+            libaan::keyed_hmac prk(master, EVP_sha256());
+            ok = prk.update(std::string("libaan crypto_file cipher\x01"))
+                && prk.finish(cipher)
+                && prk.update(std::string("libaan crypto_file hmac\x01"))
+                && prk.finish(mac);
+        }
+        OPENSSL_cleanse(&master[0], master.length());
+        return ok;
+    }
+
+    std::string cipher;
+    std::string mac;
+};
+
+}
+
 libaan::crypto_file::crypto_file(const std::string &file_name /*, cipher_type type*/)
     : total_file_length(0), dirty(false), filename(file_name)
 {
@@ -108,12 +165,13 @@ bool libaan::crypto_file::parse_header()
     off += MAGIC.length();
 
     std::string version_tmp
-        = file_header.substr(off, version.length());
+        = file_header.substr(off, VERSION_0030.length());
 
-    if(version_tmp != version) {
+    if(version_tmp != VERSION_0020 && version_tmp != VERSION_0030) {
         std::cerr << "parse_header ERROR: invalid version number.\n";
         return false;
     }
+    version = version_tmp;
     off += version.length();
 
     salt = file_header.substr(off, camellia_256::SALT_SIZE);
@@ -125,6 +183,17 @@ bool libaan::crypto_file::parse_header()
     off += hash::SHA1_HASHLENGTH;
 
     timestamp = file_header.substr(off, sizeof(int64_t));
+    off += sizeof(int64_t);
+
+    kdf_params params;
+    params.threads = kdf.threads;
+    if(version == VERSION_0030
+       && !params.deserialize(file_header.substr(off,
+                                                 kdf_params::SERIALIZED_SIZE))) {
+        std::cerr << "parse_header ERROR: invalid key derivation parameters.\n";
+        return false;
+    }
+    kdf = params;
     return true;
 }
 
@@ -165,6 +234,11 @@ void libaan::crypto_file::build_header_from_buffers()
     timestamp_tmp.replace(timestamp_tmp.begin(), timestamp_tmp.end(), timestamp);
     file_header.replace(file_header.begin() + off,
                         file_header.begin() + off + timestamp_tmp.length(), timestamp_tmp);
+    off += timestamp_tmp.length();
+
+    const std::string kdf_tmp = kdf.serialize();
+    file_header.replace(file_header.begin() + off,
+                        file_header.begin() + off + kdf_tmp.length(), kdf_tmp);
 }
 
 libaan::crypto_file::error_type
@@ -216,11 +290,18 @@ libaan::crypto_file::read(
         // read encrypted contents
         fp.read(begin, encrypted_file_length);
 
-        // TODO: after parsing, before decryption, the hmac should be calculated
-        //       and checked with the stored one
-        hash h;
+        // the hmac is checked before decryption. 0020 files use the
+        // password as hmac key.
+        const bool v0030 = version == VERSION_0030;
+        file_keys keys;
+        if(v0030 && !keys.derive(kdf, cache, password, salt)) {
+            std::cerr << "crypto_file::read(): key derivation failed.\n";
+            return INTERNAL_CIPHER_ERROR;
+        }
         std::string hmac_tmp;
-        if(!h.sha1_hmac(timestamp + encrypted_file, password, hmac_tmp)) {
+        if(!file_hmac(v0030 ? keys.mac : password, timestamp,
+                      v0030 ? kdf.serialize() : std::string(),
+                      encrypted_file, hmac_tmp)) {
             std::cerr << "crypto_file::write(): hmac generation failed.\n";
             return INTERNAL_CIPHER_ERROR;
         }
@@ -232,9 +313,13 @@ libaan::crypto_file::read(
         if(!cipher.init(salt, iv)) {
             return INTERNAL_CIPHER_ERROR;
         }
+        cipher.kdf = kdf;
         decrypted_buffer.resize(encrypted_file_length);
 
-        if(!cipher.decrypt(password, encrypted_file, decrypted_buffer)) {
+        if(!(v0030
+             ? cipher.decrypt_with_key(keys.cipher, encrypted_file,
+                                       decrypted_buffer)
+             : cipher.decrypt(password, encrypted_file, decrypted_buffer))) {
             std::cerr << "crypto_file::read -> cipher.decrypt() failed.\n";
             return INTERNAL_CIPHER_ERROR;
         }
@@ -257,16 +342,23 @@ libaan::crypto_file::write(
     if(!cipher.new_random_iv())
         return INTERNAL_CIPHER_ERROR;
     iv = cipher.iv;
+    version = VERSION_0030;
 
-    if(!cipher.encrypt(password, decrypted_buffer, encrypted_file)) {
+    file_keys keys;
+    if(!keys.derive(kdf, cache, password, salt)) {
+        std::cerr << "crypto_file::write(): key derivation failed.\n";
+        return INTERNAL_CIPHER_ERROR;
+    }
+    if(!cipher.encrypt_with_key(keys.cipher, decrypted_buffer,
+                                encrypted_file)) {
         std::cerr << "crypto_file::write(): camellia_256::encrypt() failed\n";
         return INTERNAL_CIPHER_ERROR;
     }
 
     timestamp = storable_time_point_now_bin<libaan::time_point_t>();
 
-    hash h;
-    if(!h.sha1_hmac(timestamp + encrypted_file, password, hmac)) {
+    if(!file_hmac(keys.mac, timestamp, kdf.serialize(), encrypted_file,
+                  hmac)) {
         std::cerr << "crypto_file::write(): hmac generation failed.\n";
         return INTERNAL_CIPHER_ERROR;
     }
@@ -31,6 +31,21 @@ sha1_hashlength(20) bytes hmac
 8byte timestamp
 size = 8 + 4 + 16 + 16 + 20 + 8 = 72
 
+
+
+VERSION 0030
+file format: as VERSION 0020
+
+header format: as VERSION 0020 (4 byte magic, so 68 bytes), followed by
+kdf_params::SERIALIZED_SIZE(13) bytes key derivation parameters
+size = 4 + 4 + 16 + 16 + 20 + 8 + 13 = 81
+
+keys: one kdf run over password and salt gives a 32 byte master key.
+camellia key = HMAC-SHA256(master, "libaan crypto_file cipher" 0x01)
+hmac key     = HMAC-SHA256(master, "libaan crypto_file hmac" 0x01)
+(HKDF-expand, RFC 5869). VERSION 0020 uses the password as hmac key, so
+password guesses could be checked without the kdf.
+
 */
 
 #ifndef _LIBAAN_CRYPTO_FILE_HH_
@@ -39,6 +54,8 @@ size = 8 + 4 + 16 + 16 + 20 + 8 = 72
 #include <cstddef>
 #include <string>
 
+#include "kdf.hh"
+
 namespace libaan {
 
 const size_t HEADER_SIZE = 128;
@@ -56,6 +73,12 @@ const std::string VERSION_0010 = {'\x0', '\x0', '\x1', '\x0'};
 //   o add timestamp to unencrypted header.
 //   o HEADER_SIZE = 128
 const std::string VERSION_0020 = {'\x0', '\x0', '\x2', '\x0'};
+// VERSION_0030:
+//   o key derivation parameters (algorithm, iterations, memory,
+//     parallelism) in the header, part of the hmac. 0020 files are read
+//     with the PBKDF2-HMAC-SHA1 default and written as 0030.
+//   o hmac key derived with the kdf, together with the camellia key.
+const std::string VERSION_0030 = {'\x0', '\x0', '\x3', '\x0'};
 
 class crypto_file {
 public:
@@ -126,6 +149,16 @@ public:
     std::string &get_decrypted_buffer() { return decrypted_buffer; }
     const std::string &get_decrypted_buffer() const { return decrypted_buffer; }
 
+    // Key derivation for the next write(). read() sets the parameters
+    // stored in the file. Changing them re-encrypts the file with the new
+    // key on the next write.
+    void set_kdf(const kdf_params &params) { kdf = params; set_dirty(); }
+    const kdf_params &get_kdf() const { return kdf; }
+    // Derived keys are taken from and stored in cache, so a write() after
+    // read() with the same password skips the key derivation. Not owned,
+    // nullptr to disable.
+    void set_key_cache(key_cache *c) { cache = c; }
+
     void set_dirty() { dirty = true; }
     bool is_dirty() const { return dirty; }
 
@@ -162,6 +195,8 @@ private:
     std::string iv;
     std::string hmac;
     std::string timestamp;
+    kdf_params kdf;
+    key_cache *cache{nullptr};
 
     std::string encrypted_file;
     std::string decrypted_buffer;
@@ -170,7 +205,8 @@ private:
 
     const std::string filename;
     error_type last_error;
-    const std::string version = VERSION_0020;
+    // of the file read, files are always written with VERSION_0030
+    std::string version = VERSION_0030;
 };
 
 }
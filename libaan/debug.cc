@@ -1,9 +1,14 @@
 #include "debug.hh"
 
+#include <cctype>
 #include <cstring>
 #include <iostream>
 #include "file.hh"
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 void libaan::do_ls(const std::string &path, std::ostream &out)
 {
     auto const f = [&out](const std::string &, const struct dirent *p) {
@@ -18,51 +23,249 @@ void libaan::do_ls(const std::string &path, std::ostream &out)
 }
 
 namespace {
-int ascii2bin(char input)
+
+const char HEX_DIGITS[] = "0123456789abcdef";
+
+// value of hex digits, -1 for other characters
+struct hex_table {
+    signed char value[256];
+    hex_table()
+    {
+        for(auto &v: value)
+            v = -1;
+        for(int i = 0; i < 16; i++) {
+            value[static_cast<unsigned char>(HEX_DIGITS[i])]
+                = static_cast<signed char>(i);
+            value[static_cast<unsigned char>(std::toupper(HEX_DIGITS[i]))]
+                = static_cast<signed char>(i);
+        }
+    }
+};
+const hex_table HEX_VALUES;
+
+// character pairs of all bytes
+struct pair_table {
+    char pairs[512];
+    pair_table()
+    {
+        for(int i = 0; i < 256; i++) {
+            pairs[2 * i] = HEX_DIGITS[i >> 4];
+            pairs[2 * i + 1] = HEX_DIGITS[i & 0xf];
+        }
+    }
+};
+const pair_table HEX_PAIRS;
+
+typedef void (*bin2hex_function)(const unsigned char *, size_t, char *);
+typedef bool (*hex2bin_function)(const char *, size_t, unsigned char *);
+
+void bin2hex_scalar(const unsigned char *src, size_t n, char *dest)
 {
-  if(input >= '0' && input <= '9')
-    return input - '0';
-  else if(input >= 'A' && input <= 'F')
-    return input - 'A' + 10;
-  else if(input >= 'a' && input <= 'f')
-    return input - 'a' + 10;
-  else
-      return -1;
+    for(size_t i = 0; i < n; i++)
+        std::memcpy(dest + 2 * i, &HEX_PAIRS.pairs[2 * src[i]], 2);
 }
+
+// n is the number of bytes written
+bool hex2bin_scalar(const char *src, size_t n, unsigned char *dest)
+{
+    int invalid = 0;
+    for(size_t i = 0; i < n; i++) {
+        const int hi = HEX_VALUES.value[static_cast<unsigned char>(src[2 * i])];
+        const int lo
+            = HEX_VALUES.value[static_cast<unsigned char>(src[2 * i + 1])];
+        invalid |= hi | lo;
+        // -1 for invalid digits, masked to avoid shifting a negative value
+        dest[i] = static_cast<unsigned char>((unsigned(hi) & 0xf) << 4
+                                             | (unsigned(lo) & 0xf));
+    }
+    return invalid >= 0;
 }
 
-// Src must have an even number of [0-9a-f] characters.
-// In the uneven case it returns false and converted input.
-std::pair<bool, std::vector<unsigned char> > libaan::hex2bin(const char *src, size_t size_hint)
+#if defined(__SSE2__)
+__attribute__((target("ssse3")))
+void bin2hex_ssse3(const unsigned char *src, size_t n, char *dest)
 {
-    std::vector<unsigned char> target;
-    if(size_hint) {
-        target.reserve(size_hint / 2);
-        size_hint = 0;
+    const __m128i digits = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(HEX_DIGITS));
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        const __m128i in = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(src + i));
+        const __m128i hi = _mm_shuffle_epi8(
+            digits, _mm_and_si128(_mm_srli_epi16(in, 4), nibble));
+        const __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(in, nibble));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 2 * i),
+                         _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 2 * i + 16),
+                         _mm_unpackhi_epi8(hi, lo));
     }
+    bin2hex_scalar(src + i, n - i, dest + 2 * i);
+}
 
-    while(*src && src[1]) {
-        const auto a = ascii2bin(*src) * 16;
-        const auto b = ascii2bin(src[1]);
-        if(a < 0 || b < 0)
-            return std::make_pair(false, decltype(target)());
-        target.push_back(a + b);
-        src += 2;
-        size_hint++;
+__attribute__((target("avx2")))
+void bin2hex_avx2(const unsigned char *src, size_t n, char *dest)
+{
+    const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(HEX_DIGITS)));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for(; i + 32 <= n; i += 32) {
+        const __m256i in = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(src + i));
+        const __m256i hi = _mm256_shuffle_epi8(
+            digits, _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble));
+        const __m256i lo = _mm256_shuffle_epi8(
+            digits, _mm256_and_si256(in, nibble));
+        // unpack works within 128 bit lanes
+        const __m256i first = _mm256_unpacklo_epi8(hi, lo);
+        const __m256i second = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + 2 * i),
+                            _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + 2 * i + 32),
+                            _mm256_permute2x128_si256(first, second, 0x31));
     }
+    bin2hex_scalar(src + i, n - i, dest + 2 * i);
+}
 
-    target.resize(size_hint);
-    return std::make_pair(!*src, target);
+// Nibble values of 16 characters, invalid gets the positions of other
+// characters.
+__attribute__((target("ssse3")))
+inline __m128i hex_values_ssse3(__m128i c, __m128i &invalid)
+{
+    const __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    const __m128i letter = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+                                        _mm_set1_epi8('a'));
+    const __m128i is_digit = _mm_cmpeq_epi8(
+        _mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    const __m128i is_letter = _mm_cmpeq_epi8(
+        _mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+    invalid = _mm_or_si128(invalid, _mm_andnot_si128(
+                               _mm_or_si128(is_digit, is_letter),
+                               _mm_set1_epi8(-1)));
+    return _mm_or_si128(
+        _mm_and_si128(is_digit, digit),
+        _mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+__attribute__((target("ssse3")))
+bool hex2bin_ssse3(const char *src, size_t n, unsigned char *dest)
+{
+    // high nibble * 16 + low nibble for each pair
+    const __m128i weights = _mm_set1_epi16(0x0110);
+    __m128i invalid = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        const __m128i a = hex_values_ssse3(_mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(src + 2 * i)), invalid);
+        const __m128i b = hex_values_ssse3(_mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(src + 2 * i + 16)), invalid);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i),
+                         _mm_packus_epi16(_mm_maddubs_epi16(a, weights),
+                                          _mm_maddubs_epi16(b, weights)));
+    }
+    return _mm_movemask_epi8(invalid) == 0
+        && hex2bin_scalar(src + 2 * i, n - i, dest + i);
+}
+
+__attribute__((target("avx2")))
+inline __m256i hex_values_avx2(__m256i c, __m256i &invalid)
+{
+    const __m256i digit = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+    const __m256i letter = _mm256_sub_epi8(
+        _mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    const __m256i is_digit = _mm256_cmpeq_epi8(
+        _mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+    const __m256i is_letter = _mm256_cmpeq_epi8(
+        _mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+    invalid = _mm256_or_si256(invalid, _mm256_andnot_si256(
+                                  _mm256_or_si256(is_digit, is_letter),
+                                  _mm256_set1_epi8(-1)));
+    return _mm256_or_si256(
+        _mm256_and_si256(is_digit, digit),
+        _mm256_and_si256(is_letter,
+                         _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+}
+
+__attribute__((target("avx2")))
+bool hex2bin_avx2(const char *src, size_t n, unsigned char *dest)
+{
+    const __m256i weights = _mm256_set1_epi16(0x0110);
+    __m256i invalid = _mm256_setzero_si256();
+    size_t i = 0;
+    for(; i + 32 <= n; i += 32) {
+        const __m256i a = hex_values_avx2(_mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(src + 2 * i)), invalid);
+        const __m256i b = hex_values_avx2(_mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(src + 2 * i + 32)), invalid);
+        // pack works within 128 bit lanes: a0 b0 a1 b1 -> a0 a1 b0 b1
+        const __m256i packed = _mm256_packus_epi16(
+            _mm256_maddubs_epi16(a, weights), _mm256_maddubs_epi16(b, weights));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i),
+                            _mm256_permute4x64_epi64(packed, 0xd8));
+    }
+    return _mm256_movemask_epi8(invalid) == 0
+        && hex2bin_scalar(src + 2 * i, n - i, dest + i);
+}
+#endif
+
+template<typename function_t>
+function_t select_hex(function_t scalar, function_t ssse3, function_t avx2)
+{
+#if defined(__SSE2__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return avx2;
+    if(__builtin_cpu_supports("ssse3"))
+        return ssse3;
+#else
+    (void)ssse3;
+    (void)avx2;
+#endif
+    return scalar;
+}
+
+}
+
+void libaan::bin2hex(const unsigned char *src, size_t n, char *dest)
+{
+#if defined(__SSE2__)
+    static const auto kernel = select_hex<bin2hex_function>(
+        bin2hex_scalar, bin2hex_ssse3, bin2hex_avx2);
+#else
+    static const auto kernel = select_hex<bin2hex_function>(
+        bin2hex_scalar, nullptr, nullptr);
+#endif
+    kernel(src, n, dest);
+}
+
+bool libaan::hex2bin(const char *src, size_t n, unsigned char *dest)
+{
+#if defined(__SSE2__)
+    static const auto kernel = select_hex<hex2bin_function>(
+        hex2bin_scalar, hex2bin_ssse3, hex2bin_avx2);
+#else
+    static const auto kernel = select_hex<hex2bin_function>(
+        hex2bin_scalar, nullptr, nullptr);
+#endif
+    return n % 2 == 0 && kernel(src, n / 2, dest);
+}
+
+// Src must have an even number of [0-9a-f] characters.
+// In the uneven case it returns false and converted input.
+std::pair<bool, std::vector<unsigned char> > libaan::hex2bin(const char *src, size_t /*size_hint*/)
+{
+    const size_t length = std::strlen(src);
+    std::vector<unsigned char> target(length / 2);
+    if(!hex2bin(src, length & ~size_t(1), target.data()))
+        return std::make_pair(false, decltype(target)());
+    return std::make_pair(length % 2 == 0, target);
 }
 
 std::string libaan::bin2hex(const std::vector<unsigned char> &v)
 {
     std::string s(v.size() * 2, '\0');
-    for(size_t i = 0; i < v.size(); i++) {
-//        printf("%02x ", (int)v[i]);
-        snprintf(&s[i * 2], 3, "%02x", (int)v[i]);
-//        std::cout << s << "\n";
-    }
+    bin2hex(v.data(), v.size(), &s[0]);
     return s;
 }
 
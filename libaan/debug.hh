@@ -16,6 +16,15 @@ void do_ls(const std::string &path, std::ostream &out = std::cout);
 std::pair<bool, std::vector<unsigned char> > hex2bin(const char *src, size_t size_hint = 0);
 std::string bin2hex(const std::vector<unsigned char> &v);
 
+// Kernels of the above on caller owned buffers. Table driven, 32 (SSSE3) or
+// 64 (AVX2) characters at a time if the cpu supports it.
+// Writes 2 * n lowercase hex characters, without terminating 0.
+void bin2hex(const unsigned char *src, size_t n, char *dest);
+// Converts the n / 2 character pairs of src, n must be even. Upper and lower
+// case are accepted. Returns false if src has other characters, dest is
+// undefined then.
+bool hex2bin(const char *src, size_t n, unsigned char *dest);
+
 void strip(std::string &str);
 
 template<typename T>
@@ -0,0 +1,343 @@
+#include "fm_index.hh"
+#include "string.hh"
+
+#include <algorithm>
+
+namespace {
+
+// position of the k-th 1 bit in word, counting from 0
+inline size_t select_in_word(uint64_t word, size_t k)
+{
+    for(; k > 0; k--)
+        word &= word - 1;
+    return static_cast<size_t>(__builtin_ctzll(word));
+}
+
+}
+
+void libaan::search::rank_bit_vector::build()
+{
+    uint64_t sum = 0;
+    for(size_t b = 0; b < blocks.size(); b += BLOCK_WORDS) {
+        blocks[b] = sum;
+        blocks[b + 1] = 0;
+        uint64_t relative = 0;
+        for(size_t w = 0; w < 8; w++) {
+            relative += popcount(blocks[b + 2 + w]);
+            if(w < 7)
+                blocks[b + 1] |= relative << (9 * w);
+        }
+        sum += relative;
+    }
+}
+
+size_t libaan::search::rank_bit_vector::select1(size_t k) const
+{
+    // last block with at most k 1 bits before it
+    size_t left = 0, right = blocks.size() / BLOCK_WORDS;
+    while(right - left > 1) {
+        const size_t mid = left + (right - left) / 2;
+        if(blocks[mid * BLOCK_WORDS] <= k)
+            left = mid;
+        else
+            right = mid;
+    }
+    k -= blocks[left * BLOCK_WORDS];
+    for(size_t w = 0;; w++) {
+        const uint64_t bits = blocks[left * BLOCK_WORDS + 2 + w];
+        const size_t ones = popcount(bits);
+        if(k < ones)
+            return left * BLOCK_BITS + w * 64 + select_in_word(bits, k);
+        k -= ones;
+    }
+}
+
+size_t libaan::search::rank_bit_vector::select0(size_t k) const
+{
+    // zeros before block b: b * BLOCK_BITS - 1 bits before it
+    size_t left = 0, right = blocks.size() / BLOCK_WORDS;
+    while(right - left > 1) {
+        const size_t mid = left + (right - left) / 2;
+        if(mid * BLOCK_BITS - blocks[mid * BLOCK_WORDS] <= k)
+            left = mid;
+        else
+            right = mid;
+    }
+    k -= left * BLOCK_BITS - blocks[left * BLOCK_WORDS];
+    for(size_t w = 0;; w++) {
+        const uint64_t bits = blocks[left * BLOCK_WORDS + 2 + w];
+        const size_t zeros = 64 - popcount(bits);
+        if(k < zeros)
+            return left * BLOCK_BITS + w * 64 + select_in_word(~bits, k);
+        k -= zeros;
+    }
+}
+
+libaan::search::wavelet_matrix::wavelet_matrix(
+    const std::vector<unsigned char> &symbols)
+    : n(symbols.size())
+{
+    std::vector<unsigned char> current(symbols), next(n);
+    for(unsigned l = 0; l < LEVELS; l++) {
+        const unsigned shift = LEVELS - 1 - l;
+        levels[l] = rank_bit_vector(n);
+        for(size_t i = 0; i < n; i++)
+            if((current[i] >> shift) & 1u)
+                levels[l].set(i);
+        levels[l].build();
+        zeros[l] = levels[l].rank0(n);
+
+        // stable partition, symbols with a 0 bit first
+        size_t z = 0, o = zeros[l];
+        for(size_t i = 0; i < n; i++)
+            next[(current[i] >> shift) & 1u ? o++ : z++] = current[i];
+        current.swap(next);
+    }
+
+    for(unsigned c = 0; c < 256; c++) {
+        size_t s = 0;
+        for(unsigned l = 0; l < LEVELS; l++)
+            s = (c >> (LEVELS - 1 - l)) & 1u
+                ? zeros[l] + levels[l].rank1(s) : levels[l].rank0(s);
+        start[c] = s;
+    }
+}
+
+unsigned char libaan::search::wavelet_matrix::access(size_t i) const
+{
+    size_t rank;
+    return inverse_select(i, rank);
+}
+
+size_t libaan::search::wavelet_matrix::rank(unsigned char c, size_t i) const
+{
+    for(unsigned l = 0; l < LEVELS; l++)
+        i = (c >> (LEVELS - 1 - l)) & 1u
+            ? zeros[l] + levels[l].rank1(i) : levels[l].rank0(i);
+    return i - start[c];
+}
+
+std::pair<size_t, size_t>
+libaan::search::wavelet_matrix::rank(unsigned char c, size_t i,
+                                     size_t j) const
+{
+    for(unsigned l = 0; l < LEVELS; l++) {
+        if((c >> (LEVELS - 1 - l)) & 1u) {
+            i = zeros[l] + levels[l].rank1(i);
+            j = zeros[l] + levels[l].rank1(j);
+        } else {
+            i = levels[l].rank0(i);
+            j = levels[l].rank0(j);
+        }
+    }
+    return std::make_pair(i - start[c], j - start[c]);
+}
+
+unsigned char libaan::search::wavelet_matrix::inverse_select(
+    size_t i, size_t &rank) const
+{
+    unsigned c = 0;
+    for(unsigned l = 0; l < LEVELS; l++) {
+        const bool bit = levels[l].get(i);
+        c = c << 1 | bit;
+        i = bit ? zeros[l] + levels[l].rank1(i) : levels[l].rank0(i);
+    }
+    rank = i - start[c];
+    return static_cast<unsigned char>(c);
+}
+
+void libaan::search::wavelet_matrix::inverse_select(
+    const size_t *positions, size_t count, unsigned char *symbols,
+    size_t *ranks) const
+{
+    std::copy(positions, positions + count, ranks);
+    std::fill(symbols, symbols + count, 0);
+    for(unsigned l = 0; l < LEVELS; l++)
+        for(size_t j = 0; j < count; j++) {
+            const size_t i = ranks[j];
+            const bool bit = levels[l].get(i);
+            symbols[j] = static_cast<unsigned char>(symbols[j] << 1 | bit);
+            ranks[j] = bit ? zeros[l] + levels[l].rank1(i)
+                           : levels[l].rank0(i);
+        }
+    for(size_t j = 0; j < count; j++)
+        ranks[j] -= start[symbols[j]];
+}
+
+size_t libaan::search::wavelet_matrix::select(unsigned char c, size_t k) const
+{
+    size_t i = start[c] + k;
+    for(unsigned l = LEVELS; l-- > 0;)
+        i = (c >> (LEVELS - 1 - l)) & 1u ? levels[l].select1(i - zeros[l])
+                                         : levels[l].select0(i);
+    return i;
+}
+
+size_t libaan::search::wavelet_matrix::size_in_bytes() const
+{
+    size_t size = sizeof(*this);
+    for(const auto &level: levels)
+        size += level.size_in_bytes();
+    return size;
+}
+
+template<typename index_t>
+libaan::search::fm_index::fm_index(const char *txt, size_t n,
+                                   const index_t *suffixes,
+                                   unsigned sample_rate)
+    : n(n), primary(0), sample_rate(std::max(1u, sample_rate)),
+      sampled(n + 1)
+{
+    build(txt, suffixes);
+}
+
+libaan::search::fm_index::fm_index(const char *txt, size_t n,
+                                   unsigned sample_rate)
+    : n(n), primary(0), sample_rate(std::max(1u, sample_rate)),
+      sampled(n + 1)
+{
+    // suffix array of the smallest element type that fits
+    if(n <= sarr_index_traits<int>::max_size()) {
+        std::vector<int> suffixes(n);
+        basic_sarr_sais<int>(txt, static_cast<int>(n), suffixes.data());
+        build(txt, suffixes.data());
+    } else {
+        std::vector<uint40_t> suffixes(n);
+        basic_sarr_sais<uint40_t>(txt, static_cast<int64_t>(n),
+                                  suffixes.data());
+        build(txt, suffixes.data());
+    }
+}
+
+// Rows of the BWT are the suffixes of txt plus a virtual sentinel, which is
+// smaller than all characters: row 0 is the empty suffix, row i + 1 the
+// suffix at suffixes[i].
+template<typename index_t>
+void libaan::search::fm_index::build(const char *txt, const index_t *suffixes)
+{
+    const auto text = reinterpret_cast<const unsigned char *>(txt);
+
+    std::array<size_t, 256> counts;
+    counts.fill(0);
+    for(size_t i = 0; i < n; i++)
+        counts[text[i]]++;
+    for(size_t c = 0, sum = 1; c < 256; c++) {
+        first_row[c] = sum;
+        sum += counts[c];
+    }
+
+    std::vector<unsigned char> symbols(n + 1);
+    const auto add_row = [&](size_t row, size_t offset) {
+        if(offset == 0) {
+            primary = row;
+            symbols[row] = 0;
+        } else
+            symbols[row] = text[offset - 1];
+        if(offset % sample_rate == 0) {
+            sampled.set(row);
+            samples.push_back(offset);
+        }
+    };
+    add_row(0, n);
+    for(size_t i = 0; i < n; i++)
+        add_row(i + 1, suffixes[i]);
+    sampled.build();
+    samples.shrink_to_fit();
+    bwt = wavelet_matrix(symbols);
+}
+
+std::pair<size_t, size_t>
+libaan::search::fm_index::rows(const std::string &pattern) const
+{
+    size_t first = 0, last = n + 1;
+    for(size_t k = pattern.size(); k-- > 0 && first < last;) {
+        const auto c = static_cast<unsigned char>(pattern[k]);
+        auto r = bwt.rank(c, first, last);
+        // the sentinel is stored as 0
+        if(c == 0) {
+            r.first -= first > primary;
+            r.second -= last > primary;
+        }
+        first = first_row[c] + r.first;
+        last = first_row[c] + r.second;
+    }
+    return first < last ? std::make_pair(first, last)
+                        : std::make_pair(first, first);
+}
+
+size_t libaan::search::fm_index::count(const std::string &pattern) const
+{
+    if(pattern.empty())
+        return 0;
+    const auto r = rows(pattern);
+    return r.second - r.first;
+}
+
+// Walk backwards through the text (LF mapping) until a sampled row is
+// reached. The row of text offset 0 is always sampled, so the sentinel row
+// is never left.
+std::vector<size_t>
+libaan::search::fm_index::locate(const std::string &pattern) const
+{
+    std::vector<size_t> matches;
+    if(pattern.empty())
+        return matches;
+    const auto r = rows(pattern);
+    matches.resize(r.second - r.first);
+
+    const size_t BATCH = 32;
+    size_t row[BATCH], match_index[BATCH], steps[BATCH], rank[BATCH];
+    unsigned char symbol[BATCH];
+    size_t active = 0;
+    for(size_t next = r.first;;) {
+        while(active < BATCH && next < r.second) {
+            match_index[active] = next - r.first;
+            row[active] = next++;
+            steps[active++] = 0;
+        }
+
+        // finished walks are replaced by the last active one
+        for(size_t j = 0; j < active;) {
+            if(!sampled.get(row[j])) {
+                j++;
+                continue;
+            }
+            matches[match_index[j]] = samples[sampled.rank1(row[j])]
+                + steps[j];
+            active--;
+            row[j] = row[active];
+            steps[j] = steps[active];
+            match_index[j] = match_index[active];
+        }
+        if(active == 0) {
+            if(next == r.second)
+                break;
+            continue;
+        }
+
+        bwt.inverse_select(row, active, symbol, rank);
+        for(size_t j = 0; j < active; j++) {
+            if(symbol[j] == 0)
+                rank[j] -= row[j] > primary;
+            row[j] = first_row[symbol[j]] + rank[j];
+            steps[j]++;
+        }
+    }
+    return matches;
+}
+
+size_t libaan::search::fm_index::size_in_bytes() const
+{
+    return sizeof(*this) - sizeof(bwt) - sizeof(sampled)
+        + bwt.size_in_bytes() + sampled.size_in_bytes()
+        + samples.capacity() * sizeof(uint40_t);
+}
+
+template libaan::search::fm_index::fm_index(const char *, size_t,
+                                            const int *, unsigned);
+template libaan::search::fm_index::fm_index(const char *, size_t,
+                                            const uint32_t *, unsigned);
+template libaan::search::fm_index::fm_index(const char *, size_t,
+                                            const uint64_t *, unsigned);
+template libaan::search::fm_index::fm_index(const char *, size_t,
+                                            const uint40_t *, unsigned);
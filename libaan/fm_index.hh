@@ -0,0 +1,159 @@
+#ifndef _LIBAAN_FM_INDEX_HH_
+#define _LIBAAN_FM_INDEX_HH_
+
+#include "byte.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace libaan {
+namespace search {
+
+// Bit vector with O(1) rank and O(log n) select. Set all bits, then call
+// build() once before using rank or select.
+// Rank directory as in Vigna: "Broadword Implementation of Rank/Select
+// Queries". Every block of 512 bits is preceded by the number of 1 bits
+// before it and the 9 bit counts of its words relative to the block, so rank
+// needs a single popcount.
+class rank_bit_vector {
+public:
+    rank_bit_vector() {}
+    explicit rank_bit_vector(size_t bit_count)
+        : blocks((bit_count / BLOCK_BITS + 1) * BLOCK_WORDS, 0),
+          bit_count(bit_count) {}
+
+    void set(size_t i) { word(i) |= 1ull << (i % 64); }
+    bool get(size_t i) const { return (word(i) >> (i % 64)) & 1u; }
+
+    void build();
+
+    // number of 1 bits in [0, i)
+    size_t rank1(size_t i) const
+    {
+        const uint64_t *block = &blocks[i / BLOCK_BITS * BLOCK_WORDS];
+        const size_t w = i % BLOCK_BITS / 64;
+        size_t r = block[0] + (w ? (block[1] >> (9 * (w - 1))) & 0x1ff : 0);
+        if(i % 64)
+            r += popcount(block[w + 2] & ((1ull << (i % 64)) - 1));
+        return r;
+    }
+    size_t rank0(size_t i) const { return i - rank1(i); }
+
+    // position of the k-th 1 (0) bit, counting from 0. k must be smaller
+    // than the number of 1 (0) bits.
+    size_t select1(size_t k) const;
+    size_t select0(size_t k) const;
+
+    size_t size() const { return bit_count; }
+    size_t size_in_bytes() const { return blocks.size() * sizeof(uint64_t); }
+
+private:
+    // absolute count, relative counts, 8 words of bits
+    static const size_t BLOCK_WORDS = 10;
+    static const size_t BLOCK_BITS = 512;
+
+    uint64_t &word(size_t i)
+    {
+        return blocks[i / BLOCK_BITS * BLOCK_WORDS + i % BLOCK_BITS / 64 + 2];
+    }
+    const uint64_t &word(size_t i) const
+    {
+        return blocks[i / BLOCK_BITS * BLOCK_WORDS + i % BLOCK_BITS / 64 + 2];
+    }
+
+    std::vector<uint64_t> blocks;
+    size_t bit_count{0};
+};
+
+// Wavelet tree over bytes, stored level by level without node boundaries
+// (Claude, Navarro: "The Wavelet Matrix"). Each level holds one bit per
+// symbol, rank, access and select need one bit vector operation per level.
+class wavelet_matrix {
+public:
+    wavelet_matrix() {}
+    explicit wavelet_matrix(const std::vector<unsigned char> &symbols);
+
+    size_t size() const { return n; }
+
+    unsigned char access(size_t i) const;
+    // occurences of c in [0, i)
+    size_t rank(unsigned char c, size_t i) const;
+    // occurences of c in [0, i) and [0, j)
+    std::pair<size_t, size_t> rank(unsigned char c, size_t i, size_t j) const;
+    // symbol at i and its occurences in [0, i)
+    unsigned char inverse_select(size_t i, size_t &rank) const;
+    // Same for count positions. The lookups of different positions are
+    // independent, doing them level by level overlaps their cache misses.
+    void inverse_select(const size_t *positions, size_t count,
+                        unsigned char *symbols, size_t *ranks) const;
+    // position of the k-th c, counting from 0. k must be smaller than
+    // rank(c, size()).
+    size_t select(unsigned char c, size_t k) const;
+
+    size_t size_in_bytes() const;
+
+private:
+    static const unsigned LEVELS = 8;
+
+    rank_bit_vector levels[LEVELS];
+    // number of 0 bits per level, the 1 bits follow them on the next level
+    size_t zeros[LEVELS];
+    // position the symbols c start at after the last level
+    std::array<size_t, 256> start;
+    size_t n{0};
+};
+
+// FM-index (Ferragina, Manzini: "Opportunistic data structures with
+// applications"): the Burrows-Wheeler transform of the text in a wavelet
+// matrix plus every sample_rate-th suffix array value. Neither text nor
+// suffix array are needed after construction.
+class fm_index {
+public:
+    // Build from an existing suffix array of txt[0..n-1].
+    template<typename index_t>
+    fm_index(const char *txt, size_t n, const index_t *suffixes,
+             unsigned sample_rate = 32);
+    // Build the suffix array with sarr_sais first.
+    fm_index(const char *txt, size_t n, unsigned sample_rate = 32);
+    fm_index(const std::string &txt, unsigned sample_rate = 32)
+        : fm_index(txt.data(), txt.size(), sample_rate) {}
+
+    // O(m), number of occurences of pattern. 0 for an empty pattern.
+    size_t count(const std::string &pattern) const;
+
+    // O(m + occ * sample_rate), text offsets of all occurences ordered like
+    // the suffix array. Occurences are walked back to a sampled offset in
+    // batches to hide the memory latency of the wavelet matrix.
+    std::vector<size_t> locate(const std::string &pattern) const;
+
+    size_t size() const { return n; }
+    size_t size_in_bytes() const;
+
+private:
+    template<typename index_t>
+    void build(const char *txt, const index_t *suffixes);
+    // half open interval of BWT rows prefixed by pattern
+    std::pair<size_t, size_t> rows(const std::string &pattern) const;
+
+private:
+    size_t n;
+    // BWT row of the whole text, its symbol is the virtual sentinel. The
+    // wavelet matrix stores a 0 there.
+    size_t primary;
+    unsigned sample_rate;
+    // first BWT row of each character, row 0 is the sentinel
+    std::array<size_t, 256> first_row;
+    wavelet_matrix bwt;
+    // rows whose suffix array value is a multiple of sample_rate
+    rank_bit_vector sampled;
+    std::vector<uint40_t> samples;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,930 @@
+#include "kdf.hh"
+#include "crypto.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+uint32_t load32_le(const unsigned char *p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16
+        | uint32_t(p[3]) << 24;
+}
+
+void store32_le(unsigned char *p, uint32_t v)
+{
+    for(size_t i = 0; i < 4; i++)
+        p[i] = static_cast<unsigned char>(v >> (8 * i));
+}
+
+uint64_t load64_le(const unsigned char *p)
+{
+    return uint64_t(load32_le(p)) | uint64_t(load32_le(p + 4)) << 32;
+}
+
+void store64_le(unsigned char *p, uint64_t v)
+{
+    store32_le(p, static_cast<uint32_t>(v));
+    store32_le(p + 4, static_cast<uint32_t>(v >> 32));
+}
+
+uint32_t load32_be(const unsigned char *p)
+{
+    return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8
+        | uint32_t(p[3]);
+}
+
+void store32_be(unsigned char *p, uint32_t v)
+{
+    for(size_t i = 0; i < 4; i++)
+        p[i] = static_cast<unsigned char>(v >> (24 - 8 * i));
+}
+
+inline uint64_t rotr64(uint64_t x, unsigned n)
+{
+    return (x >> n) | (x << (64 - n));
+}
+
+inline uint32_t rotl32(uint32_t x, unsigned n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+// Runs lambda(i) for i in [0, count), with threads > 1 one contiguous chunk
+// per thread. The calling thread takes the first chunk.
+template<typename lambda_t>
+void parallel_for(unsigned threads, uint32_t count, lambda_t lambda)
+{
+    threads = std::max(1u, std::min<unsigned>(threads, count));
+    const uint32_t chunk = (count + threads - 1) / threads;
+    auto run = [&](uint32_t begin, uint32_t end) {
+        for(uint32_t i = begin; i < end; i++)
+            lambda(i);
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for(unsigned t = 1; t < threads; t++)
+        workers.emplace_back(run, std::min(count, t * chunk),
+                             std::min(count, (t + 1) * chunk));
+    run(0, std::min(count, chunk));
+    for(auto &worker: workers)
+        worker.join();
+}
+
+// RFC 7693 BLAKE2b without key, for Argon2. OpenSSL 1.0 does not have it
+// and 1.1 only with 64 byte output.
+class blake2b {
+public:
+    static const size_t BLOCK = 128;
+    static const size_t MAX_SIZE = 64;
+
+    explicit blake2b(size_t out_length) : out_length(out_length)
+    {
+        std::copy(IV, IV + 8, h);
+        h[0] ^= 0x01010000 ^ out_length;
+    }
+
+    ~blake2b()
+    {
+        OPENSSL_cleanse(h, sizeof(h));
+        OPENSSL_cleanse(buffer, sizeof(buffer));
+    }
+
+    void update(const void *data, size_t length)
+    {
+        auto p = static_cast<const unsigned char *>(data);
+        while(length) {
+            // the last block is compressed in final()
+            if(buffered == BLOCK) {
+                counter += BLOCK;
+                compress(false);
+                buffered = 0;
+            }
+            const size_t n = std::min(length, BLOCK - buffered);
+            std::memcpy(buffer + buffered, p, n);
+            buffered += n;
+            p += n;
+            length -= n;
+        }
+    }
+
+    void update32(uint32_t v)
+    {
+        unsigned char le[4];
+        store32_le(le, v);
+        update(le, 4);
+    }
+
+    // writes out_length bytes
+    void final(unsigned char *out)
+    {
+        counter += buffered;
+        std::memset(buffer + buffered, 0, BLOCK - buffered);
+        compress(true);
+        unsigned char digest[MAX_SIZE];
+        for(size_t i = 0; i < 8; i++)
+            store64_le(digest + 8 * i, h[i]);
+        std::memcpy(out, digest, out_length);
+        OPENSSL_cleanse(digest, sizeof(digest));
+    }
+
+private:
+    static const uint64_t IV[8];
+    static const uint8_t SIGMA[12][16];
+
+    void compress(bool last)
+    {
+        uint64_t m[16], v[16];
+        for(size_t i = 0; i < 16; i++)
+            m[i] = load64_le(buffer + 8 * i);
+        std::copy(h, h + 8, v);
+        std::copy(IV, IV + 8, v + 8);
+        v[12] ^= counter;
+        if(last)
+            v[14] = ~v[14];
+
+        auto g = [&](const uint8_t *s, size_t a, size_t b, size_t c, size_t d) {
+            v[a] += v[b] + m[s[0]];
+            v[d] = rotr64(v[d] ^ v[a], 32);
+            v[c] += v[d];
+            v[b] = rotr64(v[b] ^ v[c], 24);
+            v[a] += v[b] + m[s[1]];
+            v[d] = rotr64(v[d] ^ v[a], 16);
+            v[c] += v[d];
+            v[b] = rotr64(v[b] ^ v[c], 63);
+        };
+        for(size_t r = 0; r < 12; r++) {
+            const uint8_t *s = SIGMA[r];
+            g(s, 0, 4, 8, 12);
+            g(s + 2, 1, 5, 9, 13);
+            g(s + 4, 2, 6, 10, 14);
+            g(s + 6, 3, 7, 11, 15);
+            g(s + 8, 0, 5, 10, 15);
+            g(s + 10, 1, 6, 11, 12);
+            g(s + 12, 2, 7, 8, 13);
+            g(s + 14, 3, 4, 9, 14);
+        }
+        for(size_t i = 0; i < 8; i++)
+            h[i] ^= v[i] ^ v[i + 8];
+        OPENSSL_cleanse(m, sizeof(m));
+        OPENSSL_cleanse(v, sizeof(v));
+    }
+
+    const size_t out_length;
+    uint64_t h[8];
+    unsigned char buffer[BLOCK];
+    size_t buffered{0};
+    // messages here are far below 2^64 bytes
+    uint64_t counter{0};
+};
+
+const uint64_t blake2b::IV[8] = {
+    0x6a09e667f3bcc908, 0xbb67ae8584caa73b, 0x3c6ef372fe94f82b,
+    0xa54ff53a5f1d36f1, 0x510e527fade682d1, 0x9b05688c2b3e6c1f,
+    0x1f83d9abfb41bd6b, 0x5be0cd19137e2179
+};
+
+const uint8_t blake2b::SIGMA[12][16] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 },
+    { 11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4 },
+    { 7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8 },
+    { 9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13 },
+    { 2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9 },
+    { 12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11 },
+    { 13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10 },
+    { 6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5 },
+    { 10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0 },
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 }
+};
+
+// Argon2 H': BLAKE2b with any output length
+void blake2b_long(unsigned char *out, uint32_t out_length, const void *in,
+                  size_t length)
+{
+    if(out_length <= blake2b::MAX_SIZE) {
+        blake2b b(out_length);
+        b.update32(out_length);
+        b.update(in, length);
+        b.final(out);
+        return;
+    }
+
+    // 32 bytes of each 64 byte hash of the previous one, all of the last
+    unsigned char v[blake2b::MAX_SIZE];
+    {
+        blake2b b(blake2b::MAX_SIZE);
+        b.update32(out_length);
+        b.update(in, length);
+        b.final(v);
+    }
+    std::memcpy(out, v, 32);
+    out += 32;
+    uint32_t remaining = out_length - 32;
+    while(remaining > blake2b::MAX_SIZE) {
+        blake2b b(blake2b::MAX_SIZE);
+        b.update(v, sizeof(v));
+        b.final(v);
+        std::memcpy(out, v, 32);
+        out += 32;
+        remaining -= 32;
+    }
+    blake2b b(remaining);
+    b.update(v, sizeof(v));
+    b.final(out);
+    OPENSSL_cleanse(v, sizeof(v));
+}
+
+namespace argon2 {
+
+const uint32_t VERSION = 0x13;
+const uint32_t TYPE_ID = 2;
+const uint32_t SYNC_POINTS = 4;
+const size_t BLOCK_WORDS = 128;
+const size_t BLOCK_SIZE = BLOCK_WORDS * 8;
+
+struct block {
+    uint64_t v[BLOCK_WORDS];
+};
+
+inline uint64_t blamka(uint64_t a, uint64_t b)
+{
+    return a + b + 2 * (a & 0xffffffff) * (b & 0xffffffff);
+}
+
+inline void g(uint64_t &a, uint64_t &b, uint64_t &c, uint64_t &d)
+{
+    a = blamka(a, b);
+    d = rotr64(d ^ a, 32);
+    c = blamka(c, d);
+    b = rotr64(b ^ c, 24);
+    a = blamka(a, b);
+    d = rotr64(d ^ a, 16);
+    c = blamka(c, d);
+    b = rotr64(b ^ c, 63);
+}
+
+// BLAKE2b round without message, multiplications from BlaMka. On the 16
+// words of a row at v, or on the column of 2 words per row at v.
+template<bool COLUMN>
+inline void round(uint64_t *v)
+{
+    auto at = [v](size_t k) -> uint64_t & {
+        return COLUMN ? v[16 * (k >> 1) + (k & 1)] : v[k];
+    };
+    g(at(0), at(4), at(8), at(12));
+    g(at(1), at(5), at(9), at(13));
+    g(at(2), at(6), at(10), at(14));
+    g(at(3), at(7), at(11), at(15));
+    g(at(0), at(5), at(10), at(15));
+    g(at(1), at(6), at(11), at(12));
+    g(at(2), at(7), at(8), at(13));
+    g(at(3), at(4), at(9), at(14));
+}
+
+// next = G(prev, ref), xor the old next in later passes
+void fill_block(const block &prev, const block &ref, block &next,
+                bool with_xor)
+{
+    block r, t;
+    for(size_t i = 0; i < BLOCK_WORDS; i++)
+        r.v[i] = prev.v[i] ^ ref.v[i];
+    t = r;
+    if(with_xor)
+        for(size_t i = 0; i < BLOCK_WORDS; i++)
+            t.v[i] ^= next.v[i];
+
+    // 8 rows of 16 words, then 8 columns of 2 words per row
+    for(size_t row = 0; row < 8; row++)
+        round<false>(r.v + 16 * row);
+    for(size_t column = 0; column < 8; column++)
+        round<true>(r.v + 2 * column);
+
+    for(size_t i = 0; i < BLOCK_WORDS; i++)
+        next.v[i] = t.v[i] ^ r.v[i];
+}
+
+void load_block(block &b, const unsigned char *in)
+{
+    for(size_t i = 0; i < BLOCK_WORDS; i++)
+        b.v[i] = load64_le(in + 8 * i);
+}
+
+void store_block(unsigned char *out, const block &b)
+{
+    for(size_t i = 0; i < BLOCK_WORDS; i++)
+        store64_le(out + 8 * i, b.v[i]);
+}
+
+struct instance {
+    std::vector<block> memory;
+    uint32_t passes;
+    uint32_t lanes;
+    uint32_t lane_length;
+    uint32_t segment_length;
+
+    ~instance()
+    {
+        if(!memory.empty())
+            OPENSSL_cleanse(memory.data(), memory.size() * sizeof(block));
+    }
+
+    // block index in the lane for the pseudo random value of block index
+    // of the segment
+    uint32_t reference_index(uint32_t pass, uint32_t slice, uint32_t index,
+                             uint64_t pseudo_rand, bool same_lane) const
+    {
+        uint64_t area;
+        if(pass == 0) {
+            if(slice == 0)
+                area = index - 1;
+            else if(same_lane)
+                area = uint64_t(slice) * segment_length + index - 1;
+            else
+                area = uint64_t(slice) * segment_length - (index == 0);
+        } else {
+            if(same_lane)
+                area = lane_length - segment_length + index - 1;
+            else
+                area = lane_length - segment_length - (index == 0);
+        }
+
+        uint64_t relative = pseudo_rand & 0xffffffff;
+        relative = relative * relative >> 32;
+        relative = area - 1 - (area * relative >> 32);
+        const uint64_t start = pass == 0 || slice == SYNC_POINTS - 1
+            ? 0 : uint64_t(slice + 1) * segment_length;
+        return static_cast<uint32_t>((start + relative) % lane_length);
+    }
+
+    void fill_segment(uint32_t pass, uint32_t slice, uint32_t lane)
+    {
+        // Argon2i addressing in the first half of the first pass
+        const bool independent = pass == 0 && slice < SYNC_POINTS / 2;
+        block zero{}, input{}, address{};
+        auto next_addresses = [&]() {
+            input.v[6]++;
+            fill_block(zero, input, address, false);
+            fill_block(zero, address, address, false);
+        };
+        if(independent) {
+            input.v[0] = pass;
+            input.v[1] = lane;
+            input.v[2] = slice;
+            input.v[3] = memory.size();
+            input.v[4] = passes;
+            input.v[5] = TYPE_ID;
+        }
+
+        uint32_t start = 0;
+        if(pass == 0 && slice == 0) {
+            // the first two blocks come from H0
+            start = 2;
+            if(independent)
+                next_addresses();
+        }
+
+        const size_t lane_begin = size_t(lane) * lane_length;
+        size_t current = lane_begin + slice * segment_length + start;
+        size_t previous = current % lane_length == 0
+            ? current + lane_length - 1 : current - 1;
+        for(uint32_t i = start; i < segment_length;
+            i++, current++, previous++) {
+            if(current % lane_length == 1)
+                previous = current - 1;
+
+            uint64_t pseudo_rand;
+            if(independent) {
+                if(i % BLOCK_WORDS == 0)
+                    next_addresses();
+                pseudo_rand = address.v[i % BLOCK_WORDS];
+            } else {
+                pseudo_rand = memory[previous].v[0];
+            }
+
+            uint32_t ref_lane = static_cast<uint32_t>((pseudo_rand >> 32)
+                                                      % lanes);
+            if(pass == 0 && slice == 0)
+                ref_lane = lane;
+            const uint32_t ref_index = reference_index(
+                pass, slice, i, pseudo_rand, ref_lane == lane);
+            fill_block(memory[previous],
+                       memory[size_t(ref_lane) * lane_length + ref_index],
+                       memory[current], pass != 0);
+        }
+    }
+};
+
+}
+
+// Salsa20/8 core on 16 words
+void salsa20_8(uint32_t *b)
+{
+    uint32_t x[16];
+    std::copy(b, b + 16, x);
+    for(size_t i = 0; i < 8; i += 2) {
+        x[4] ^= rotl32(x[0] + x[12], 7);   x[8] ^= rotl32(x[4] + x[0], 9);
+        x[12] ^= rotl32(x[8] + x[4], 13);  x[0] ^= rotl32(x[12] + x[8], 18);
+        x[9] ^= rotl32(x[5] + x[1], 7);    x[13] ^= rotl32(x[9] + x[5], 9);
+        x[1] ^= rotl32(x[13] + x[9], 13);  x[5] ^= rotl32(x[1] + x[13], 18);
+        x[14] ^= rotl32(x[10] + x[6], 7);  x[2] ^= rotl32(x[14] + x[10], 9);
+        x[6] ^= rotl32(x[2] + x[14], 13);  x[10] ^= rotl32(x[6] + x[2], 18);
+        x[3] ^= rotl32(x[15] + x[11], 7);  x[7] ^= rotl32(x[3] + x[15], 9);
+        x[11] ^= rotl32(x[7] + x[3], 13);  x[15] ^= rotl32(x[11] + x[7], 18);
+        x[1] ^= rotl32(x[0] + x[3], 7);    x[2] ^= rotl32(x[1] + x[0], 9);
+        x[3] ^= rotl32(x[2] + x[1], 13);   x[0] ^= rotl32(x[3] + x[2], 18);
+        x[6] ^= rotl32(x[5] + x[4], 7);    x[7] ^= rotl32(x[6] + x[5], 9);
+        x[4] ^= rotl32(x[7] + x[6], 13);   x[5] ^= rotl32(x[4] + x[7], 18);
+        x[11] ^= rotl32(x[10] + x[9], 7);  x[8] ^= rotl32(x[11] + x[10], 9);
+        x[9] ^= rotl32(x[8] + x[11], 13);  x[10] ^= rotl32(x[9] + x[8], 18);
+        x[12] ^= rotl32(x[15] + x[14], 7); x[13] ^= rotl32(x[12] + x[15], 9);
+        x[14] ^= rotl32(x[13] + x[12], 13); x[15] ^= rotl32(x[14] + x[13], 18);
+    }
+    for(size_t i = 0; i < 16; i++)
+        b[i] += x[i];
+}
+
+// RFC 7914 BlockMix with Salsa20/8 on 2 * r 64 byte blocks of 16 words,
+// y is scratch space of the same size
+void block_mix(uint32_t *b, uint32_t *y, uint32_t r)
+{
+    uint32_t x[16];
+    std::copy(b + (2 * r - 1) * 16, b + 2 * r * 16, x);
+    for(size_t i = 0; i < 2 * r; i++) {
+        for(size_t k = 0; k < 16; k++)
+            x[k] ^= b[16 * i + k];
+        salsa20_8(x);
+        // even blocks to the first half, odd ones to the second
+        std::copy(x, x + 16, y + 16 * ((i & 1) * r + i / 2));
+    }
+    std::copy(y, y + 32 * r, b);
+}
+
+// RFC 7914 ROMix of the 128 * r bytes at p, v has N * 32 * r words
+void ro_mix(unsigned char *p, uint32_t r, uint64_t N, uint32_t *v)
+{
+    const size_t words = 32 * size_t(r);
+    std::vector<uint32_t> x(words), y(words);
+    for(size_t k = 0; k < words; k++)
+        x[k] = load32_le(p + 4 * k);
+
+    for(uint64_t i = 0; i < N; i++) {
+        std::copy(x.begin(), x.end(), v + i * words);
+        block_mix(x.data(), y.data(), r);
+    }
+    for(uint64_t i = 0; i < N; i++) {
+        // Integerify: the first 64 bit of the last 64 byte block
+        const uint64_t j = (uint64_t(x[words - 16])
+                            | uint64_t(x[words - 15]) << 32) & (N - 1);
+        const uint32_t *vj = v + j * words;
+        for(size_t k = 0; k < words; k++)
+            x[k] ^= vj[k];
+        block_mix(x.data(), y.data(), r);
+    }
+
+    for(size_t k = 0; k < words; k++)
+        store32_le(p + 4 * k, x[k]);
+    OPENSSL_cleanse(x.data(), words * 4);
+    OPENSSL_cleanse(y.data(), words * 4);
+}
+
+}
+
+const size_t libaan::kdf_params::SERIALIZED_SIZE;
+const uint32_t libaan::kdf_params::MAX_ITERATIONS;
+const uint32_t libaan::kdf_params::MAX_PASSES;
+const uint32_t libaan::kdf_params::MAX_MEMORY_KIB;
+const uint32_t libaan::kdf_params::MAX_PARALLELISM;
+
+libaan::kdf_params libaan::kdf_params::pbkdf2(uint32_t iterations,
+                                              algorithm_type algorithm)
+{
+    kdf_params params;
+    params.algorithm = algorithm;
+    params.iterations = iterations;
+    params.memory_kib = 0;
+    params.parallelism = 1;
+    return params;
+}
+
+libaan::kdf_params libaan::kdf_params::scrypt(uint32_t memory_kib, uint32_t p)
+{
+    kdf_params params;
+    params.algorithm = SCRYPT;
+    params.iterations = 0;
+    params.memory_kib = memory_kib;
+    params.parallelism = p;
+    return params;
+}
+
+libaan::kdf_params libaan::kdf_params::argon2id(uint32_t passes,
+                                                uint32_t memory_kib,
+                                                uint32_t lanes)
+{
+    kdf_params params;
+    params.algorithm = ARGON2ID;
+    params.iterations = passes;
+    params.memory_kib = memory_kib;
+    params.parallelism = lanes;
+    return params;
+}
+
+bool libaan::kdf_params::valid() const
+{
+    switch(algorithm) {
+    case PBKDF2_SHA1:
+    case PBKDF2_SHA256:
+        return iterations > 0 && iterations <= MAX_ITERATIONS;
+    case SCRYPT:
+        // N = memory_kib with r = 8
+        return memory_kib > 1 && !(memory_kib & (memory_kib - 1))
+            && parallelism > 0 && parallelism <= MAX_PARALLELISM
+            && uint64_t(memory_kib) * parallelism <= MAX_MEMORY_KIB;
+    case ARGON2ID:
+        return iterations > 0 && iterations <= MAX_PASSES
+            && parallelism > 0 && parallelism <= MAX_PARALLELISM
+            && memory_kib >= 8 * parallelism && memory_kib <= MAX_MEMORY_KIB;
+    }
+    return false;
+}
+
+std::string libaan::kdf_params::serialize() const
+{
+    std::string out(SERIALIZED_SIZE, '\0');
+    auto p = reinterpret_cast<unsigned char *>(&out[0]);
+    p[0] = static_cast<unsigned char>(algorithm);
+    store32_be(p + 1, iterations);
+    store32_be(p + 5, memory_kib);
+    store32_be(p + 9, parallelism);
+    return out;
+}
+
+bool libaan::kdf_params::deserialize(const std::string &in)
+{
+    if(in.size() != SERIALIZED_SIZE || uint8_t(in[0]) > ARGON2ID)
+        return false;
+    auto p = reinterpret_cast<const unsigned char *>(in.data());
+    kdf_params params;
+    params.algorithm = static_cast<algorithm_type>(p[0]);
+    params.iterations = load32_be(p + 1);
+    params.memory_kib = load32_be(p + 5);
+    params.parallelism = load32_be(p + 9);
+    params.threads = threads;
+    if(!params.valid())
+        return false;
+    *this = params;
+    return true;
+}
+
+namespace {
+
+bool derive(const libaan::kdf_params &params, const std::string &password,
+            const std::string &salt, std::string &key)
+{
+    using libaan::kdf_params;
+    switch(params.algorithm) {
+    case kdf_params::PBKDF2_SHA1:
+        return libaan::pbkdf2(password, salt, params.iterations, key,
+                              libaan::digest::SHA1, params.threads);
+    case kdf_params::PBKDF2_SHA256:
+        return libaan::pbkdf2(password, salt, params.iterations, key,
+                              libaan::digest::SHA256, params.threads);
+    case kdf_params::SCRYPT:
+        return libaan::scrypt(password, salt, params.memory_kib, 8,
+                              params.parallelism, key, params.threads);
+    case kdf_params::ARGON2ID:
+        return libaan::argon2id(password, salt, params.iterations,
+                                params.memory_kib, params.parallelism, key,
+                                params.threads);
+    }
+    return false;
+}
+
+}
+
+bool libaan::derive_key(const kdf_params &params, const std::string &password,
+                        const std::string &salt, std::string &key,
+                        key_cache *cache)
+{
+    if(!params.valid() || key.empty())
+        return false;
+    if(cache && cache->get(params, password, salt, key))
+        return true;
+    if(!derive(params, password, salt, key))
+        return false;
+    if(cache)
+        cache->put(params, password, salt, key);
+    return true;
+}
+
+namespace {
+
+const size_t CACHE_SECRET_SIZE = 32;
+const size_t CACHE_ID_SIZE = SHA256_DIGEST_LENGTH;
+
+int64_t steady_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+struct libaan::key_cache::entry {
+    unsigned char id[CACHE_ID_SIZE];
+    unsigned char key[MAX_KEY_SIZE];
+    // steady clock in ns, 0 for a free entry
+    int64_t expires;
+};
+
+const size_t libaan::key_cache::MAX_KEY_SIZE;
+
+libaan::key_cache::key_cache(std::chrono::milliseconds ttl, size_t capacity)
+    : ttl(ttl), capacity(capacity)
+{
+    // the secret, then the entries, in whole pages
+    const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t size = (sizeof(entry) + capacity * sizeof(entry) + page - 1)
+        / page * page;
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED)
+        return;
+    if(mlock(p, size) != 0) {
+        munmap(p, size);
+        return;
+    }
+#ifdef MADV_DONTDUMP
+    madvise(p, size, MADV_DONTDUMP);
+#endif
+    auto bytes = static_cast<unsigned char *>(p);
+    if(RAND_bytes(bytes, CACHE_SECRET_SIZE) != 1) {
+        munlock(p, size);
+        munmap(p, size);
+        return;
+    }
+    mapping = p;
+    mapping_size = size;
+    secret = bytes;
+    // the mapping is zeroed, all entries are free
+    entries = static_cast<entry *>(static_cast<void *>(bytes + sizeof(entry)));
+}
+
+libaan::key_cache::~key_cache()
+{
+    if(!mapping)
+        return;
+    OPENSSL_cleanse(mapping, mapping_size);
+    munlock(mapping, mapping_size);
+    munmap(mapping, mapping_size);
+}
+
+bool libaan::key_cache::id(const kdf_params &params,
+                           const std::string &password,
+                           const std::string &salt, size_t key_length,
+                           unsigned char *out) const
+{
+    // HMAC-SHA256(secret, |password| password params |key| salt)
+    unsigned char length[8];
+    const std::string p = params.serialize();
+    unsigned int out_length;
+    HMAC_CTX ctx;
+    HMAC_CTX_init(&ctx);
+    bool ok = HMAC_Init_ex(&ctx, secret, CACHE_SECRET_SIZE, EVP_sha256(),
+                           nullptr) == 1;
+    store64_le(length, password.size());
+    ok = ok && HMAC_Update(&ctx, length, 8) == 1
+        && HMAC_Update(&ctx, reinterpret_cast<const unsigned char *>(
+                           password.data()), password.size()) == 1
+        && HMAC_Update(&ctx, reinterpret_cast<const unsigned char *>(p.data()),
+                       p.size()) == 1;
+    store64_le(length, key_length);
+    ok = ok && HMAC_Update(&ctx, length, 8) == 1
+        && HMAC_Update(&ctx, reinterpret_cast<const unsigned char *>(
+                           salt.data()), salt.size()) == 1
+        && HMAC_Final(&ctx, out, &out_length) == 1;
+    HMAC_CTX_cleanup(&ctx);
+    return ok;
+}
+
+libaan::key_cache::entry *libaan::key_cache::find(
+    const unsigned char *entry_id, int64_t now)
+{
+    entry *found = nullptr;
+    for(size_t i = 0; i < capacity; i++) {
+        entry &e = entries[i];
+        if(!e.expires)
+            continue;
+        if(e.expires <= now)
+            OPENSSL_cleanse(&e, sizeof(e));
+        else if(!CRYPTO_memcmp(e.id, entry_id, CACHE_ID_SIZE))
+            found = &e;
+    }
+    return found;
+}
+
+bool libaan::key_cache::get(const kdf_params &params,
+                            const std::string &password,
+                            const std::string &salt, std::string &key)
+{
+    unsigned char entry_id[CACHE_ID_SIZE];
+    if(!mapping || key.empty() || key.size() > MAX_KEY_SIZE
+       || !id(params, password, salt, key.size(), entry_id))
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const entry *e = find(entry_id, steady_now());
+    if(e)
+        std::memcpy(&key[0], e->key, key.size());
+    return e;
+}
+
+void libaan::key_cache::put(const kdf_params &params,
+                            const std::string &password,
+                            const std::string &salt, const std::string &key)
+{
+    unsigned char entry_id[CACHE_ID_SIZE];
+    if(!mapping || !capacity || ttl.count() <= 0 || key.empty()
+       || key.size() > MAX_KEY_SIZE
+       || !id(params, password, salt, key.size(), entry_id))
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const int64_t now = steady_now();
+    entry *e = find(entry_id, now);
+    // a free entry or the one that expires first
+    for(size_t i = 0; !e && i < capacity; i++)
+        if(!entries[i].expires)
+            e = &entries[i];
+    if(!e)
+        e = std::min_element(entries, entries + capacity,
+                             [](const entry &a, const entry &b) {
+                                 return a.expires < b.expires;
+                             });
+    OPENSSL_cleanse(e, sizeof(*e));
+    std::memcpy(e->id, entry_id, CACHE_ID_SIZE);
+    std::memcpy(e->key, key.data(), key.size());
+    e->expires = now + std::chrono::duration_cast<std::chrono::nanoseconds>(
+        ttl).count();
+}
+
+void libaan::key_cache::purge()
+{
+    if(!mapping)
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    OPENSSL_cleanse(entries, capacity * sizeof(entry));
+}
+
+size_t libaan::key_cache::purge_expired()
+{
+    if(!mapping)
+        return 0;
+    std::lock_guard<std::mutex> lock(mutex);
+    const int64_t now = steady_now();
+    size_t purged = 0;
+    for(size_t i = 0; i < capacity; i++) {
+        if(entries[i].expires && entries[i].expires <= now) {
+            OPENSSL_cleanse(&entries[i], sizeof(entry));
+            purged++;
+        }
+    }
+    return purged;
+}
+
+size_t libaan::key_cache::size()
+{
+    if(!mapping)
+        return 0;
+    std::lock_guard<std::mutex> lock(mutex);
+    const int64_t now = steady_now();
+    return static_cast<size_t>(std::count_if(
+        entries, entries + capacity,
+        [now](const entry &e) { return e.expires > now; }));
+}
+
+bool libaan::scrypt(const std::string &password, const std::string &salt,
+                    uint64_t N, uint32_t r, uint32_t p, std::string &key,
+                    unsigned threads)
+{
+    if(N < 2 || (N & (N - 1)) || !r || !p || uint64_t(r) * p >= (1u << 30)
+       || key.empty())
+        return false;
+    // N * 128 * r bytes must be addressable
+    const size_t words = 32 * size_t(r);
+    if(N > SIZE_MAX / 4 / words)
+        return false;
+
+    threads = std::max(1u, std::min(threads, p));
+    try {
+        std::string b(size_t(p) * 128 * r, '\0');
+        if(!pbkdf2(password, salt, 1, b, digest::SHA256))
+            return false;
+
+        std::vector<std::vector<uint32_t> > v(threads);
+        for(auto &t: v)
+            t.resize(N * words);
+        // ROMix of the p blocks, thread t uses v[t]
+        const uint32_t chunk = (p + threads - 1) / threads;
+        parallel_for(threads, threads, [&](uint32_t t) {
+                for(uint32_t i = t * chunk; i < std::min(p, (t + 1) * chunk);
+                    i++)
+                    ro_mix(reinterpret_cast<unsigned char *>(&b[0])
+                           + size_t(i) * 128 * r, r, N, v[t].data());
+            });
+        for(auto &t: v)
+            OPENSSL_cleanse(t.data(), t.size() * 4);
+
+        const bool ok = pbkdf2(password, b, 1, key, digest::SHA256);
+        OPENSSL_cleanse(&b[0], b.size());
+        return ok;
+    } catch(const std::bad_alloc &) {
+        return false;
+    }
+}
+
+bool libaan::argon2id(const std::string &password, const std::string &salt,
+                      uint32_t passes, uint32_t memory_kib, uint32_t lanes,
+                      std::string &key, unsigned threads,
+                      const std::string &secret,
+                      const std::string &associated_data)
+{
+    using namespace argon2;
+    if(!passes || !lanes || lanes >= (1u << 24)
+       || memory_kib < 2 * SYNC_POINTS * lanes || key.size() < 4
+       || key.size() > UINT32_MAX || salt.size() < 8)
+        return false;
+    const auto tag_length = static_cast<uint32_t>(key.size());
+
+    // H0 over all parameters and inputs
+    unsigned char h0[blake2b::MAX_SIZE + 8];
+    {
+        blake2b b(blake2b::MAX_SIZE);
+        for(const uint32_t v: { lanes, tag_length, memory_kib, passes,
+                                VERSION, TYPE_ID })
+            b.update32(v);
+        for(const auto *s: { &password, &salt, &secret, &associated_data }) {
+            b.update32(static_cast<uint32_t>(s->size()));
+            b.update(s->data(), s->size());
+        }
+        b.final(h0);
+    }
+
+    try {
+        instance a;
+        a.passes = passes;
+        a.lanes = lanes;
+        a.segment_length = memory_kib / (lanes * SYNC_POINTS);
+        a.lane_length = a.segment_length * SYNC_POINTS;
+        a.memory.resize(size_t(a.lane_length) * lanes);
+
+        // the first two blocks of each lane: H'(H0 || j || lane)
+        unsigned char bytes[BLOCK_SIZE];
+        for(uint32_t lane = 0; lane < lanes; lane++) {
+            for(uint32_t j = 0; j < 2; j++) {
+                store32_le(h0 + blake2b::MAX_SIZE, j);
+                store32_le(h0 + blake2b::MAX_SIZE + 4, lane);
+                blake2b_long(bytes, BLOCK_SIZE, h0, sizeof(h0));
+                load_block(a.memory[size_t(lane) * a.lane_length + j], bytes);
+            }
+        }
+        OPENSSL_cleanse(h0, sizeof(h0));
+
+        // the segments of a slice only reference other lanes in finished
+        // slices, the lanes of a slice can be filled at the same time
+        for(uint32_t pass = 0; pass < passes; pass++)
+            for(uint32_t slice = 0; slice < SYNC_POINTS; slice++)
+                parallel_for(threads, lanes, [&](uint32_t lane) {
+                        a.fill_segment(pass, slice, lane);
+                    });
+
+        // xor of the last blocks of all lanes
+        block last = a.memory[a.lane_length - 1];
+        for(uint32_t lane = 1; lane < lanes; lane++) {
+            const block &b = a.memory[size_t(lane) * a.lane_length
+                                      + a.lane_length - 1];
+            for(size_t i = 0; i < BLOCK_WORDS; i++)
+                last.v[i] ^= b.v[i];
+        }
+        store_block(bytes, last);
+        blake2b_long(reinterpret_cast<unsigned char *>(&key[0]), tag_length,
+                     bytes, sizeof(bytes));
+        OPENSSL_cleanse(bytes, sizeof(bytes));
+        OPENSSL_cleanse(&last, sizeof(last));
+        return true;
+    } catch(const std::bad_alloc &) {
+        OPENSSL_cleanse(h0, sizeof(h0));
+        return false;
+    }
+}
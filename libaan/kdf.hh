@@ -0,0 +1,159 @@
+#ifndef _LIBAAN_KDF_HH_
+#define _LIBAAN_KDF_HH_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace libaan {
+
+/* Password based key derivation. The parameters are stored next to the
+   salt (see crypto_file), so unlock latency and attack cost can be tuned
+   per deployment and old data stays readable.
+
+   algorithm      iterations        memory_kib          parallelism
+   PBKDF2_SHA1    iterations        -                   -
+   PBKDF2_SHA256  iterations        -                   -
+   SCRYPT         -                 N * r * 128 / 1024  p
+   ARGON2ID       passes            memory              lanes
+
+   scrypt uses r = 8, memory_kib must be a power of 2 (N = memory_kib, at
+   least 2). threads is not stored, it only changes how fast the same key
+   is derived: PBKDF2 blocks, scrypt p and Argon2 lanes run concurrently.
+
+   The parameters are read before anything in a file can be authenticated,
+   so valid() also bounds the cost: a corrupted or forged header must not
+   make derive_key() run for hours or allocate terabytes. scrypt p runs
+   memory_kib * p KiB of ROMix in total, bounded by MAX_MEMORY_KIB.
+*/
+struct kdf_params {
+    enum algorithm_type {
+        PBKDF2_SHA1,
+        PBKDF2_SHA256,
+        SCRYPT,
+        ARGON2ID
+    };
+    static const size_t SERIALIZED_SIZE = 13;
+    static const uint32_t MAX_ITERATIONS = 1u << 24;   // PBKDF2
+    static const uint32_t MAX_PASSES = 16;             // Argon2
+    static const uint32_t MAX_MEMORY_KIB = 1u << 22;   // 4 GiB
+    static const uint32_t MAX_PARALLELISM = 64;
+
+    algorithm_type algorithm{PBKDF2_SHA1};
+    // pbkdf2() used to run one iteration more than asked for, existing
+    // camellia_256 keys were derived with 1001 iterations
+    uint32_t iterations{1001};
+    uint32_t memory_kib{0};
+    uint32_t parallelism{1};
+    unsigned threads{1};
+
+    static kdf_params pbkdf2(uint32_t iterations,
+                             algorithm_type algorithm = PBKDF2_SHA256);
+    static kdf_params scrypt(uint32_t memory_kib, uint32_t p = 1);
+    static kdf_params argon2id(uint32_t passes, uint32_t memory_kib,
+                               uint32_t lanes = 1);
+
+    // parameters the backend accepts, within the limits above
+    bool valid() const;
+
+    // algorithm and the three parameters, SERIALIZED_SIZE bytes, big endian
+    std::string serialize() const;
+    // false for unknown algorithms or invalid parameters
+    bool deserialize(const std::string &in);
+
+    bool operator==(const kdf_params &other) const
+    {
+        return algorithm == other.algorithm && iterations == other.iterations
+            && memory_kib == other.memory_kib
+            && parallelism == other.parallelism;
+    }
+    bool operator!=(const kdf_params &other) const { return !(*this == other); }
+};
+
+/* Derived keys for repeated derive_key() calls with the same password,
+   salt and parameters, e.g. the read() and write() of a crypto_file.
+   Opt-in, pass it to derive_key() or crypto_file::set_key_cache().
+   Entries and the random key of the cache are kept in one mlock'd mapping
+   that is not part of core dumps. Entries are zeroed when they expire
+   (ttl after they were derived), on purge() and on destruction. An entry
+   is found by an HMAC of password, parameters and salt under the random
+   key, neither the password nor a plain digest of it is stored.
+   Usage:
+   {
+       key_cache cache(std::chrono::minutes(5));
+       crypto_file f(path);
+       f.set_key_cache(&cache);
+       f.read(pw);
+       f.write(pw);   // no second key derivation
+   }
+*/
+class key_cache {
+public:
+    static const size_t MAX_KEY_SIZE = 64;
+
+    explicit key_cache(std::chrono::milliseconds ttl = std::chrono::minutes(5),
+                       size_t capacity = 16);
+    ~key_cache();
+    key_cache(const key_cache &) = delete;
+    key_cache &operator=(const key_cache &) = delete;
+
+    // false if the memory could not be locked, nothing is cached then
+    bool locked() const { return mapping != nullptr; }
+
+    // key is resized by the caller, false if there is no live entry
+    bool get(const kdf_params &params, const std::string &password,
+             const std::string &salt, std::string &key);
+    // replaces the entry that expires first if the cache is full
+    void put(const kdf_params &params, const std::string &password,
+             const std::string &salt, const std::string &key);
+
+    // zeroes all entries
+    void purge();
+    // zeroes the expired entries, returns their number
+    size_t purge_expired();
+    // live entries
+    size_t size();
+
+private:
+    struct entry;
+
+    bool id(const kdf_params &params, const std::string &password,
+            const std::string &salt, size_t key_length,
+            unsigned char *out) const;
+    entry *find(const unsigned char *entry_id, int64_t now);
+
+    const std::chrono::milliseconds ttl;
+    const size_t capacity;
+    size_t mapping_size{0};
+    void *mapping{nullptr};
+    // in the mapping
+    unsigned char *secret{nullptr};
+    entry *entries{nullptr};
+    std::mutex mutex;
+};
+
+// key is resized by the caller to the wanted length. With a cache, a key
+// derived before with the same arguments is taken from it.
+bool derive_key(const kdf_params &params, const std::string &password,
+                const std::string &salt, std::string &key,
+                key_cache *cache = nullptr);
+
+// RFC 7914 scrypt with N * r * 128 bytes of memory per thread. N is a power
+// of 2. With threads > 1 the p ROMix calls run concurrently.
+bool scrypt(const std::string &password, const std::string &salt, uint64_t N,
+            uint32_t r, uint32_t p, std::string &key, unsigned threads = 1);
+
+// RFC 9106 Argon2id (version 0x13) with memory_kib 1 KiB blocks, at least
+// 8 * lanes. With threads > 1 the lanes of a slice are filled concurrently.
+// key is at least 4 bytes.
+bool argon2id(const std::string &password, const std::string &salt,
+              uint32_t passes, uint32_t memory_kib, uint32_t lanes,
+              std::string &key, unsigned threads = 1,
+              const std::string &secret = std::string(),
+              const std::string &associated_data = std::string());
+
+}
+
+#endif
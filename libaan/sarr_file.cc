@@ -0,0 +1,186 @@
+#include "sarr_file.hh"
+#include "byte.hh"
+
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const uint32_t FLAG_LCP = 1;
+
+struct header_type {
+    char magic[4];
+    char version[4];
+    uint64_t length;
+    uint32_t element_size;
+    uint32_t flags;
+    uint64_t suffix_array_offset;
+    uint64_t lcp_offset;
+    uint64_t text_offset;
+    uint64_t file_size;
+    uint32_t byte_order;
+    uint32_t reserved;
+};
+static_assert(sizeof(header_type) == libaan::search::SARR_HEADER_SIZE,
+              "sarr_file header size");
+
+// count elements at offset lie in the file behind the header. Written so
+// that values from a crafted header can not overflow.
+bool in_file(uint64_t offset, uint64_t count, uint64_t element_size,
+             uint64_t file_size)
+{
+    return offset >= sizeof(header_type) && offset <= file_size
+        && count <= (file_size - offset) / element_size;
+}
+
+}
+
+template<typename index_t>
+typename libaan::search::basic_sarr_file<index_t>::error_type
+libaan::search::basic_sarr_file<index_t>::write(const std::string &file_name,
+                                                const sarr_type &sarr)
+{
+    const uint64_t n = sarr.size();
+    const uint64_t array_size = n * sizeof(index_t);
+    const bool with_lcp = sarr.get_lcp() && sarr.get_left_lcp()
+        && sarr.get_right_lcp();
+
+    header_type header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SARR_MAGIC.data(), sizeof(header.magic));
+    std::memcpy(header.version, SARR_VERSION_0010.data(),
+                sizeof(header.version));
+    header.length = n;
+    header.element_size = sizeof(index_t);
+    header.flags = with_lcp ? FLAG_LCP : 0;
+    header.suffix_array_offset = SARR_HEADER_SIZE;
+    const uint64_t suffix_array_end = header.suffix_array_offset + array_size;
+    header.lcp_offset = with_lcp ? roundtonext8(suffix_array_end) : 0;
+    header.text_offset = roundtonext8(with_lcp
+                                      ? header.lcp_offset + 3 * array_size
+                                      : suffix_array_end);
+    header.file_size = header.text_offset + n + 1;
+    header.byte_order = BYTE_ORDER_MARK;
+
+    // binary mode to avoid problems with different line endings under
+    // windows. truncate mode to overwrite the file everytime.
+    std::ofstream fp(file_name, std::ios_base::out | std::ios_base::binary
+                                | std::ios_base::trunc);
+    const auto write_array = [&fp, array_size](const index_t *a) {
+        fp.write(reinterpret_cast<const char *>(a), array_size);
+    };
+    const char padding[8] = {};
+
+    fp.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    write_array(sarr.get_suffix_array());
+    if(with_lcp) {
+        fp.write(padding, header.lcp_offset - suffix_array_end);
+        write_array(sarr.get_lcp());
+        write_array(sarr.get_left_lcp());
+        write_array(sarr.get_right_lcp());
+    }
+    fp.write(padding, header.text_offset
+                      - (with_lcp ? header.lcp_offset + 3 * array_size
+                                  : suffix_array_end));
+    fp.write(sarr.get_text(), n);
+    fp.put('\0');
+    fp.close();
+
+    return fp ? NO_ERROR : WRITE_FAILED;
+}
+
+template<typename index_t>
+typename libaan::search::basic_sarr_file<index_t>::error_type
+libaan::search::basic_sarr_file<index_t>::open(const std::string &file_name)
+{
+    close();
+
+    const int fd = ::open(file_name.c_str(), O_RDONLY);
+    if(fd == -1)
+        return error(OPEN_FAILED);
+
+    struct stat st;
+    if(fstat(fd, &st) == -1) {
+        ::close(fd);
+        return error(OPEN_FAILED);
+    }
+    const size_t file_size = st.st_size;
+    if(file_size < SARR_HEADER_SIZE) {
+        ::close(fd);
+        return error(NO_HEADER_IN_FILE);
+    }
+
+    void *data = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+    if(data == MAP_FAILED)
+        return error(OPEN_FAILED);
+    mapped_data = data;
+    mapped_size = file_size;
+
+    const char *base = static_cast<const char *>(mapped_data);
+    header_type header;
+    std::memcpy(&header, base, sizeof(header));
+    if(SARR_MAGIC.compare(0, SARR_MAGIC.size(), header.magic,
+                          sizeof(header.magic)) != 0
+       || SARR_VERSION_0010.compare(0, SARR_VERSION_0010.size(),
+                                    header.version, sizeof(header.version))
+              != 0
+       || header.byte_order != BYTE_ORDER_MARK) {
+        close();
+        return error(NO_HEADER_IN_FILE);
+    }
+    if(header.element_size != sizeof(index_t)) {
+        close();
+        return error(ELEMENT_SIZE);
+    }
+
+    // n is bounded by the file size first, so 3 * n and n + 1 do not wrap
+    const uint64_t n = header.length;
+    const bool with_lcp = header.flags & FLAG_LCP;
+    if(header.file_size != file_size
+       || n > sarr_index_traits<index_t>::max_size()
+       || n > file_size / sizeof(index_t)
+       || header.suffix_array_offset % 8 || header.lcp_offset % 8
+       || !in_file(header.suffix_array_offset, n, sizeof(index_t), file_size)
+       || (with_lcp && !in_file(header.lcp_offset, 3 * n, sizeof(index_t),
+                                file_size))
+       || !in_file(header.text_offset, n + 1, 1, file_size)) {
+        close();
+        return error(FILE_LENGTH);
+    }
+
+    typedef typename sarr_type::diff_type diff_type;
+    const index_t *suffixes
+        = reinterpret_cast<const index_t *>(base + header.suffix_array_offset);
+    const index_t *lcp = with_lcp
+        ? reinterpret_cast<const index_t *>(base + header.lcp_offset)
+        : nullptr;
+    sarr.reset(new sarr_type(base + header.text_offset,
+                             static_cast<diff_type>(n), suffixes, lcp,
+                             lcp ? lcp + n : nullptr,
+                             lcp ? lcp + 2 * n : nullptr));
+
+    return error(NO_ERROR);
+}
+
+template<typename index_t>
+void libaan::search::basic_sarr_file<index_t>::close()
+{
+    sarr.reset();
+    if(mapped_data)
+        munmap(mapped_data, mapped_size);
+    mapped_data = nullptr;
+    mapped_size = 0;
+}
+
+template class libaan::search::basic_sarr_file<int>;
+template class libaan::search::basic_sarr_file<std::uint32_t>;
+template class libaan::search::basic_sarr_file<std::uint64_t>;
+template class libaan::search::basic_sarr_file<libaan::uint40_t>;
@@ -0,0 +1,120 @@
+/* Suffix array index files. Written once, opened with mmap.
+
+VERSION 0010
+file format:
+64 bytes header
+suffix array, n elements
+optional lcp information, 3 * n elements: lcp, left_lcp, right_lcp of
+  search::sarr_lcp
+text, n bytes followed by a 0 byte
+
+Element size is the size of the index type the file was written with (int or
+uint32_t: 4, uint40_t: 5, uint64_t: 8), it must be opened with the same one.
+
+All sections start at a multiple of 8 bytes. Integers are stored in host byte
+order, files are only portable between machines of the same byte order.
+
+header format:
+4 bytes magic string
+4 bytes version string
+8 bytes text length n
+4 bytes element size of suffix array and lcp arrays
+4 bytes flags
+8 bytes offset of suffix array
+8 bytes offset of lcp information, 0 if not present
+8 bytes offset of text
+8 bytes file size
+4 bytes byte order mark 0x01020304
+4 bytes reserved
+size = 4 + 4 + 8 + 4 + 4 + 8 + 8 + 8 + 8 + 4 + 4 = 64
+*/
+
+#ifndef _LIBAAN_SARR_FILE_HH_
+#define _LIBAAN_SARR_FILE_HH_
+
+#include "string.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace libaan {
+namespace search {
+
+const size_t SARR_HEADER_SIZE = 64;
+const std::string SARR_MAGIC = {'\x13', '\x12', '\x11', '\x53'};
+const std::string SARR_VERSION_0010 = {'\x0', '\x0', '\x1', '\x0'};
+
+template<typename index_t>
+class basic_sarr_file {
+public:
+    enum error_type {
+        NO_ERROR,
+        OPEN_FAILED,
+        NO_HEADER_IN_FILE,
+        ELEMENT_SIZE,
+        FILE_LENGTH,
+        WRITE_FAILED
+    };
+
+    typedef basic_sarr_lcp<index_t> sarr_type;
+    typedef basic_sarr_range<index_t> range_type;
+
+public:
+    basic_sarr_file() {}
+    ~basic_sarr_file() { close(); }
+    basic_sarr_file(const basic_sarr_file &) = delete;
+    basic_sarr_file &operator=(const basic_sarr_file &) = delete;
+
+    // Write text, suffix array and, if available, the lcp information of
+    // sarr to file_name.
+    static error_type write(const std::string &file_name,
+                            const sarr_type &sarr);
+
+    // Map file_name read only and shared. Only the header is read, search()
+    // works on the page cache and the mapping can be shared between
+    // processes.
+    error_type open(const std::string &file_name);
+    void close();
+
+    // O(m + log(n)) if the file contains lcp information, else O(m * log(n))
+    // The range is valid while the file is open.
+    range_type search(const std::string &pattern) const
+    {
+        return sarr ? sarr->search(pattern) : range_type { nullptr, nullptr };
+    }
+
+    // nullptr if no file is open
+    const sarr_type *get() const { return sarr.get(); }
+
+    error_type get_last_error() const { return last_error; }
+    static std::string error_string(error_type err)
+    {
+        switch(err) {
+        case NO_ERROR: return "NO_ERROR";
+        case OPEN_FAILED: return "OPEN_FAILED";
+        case NO_HEADER_IN_FILE: return "NO_HEADER_IN_FILE";
+        case ELEMENT_SIZE: return "ELEMENT_SIZE";
+        case FILE_LENGTH: return "FILE_LENGTH";
+        case WRITE_FAILED: return "WRITE_FAILED";
+        }
+        return "UNKNOWN ERROR";
+    }
+
+private:
+    error_type error(error_type e) { last_error = e; return last_error; }
+
+private:
+    void *mapped_data{nullptr};
+    size_t mapped_size{0};
+    std::unique_ptr<sarr_type> sarr;
+    error_type last_error{NO_ERROR};
+};
+
+typedef basic_sarr_file<int> sarr_file;
+
+}
+}
+
+#endif
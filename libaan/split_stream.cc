@@ -0,0 +1,76 @@
+#include "split_stream.hh"
+#include "fd.hh"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+libaan::split_stream::split_stream(int fd, const string_type &delim,
+                                   size_t chunk_size)
+    : fd(fd), delim(delim), chunk_size(std::max<size_t>(1, chunk_size)),
+      data(nullptr), end(0), eof(false)
+{
+}
+
+libaan::split_stream::split_stream(const char *data, size_t length,
+                                   const string_type &delim)
+    : fd(-1), delim(delim), chunk_size(0), data(data), end(length), eof(true)
+{
+}
+
+void libaan::split_stream::read_chunk()
+{
+    if(begin > 0)
+        std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+    end -= begin;
+    scan -= begin;
+    begin = 0;
+    if(buffer.size() < end + chunk_size)
+        buffer.resize(std::max(buffer.size() * 2, end + chunk_size));
+    data = buffer.data();
+
+    // readall() returns an int
+    const size_t request = std::min<size_t>(buffer.size() - end, INT_MAX);
+    const int n = readall(fd, buffer.data() + end, request);
+    if(n < 0) {
+        read_error = true;
+        eof = true;
+        return;
+    }
+    // readall() only returns less than requested at the end of the file
+    if(static_cast<size_t>(n) < request)
+        eof = true;
+    end += static_cast<size_t>(n);
+}
+
+bool libaan::split_stream::next(string_type &token)
+{
+    if(delim.empty())
+        return false;
+
+    for(;;) {
+        const size_t found = search::find(data, end, delim.data(),
+                                          delim.size(), scan);
+        if(found != std::string::npos) {
+            const size_t start = begin;
+            begin = scan = found + delim.size();
+            if(found > start) {
+                token = string_type(data + start, found - start);
+                return true;
+            }
+            continue;
+        }
+
+        if(eof) {
+            if(read_error || end == begin)
+                return false;
+            token = string_type(data + begin, end - begin);
+            begin = scan = end;
+            return true;
+        }
+
+        // a delimiter may start in the last delim.size() - 1 bytes
+        scan = std::max(begin, end - std::min(end, delim.size() - 1));
+        read_chunk();
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef _LIBAAN_SPLIT_STREAM_HH_
+#define _LIBAAN_SPLIT_STREAM_HH_
+
+#include "string.hh"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace libaan {
+
+// split() for inputs that do not fit into memory. Tokens are handed out one
+// at a time like by split_view, empty tokens are skipped.
+// From a file descriptor the input is read with readall() in chunks of
+// chunk_size bytes. The unfinished token at the end of a chunk is moved to
+// the front of the buffer before the next chunk is read behind it, so the
+// buffer only grows for tokens longer than chunk_size.
+// From a memory region, e.g. an mmap'd file, tokens are views into it and
+// nothing is copied.
+class split_stream {
+public:
+    split_stream(int fd, char delim, size_t chunk_size = 1 << 20)
+        : split_stream(fd, std::string(1, delim), chunk_size) {}
+    split_stream(int fd, const string_type &delim,
+                 size_t chunk_size = 1 << 20);
+    split_stream(const char *data, size_t length, char delim)
+        : split_stream(data, length, std::string(1, delim)) {}
+    split_stream(const char *data, size_t length, const string_type &delim);
+
+    // Sets token to the next token, which stays valid until the next call.
+    // false at the end of the input or if reading failed.
+    bool next(string_type &token);
+
+    // reading from the file descriptor failed
+    bool error() const { return read_error; }
+
+private:
+    // moves the unfinished token to the front and appends the next chunk
+    void read_chunk();
+
+    int fd;
+    std::string delim;
+    size_t chunk_size;
+    std::vector<char> buffer;
+
+    const char *data;
+    // [begin, end) of data is not consumed yet, delimiters can only start
+    // at scan or later
+    size_t begin{0};
+    size_t end;
+    size_t scan{0};
+    bool eof;
+    bool read_error{false};
+};
+
+}
+
+#endif
@@ -2,97 +2,65 @@
 
 #include <algorithm>
 #include <iostream>
+#include <numeric>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 bool libaan::operator==(const string_type &lhs, const string_type &rhs)
 {
-    return lhs.l == rhs.l ? std::strncmp(lhs.s, rhs.s, lhs.l) == 0  : false;
+    return lhs.l == rhs.l ? std::memcmp(lhs.s, rhs.s, lhs.l) == 0  : false;
 }
 
 bool libaan::operator==(const char *lhs, const string_type &rhs)
 {
-    return std::strncmp(lhs, rhs.s, rhs.l) == 0 ;
+    return std::strlen(lhs) == rhs.l && std::memcmp(lhs, rhs.s, rhs.l) == 0;
 }
 
 bool libaan::operator==(const std::string &lhs, const string_type &rhs)
 {
-    return lhs.size() == rhs.l ? std::strncmp(lhs.data(), rhs.s, rhs.l) == 0 : false;
+    return lhs.size() == rhs.l ? std::memcmp(lhs.data(), rhs.s, rhs.l) == 0 : false;
 }
 
-std::vector<libaan::string_type>
-libaan::split2(const std::string &input, const std::string &delim)
+namespace {
+
+// Tokens of input separated by delim, empty tokens are skipped.
+std::vector<libaan::string_type> split_impl(const char *input, size_t n,
+                                            const char *delim, size_t m)
 {
-    std::vector<string_type> tokens;
-    if(delim.empty())
+    std::vector<libaan::string_type> tokens;
+    if(m == 0)
         return tokens;
 
-    std::string::size_type start = 0;
-    std::string::size_type end;
-
-    for(;;) {
-        end = input.find(delim, start);
-
-        // Just copied the last token
+    for(size_t start = 0;;) {
+        const auto end = libaan::search::find(input, n, delim, m, start);
         if(end == std::string::npos) {
-            const auto l = input.size() - start;
-            if(l > 0)
-                tokens.emplace_back(&input.data()[start], l);
+            if(n > start)
+                tokens.emplace_back(input + start, n - start);
             break;
         }
-
-        const auto l = end - start;
-        if(l == 0) {
-            start += delim.size();
-            continue;
-        }
-
-        tokens.emplace_back(&input.data()[start], l);
+        if(end > start)
+            tokens.emplace_back(input + start, end - start);
         // Exclude the delimiter in the next search
-        start = end + delim.size();
+        start = end + m;
     }
 
     return tokens;
 }
 
-std::vector<libaan::string_type> libaan::split(const string_type &input, const string_type &delim)
-{
-    std::vector<string_type> tokens;
-    if(delim.l == 0)
-        return tokens;
-
-    const char *start = input.s;
-    const char *end = nullptr;
-    const auto max = start + input.length();
-
-    for(;;) {
-        end = std::strstr(start, delim.s);
-
-        // Just copied the last token
-        if(end == nullptr) {
-            const auto size = input.s + input.l - start;
-            if((input.s + input.l) < start)
-                break;
-
-            if(size > 0)
-                tokens.emplace_back(start, size);
-
-            break;
-        }
-
-        if(end > max)
-            break;//std::cout << "libaan::split: end < start -> " << (size_t)start - (size_t)end << "\n";
-
-        const auto l = end - start;
-        if(l == 0) {
-            start += delim.l;
-            continue;
-        }
+}
 
-        tokens.emplace_back(start, l);
-        // Exclude the delimiter in the next search
-        start = end + delim.l;
-    }
+std::vector<libaan::string_type>
+libaan::split2(const std::string &input, const std::string &delim)
+{
+    return split_impl(input.data(), input.size(), delim.data(), delim.size());
+}
 
-    return tokens;
+std::vector<libaan::string_type> libaan::split(const string_type &input, const string_type &delim)
+{
+    return split_impl(input.s, input.l, delim.s, delim.l);
 }
 
 std::vector<libaan::string_type>
@@ -119,6 +87,221 @@ libaan::split(const string_type &input, char delim)
     return ret;
 }
 
+void libaan::hash_all(const string_type *tokens, size_t count,
+                      uint64_t *hashes, uint64_t seed)
+{
+    const size_t AHEAD = 8;
+    for(size_t i = 0; i < count; i++) {
+        if(i + AHEAD < count)
+            __builtin_prefetch(tokens[i + AHEAD].data());
+        hashes[i] = hash_bytes(tokens[i].data(), tokens[i].length(), seed);
+    }
+}
+
+void libaan::split_view::iterator::next()
+{
+    const char *s = view->input.data();
+    const size_t n = view->input.length();
+    while(pos < n) {
+        size_t end;
+        if(view->delim)
+            end = search::find(s, n, view->delim, view->delim_length, pos);
+        else {
+            const auto found = static_cast<const char *>(
+                std::memchr(s + pos, view->delim_char, n - pos));
+            end = found ? static_cast<size_t>(found - s) : std::string::npos;
+        }
+        if(end == std::string::npos)
+            end = n;
+        const size_t start = pos;
+        pos = end + view->delim_length;
+        if(end > start) {
+            token = string_type(s + start, end - start);
+            return;
+        }
+    }
+    token = string_type(nullptr, 0);
+}
+
+namespace {
+
+struct delimiter_set {
+    const unsigned char *table;
+    const unsigned char *nibbles;
+    const char *chars;
+    size_t count;
+};
+
+typedef size_t (*tokenize_function)(const char *, size_t, size_t,
+                                    const delimiter_set &, size_t *);
+
+// The kernels write the offsets + base of the delimiters in s[0..n-1] to out
+// and return their number.
+size_t tokenize_scalar(const char *s, size_t n, size_t base,
+                       const delimiter_set &delims, size_t *out)
+{
+    size_t count = 0;
+    for(size_t i = 0; i < n; i++) {
+        out[count] = base + i;
+        count += delims.table[static_cast<unsigned char>(s[i])];
+    }
+    return count;
+}
+
+inline size_t write_offsets(uint64_t mask, size_t base, size_t *out)
+{
+    size_t count = 0;
+    for(; mask; mask &= mask - 1)
+        out[count++] = base + static_cast<size_t>(__builtin_ctzll(mask));
+    return count;
+}
+
+#if defined(__SSE2__)
+size_t tokenize_sse2(const char *s, size_t n, size_t base,
+                     const delimiter_set &delims, size_t *out)
+{
+    if(delims.count > 8)
+        return tokenize_scalar(s, n, base, delims, out);
+
+    __m128i chars[8];
+    for(size_t d = 0; d < delims.count; d++)
+        chars[d] = _mm_set1_epi8(delims.chars[d]);
+    size_t count = 0, i = 0;
+    for(; i + 64 <= n; i += 64) {
+        uint64_t mask = 0;
+        for(unsigned b = 0; b < 4; b++) {
+            const __m128i block = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(s + i + b * 16));
+            __m128i match = _mm_setzero_si128();
+            for(size_t d = 0; d < delims.count; d++)
+                match = _mm_or_si128(match, _mm_cmpeq_epi8(block, chars[d]));
+            mask |= uint64_t(static_cast<unsigned>(_mm_movemask_epi8(match)))
+                << (b * 16);
+        }
+        count += write_offsets(mask, base + i, out + count);
+    }
+    return count + tokenize_scalar(s + i, n - i, base + i, delims,
+                                   out + count);
+}
+
+__attribute__((target("avx2")))
+inline uint64_t avx2_match(const char *s, __m256i low_table,
+                           __m256i high_table, __m256i bits)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i block = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(s));
+    const __m256i lo = _mm256_and_si256(block, nibble);
+    const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble);
+    // row of the low nibble, for high nibbles 0-7 or 8-15
+    const __m256i upper = _mm256_cmpgt_epi8(hi, _mm256_set1_epi8(7));
+    const __m256i row = _mm256_blendv_epi8(
+        _mm256_shuffle_epi8(low_table, lo),
+        _mm256_shuffle_epi8(high_table, lo), upper);
+    const __m256i bit = _mm256_shuffle_epi8(bits, hi);
+    const __m256i match = _mm256_cmpeq_epi8(_mm256_and_si256(row, bit), bit);
+    return static_cast<uint32_t>(_mm256_movemask_epi8(match));
+}
+
+// compares with each delimiter, cheaper than the table for small sets
+__attribute__((target("avx2")))
+inline uint64_t avx2_match(const char *s, const __m256i *chars, size_t count)
+{
+    const __m256i block = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(s));
+    __m256i match = _mm256_cmpeq_epi8(block, chars[0]);
+    for(size_t d = 1; d < count; d++)
+        match = _mm256_or_si256(match, _mm256_cmpeq_epi8(block, chars[d]));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(match));
+}
+
+__attribute__((target("avx2")))
+size_t tokenize_avx2(const char *s, size_t n, size_t base,
+                     const delimiter_set &delims, size_t *out)
+{
+    size_t count = 0, i = 0;
+    if(delims.count == 0)
+        return 0;
+    if(delims.count <= 4) {
+        __m256i chars[4];
+        for(size_t d = 0; d < delims.count; d++)
+            chars[d] = _mm256_set1_epi8(delims.chars[d]);
+        for(; i + 64 <= n; i += 64) {
+            const uint64_t mask = avx2_match(s + i, chars, delims.count)
+                | avx2_match(s + i + 32, chars, delims.count) << 32;
+            count += write_offsets(mask, base + i, out + count);
+        }
+        return count + tokenize_scalar(s + i, n - i, base + i, delims,
+                                       out + count);
+    }
+
+    const __m256i low_table = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(delims.nibbles)));
+    const __m256i high_table = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(delims.nibbles + 16)));
+    const __m256i bits = _mm256_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    for(; i + 64 <= n; i += 64) {
+        const uint64_t mask
+            = avx2_match(s + i, low_table, high_table, bits)
+            | avx2_match(s + i + 32, low_table, high_table, bits) << 32;
+        count += write_offsets(mask, base + i, out + count);
+    }
+    return count + tokenize_scalar(s + i, n - i, base + i, delims,
+                                   out + count);
+}
+#endif
+
+tokenize_function select_tokenize()
+{
+#if defined(__SSE2__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return tokenize_avx2;
+    return tokenize_sse2;
+#else
+    return tokenize_scalar;
+#endif
+}
+
+}
+
+libaan::tokenizer::tokenizer(const string_type &delims)
+    : input("", 0), count(0)
+{
+    table.fill(0);
+    nibbles.fill(0);
+    for(size_t i = 0; i < delims.length(); i++) {
+        const auto c = static_cast<unsigned char>(delims.data()[i]);
+        if(table[c])
+            continue;
+        table[c] = 1;
+        this->delims.push_back(static_cast<char>(c));
+        nibbles[(c >> 7) * 16 + (c & 0x0f)] |= 1u << ((c >> 4) & 7);
+    }
+}
+
+// Offsets are found in chunks, the buffer grows to hold at least one more
+// chunk of delimiters.
+void libaan::tokenizer::tokenize(const string_type &input)
+{
+    static const tokenize_function kernel = select_tokenize();
+    const size_t CHUNK = 64 * 1024;
+    const delimiter_set set = { table.data(), nibbles.data(), delims.data(),
+                                delims.size() };
+
+    this->input = input;
+    count = 0;
+    for(size_t pos = 0; pos < input.length(); pos += CHUNK) {
+        const size_t length = std::min(CHUNK, input.length() - pos);
+        if(offsets.size() < count + length)
+            offsets.resize(std::max(offsets.size() * 2, count + length));
+        count += kernel(input.data() + pos, length, pos, set,
+                        offsets.data() + count);
+    }
+}
+
 /*
 string_type find(const string_type &haystack, const std::string &needle)
 {
@@ -130,6 +313,121 @@ string_type find(const string_type &haystack, const std::string &needle)
 }
 */
 
+namespace {
+
+typedef size_t (*find_function)(const char *, size_t, const char *, size_t);
+
+// Checks the positions [i, n - m] one by one.
+size_t find_tail(const char *txt, size_t n, const char *pattern, size_t m,
+                 size_t i)
+{
+    while(i + m <= n) {
+        const auto found = static_cast<const char *>(
+            std::memchr(txt + i, pattern[0], n - m + 1 - i));
+        if(!found)
+            break;
+        i = static_cast<size_t>(found - txt);
+        if(std::memcmp(found + 1, pattern + 1, m - 1) == 0)
+            return i;
+        i++;
+    }
+    return std::string::npos;
+}
+
+// The kernels below need m >= 2. Bit k of mask is a candidate at i + k.
+inline bool verify(const char *txt, const char *pattern, size_t m, size_t i,
+                   unsigned mask, size_t &match)
+{
+    for(; mask; mask &= mask - 1) {
+        const auto k = static_cast<size_t>(__builtin_ctz(mask));
+        if(std::memcmp(txt + i + k + 1, pattern + 1, m - 2) == 0) {
+            match = i + k;
+            return true;
+        }
+    }
+    return false;
+}
+
+#if defined(__SSE2__)
+size_t find_sse2(const char *txt, size_t n, const char *pattern, size_t m)
+{
+    const __m128i first = _mm_set1_epi8(pattern[0]);
+    const __m128i last = _mm_set1_epi8(pattern[m - 1]);
+    size_t i = 0, match;
+    for(; i + m - 1 + 16 <= n; i += 16) {
+        const __m128i block_first = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(txt + i));
+        const __m128i block_last = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(txt + i + m - 1));
+        const auto mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                          _mm_cmpeq_epi8(last, block_last))));
+        if(mask && verify(txt, pattern, m, i, mask, match))
+            return match;
+    }
+    return find_tail(txt, n, pattern, m, i);
+}
+
+__attribute__((target("avx2")))
+size_t find_avx2(const char *txt, size_t n, const char *pattern, size_t m)
+{
+    const __m256i first = _mm256_set1_epi8(pattern[0]);
+    const __m256i last = _mm256_set1_epi8(pattern[m - 1]);
+    size_t i = 0, match;
+    for(; i + m - 1 + 32 <= n; i += 32) {
+        const __m256i block_first = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(txt + i));
+        const __m256i block_last = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(txt + i + m - 1));
+        const auto mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                             _mm256_cmpeq_epi8(last, block_last))));
+        if(mask && verify(txt, pattern, m, i, mask, match))
+            return match;
+    }
+    const size_t rest = find_sse2(txt + i, n - i, pattern, m);
+    return rest == std::string::npos ? rest : rest + i;
+}
+#else
+size_t find_scalar(const char *txt, size_t n, const char *pattern, size_t m)
+{
+    return find_tail(txt, n, pattern, m, 0);
+}
+#endif
+
+find_function select_find()
+{
+#if defined(__SSE2__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return find_avx2;
+    return find_sse2;
+#else
+    return find_scalar;
+#endif
+}
+
+}
+
+size_t libaan::search::find(const char *txt, size_t n, const char *pattern,
+                            size_t m, size_t pos)
+{
+    if(pos > n || m > n - pos)
+        return std::string::npos;
+    if(m == 0)
+        return pos;
+    if(m == 1) {
+        const auto found = std::memchr(txt + pos, pattern[0], n - pos);
+        return found ? static_cast<size_t>(static_cast<const char *>(found)
+                                           - txt)
+                     : std::string::npos;
+    }
+
+    static const find_function impl = select_find();
+    const size_t match = impl(txt + pos, n - pos, pattern, m);
+    return match == std::string::npos ? match : match + pos;
+}
+
 std::vector<std::size_t>
 libaan::search::stl_search_all(const std::string &pattern, const std::string &txt)
 {
@@ -140,7 +438,8 @@ libaan::search::stl_search_all(const std::string &pattern, const std::string &tx
 
     std::size_t match = 0;
     while(true) {
-        match = txt.find(pattern, match);
+        match = find(txt.data(), txt.size(), pattern.data(), pattern.size(),
+                     match);
         if(match == std::string::npos)
             break;
         matches.push_back(match);
@@ -149,6 +448,145 @@ libaan::search::stl_search_all(const std::string &pattern, const std::string &tx
     return matches;
 }
 
+const uint32_t libaan::search::aho_corasick::ROOT;
+const uint32_t libaan::search::aho_corasick::NONE;
+
+// Builds a pointer trie first, then places it into the double array in
+// breadth first order, which is also the order failure links need.
+libaan::search::aho_corasick::aho_corasick(
+    const std::vector<std::string> &patterns)
+{
+    // codes by descending frequency, 0 stays unused
+    std::array<size_t, 256> counts;
+    counts.fill(0);
+    for(const auto &p: patterns)
+        for(const auto c: p)
+            counts[static_cast<unsigned char>(c)]++;
+    std::array<unsigned, 256> order;
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+            return counts[a] > counts[b];
+        });
+    code.fill(0);
+    uint32_t alphabet = 0;
+    for(const auto c: order)
+        if(counts[c])
+            code[c] = ++alphabet;
+
+    struct trie_node {
+        // (code, node) sorted by code
+        std::vector<std::pair<uint32_t, uint32_t> > children;
+        uint32_t pattern{NONE};
+    };
+    std::vector<trie_node> trie(1);
+    const auto child = [&](uint32_t node, uint32_t c) {
+        const auto &ch = trie[node].children;
+        const auto it = std::lower_bound(ch.begin(), ch.end(),
+                                         std::make_pair(c, uint32_t(0)));
+        return it != ch.end() && it->first == c ? it->second : NONE;
+    };
+    lengths.resize(patterns.size());
+    for(size_t i = 0; i < patterns.size(); i++) {
+        lengths[i] = static_cast<uint32_t>(patterns[i].size());
+        if(patterns[i].empty())
+            continue;
+        uint32_t node = 0;
+        for(const auto ch: patterns[i]) {
+            const auto c = code[static_cast<unsigned char>(ch)];
+            auto next = child(node, c);
+            if(next == NONE) {
+                next = static_cast<uint32_t>(trie.size());
+                auto &children = trie[node].children;
+                children.insert(std::lower_bound(
+                                    children.begin(), children.end(),
+                                    std::make_pair(c, uint32_t(0))),
+                                std::make_pair(c, next));
+                trie.emplace_back();
+            }
+            node = next;
+        }
+        if(trie[node].pattern == NONE)
+            trie[node].pattern = static_cast<uint32_t>(i);
+    }
+
+    // trie node -> double array state
+    std::vector<uint32_t> state_of(trie.size(), NONE);
+    std::vector<uint32_t> fail(trie.size(), 0);
+    std::vector<bool> used(1, true);
+    state_of[0] = ROOT;
+    cells.push_back({ 0, NONE });
+    size_t first_free = 1;
+
+    std::vector<uint32_t> queue(1, 0);
+    for(size_t q = 0; q < queue.size(); q++) {
+        const auto node = queue[q];
+        const auto &children = trie[node].children;
+        if(children.empty())
+            continue;
+
+        // smallest base with free cells for all children
+        while(first_free < used.size() && used[first_free])
+            first_free++;
+        const uint32_t first_code = children.front().first;
+        size_t base = first_free > first_code ? first_free - first_code : 0;
+        for(;; base++) {
+            bool fits = true;
+            for(const auto &ch: children)
+                if(base + ch.first < used.size() && used[base + ch.first]) {
+                    fits = false;
+                    break;
+                }
+            if(fits)
+                break;
+        }
+        const auto end = base + children.back().first + 1;
+        if(end > used.size()) {
+            used.resize(end, false);
+            cells.resize(end, { 0, NONE });
+        }
+        const auto state = state_of[node];
+        cells[state].base = static_cast<uint32_t>(base);
+
+        for(const auto &ch: children) {
+            const auto slot = base + ch.first;
+            used[slot] = true;
+            cells[slot].check = state;
+            state_of[ch.second] = static_cast<uint32_t>(slot);
+            queue.push_back(ch.second);
+
+            if(node != 0) {
+                auto f = fail[node];
+                while(f != 0 && child(f, ch.first) == NONE)
+                    f = fail[f];
+                const auto target = child(f, ch.first);
+                fail[ch.second] = target != NONE ? target : 0;
+            }
+        }
+    }
+    // the largest lookup is base + alphabet
+    uint32_t max_base = 0;
+    for(const auto &c: cells)
+        max_base = std::max(max_base, c.base);
+    if(cells.size() < size_t(max_base) + alphabet + 1)
+        cells.resize(size_t(max_base) + alphabet + 1, { 0, NONE });
+
+    states.assign(cells.size(), { ROOT, NONE, NONE });
+    for(const auto node: queue) {
+        auto &info = states[state_of[node]];
+        info.fail = state_of[fail[node]];
+        info.pattern = trie[node].pattern;
+        info.output = info.pattern != NONE ? state_of[node]
+            : node == 0 ? NONE : states[info.fail].output;
+    }
+}
+
+size_t libaan::search::aho_corasick::size_in_bytes() const
+{
+    return sizeof(*this) + cells.capacity() * sizeof(cell)
+        + states.capacity() * sizeof(state_info)
+        + lengths.capacity() * sizeof(uint32_t);
+}
+
 libaan::search::sarr_cx11::sarr_cx11(const char *in, size_t l)
  : input(in), input_length(l)
 {
@@ -238,11 +676,21 @@ void libaan::search::sarr_cx11::print()
     std::cout << "\n";
 }
 
-libaan::search::sarr_c::sarr_c(const char *txt, int n)
+namespace {
+
+// Signed type offsets into a suffix array of index_t elements are computed in.
+template<typename index_t>
+using diff_type_t = typename libaan::search::sarr_index_traits<index_t>::diff_type;
+
+}
+
+template<typename index_t>
+libaan::search::basic_sarr_c<index_t>::basic_sarr_c(const char *txt,
+                                                    diff_type n)
     : suffixes(n), txt(txt), n(n)
 {
     struct suffix {
-        int index;
+        index_t index;
         const char *suff;
     };
 
@@ -252,7 +700,7 @@ libaan::search::sarr_c::sarr_c(const char *txt, int n)
     // Store suffixes and their indexes in an array of structures.
     // The structure is needed to sort the suffixes alphabatically
     // and maintain their old indexes while sorting
-    for(int i = 0; i < n; i++) {
+    for(diff_type i = 0; i < n; i++) {
         suffix_array[i].index = i;
         suffix_array[i].suff = (txt + i);
     }
@@ -265,35 +713,37 @@ libaan::search::sarr_c::sarr_c(const char *txt, int n)
 
     // Store indexes of all sorted suffixes in the suffix array
 
-    for(int i = 0; i < n; i++)
+    for(diff_type i = 0; i < n; i++)
         suffixes[i] = suffix_array[i].index;
 }
 
 // TODO: result is unsorted
-std::vector<std::size_t> libaan::search::sarr_c::search(const char *pat)
+template<typename index_t>
+std::vector<std::size_t>
+libaan::search::basic_sarr_c<index_t>::search(const char *pat)
 {
     std::vector<std::size_t> matches;
 
     // needed for strncmp()
-    const int pat_len = strlen(pat);
+    const diff_type pat_len = strlen(pat);
     if(pat_len > n || pat_len == 0)
         return matches;
 
     // binary search for pat in txt using built suffix array
     // left and right indexes
-    int l = 0, r = n - 1;
+    diff_type l = 0, r = n - 1;
     while(l <= r) {
         // See if 'pat' is prefix of middle suffix in suffix array
-        int mid = l + (r - l) / 2;
+        diff_type mid = l + (r - l) / 2;
         int res = strncmp(pat, txt + suffixes[mid], pat_len);
 
         // If match found at the middle, print it and return
         if(res == 0) {
             matches.push_back(suffixes[mid]);
-            int idx = mid;
+            diff_type idx = mid;
             do {
                 ++idx;
-                if((size_t)idx >= suffixes.size())
+                if(idx >= n)
                     break;
 
                 res = strncmp(pat, txt + suffixes[idx], pat_len);
@@ -327,7 +777,8 @@ std::vector<std::size_t> libaan::search::sarr_c::search(const char *pat)
     return matches;
 }
 
-void libaan::search::sarr_c::print()
+template<typename index_t>
+void libaan::search::basic_sarr_c<index_t>::print()
 {
     std::size_t cnt = 0;
     // std::cout << "suffix array for:\n\"" << input << "\"\n";
@@ -338,15 +789,18 @@ void libaan::search::sarr_c::print()
 
 namespace {
 
-void create_source_array(const std::string &in,
-                                         std::vector<int> &out, int &max_key)
+// Characters are keys 0..255, compared as unsigned char like in sais().
+template<typename index_t>
+void create_source_array(const std::string &in, std::vector<index_t> &out,
+                         diff_type_t<index_t> &max_key)
 {
     max_key = -1;
     const auto n = in.length();
     out.reserve(n + 3);
     for(size_t i = 0; i < n; i++) {
-        out.push_back((int)in[i]);
-        max_key = max_key > in[i] ? max_key : in[i];
+        const diff_type_t<index_t> c = static_cast<unsigned char>(in[i]);
+        out.push_back(c);
+        max_key = max_key > c ? max_key : c;
     }
 
     // dc3 algorithm expects the last 3 elements to be 0.
@@ -358,11 +812,12 @@ void create_source_array(const std::string &in,
 // input_text is expected to be the output of create_source_array() function and
 // must have a number of elements equal to the length of the input text padded
 // with 3 additional zero entries.
-std::unique_ptr<int[]>
-create_suffix_array_buffer(const std::vector<int> &input_text_padded)
+template<typename index_t>
+std::unique_ptr<index_t[]>
+create_suffix_array_buffer(const std::vector<index_t> &input_text_padded)
 {
     const auto n = input_text_padded.size();
-    std::unique_ptr<int[]> suffix_array_buffer(new int[n]);
+    std::unique_ptr<index_t[]> suffix_array_buffer(new index_t[n]);
 
     // dc3 algorithm expects the last 3 elements to be 0.
     suffix_array_buffer[n - 3] = suffix_array_buffer[n - 2]
@@ -377,38 +832,97 @@ improve readibility.
 */
 
 // lexic. order for pairs
-inline bool leq(int a1, int a2, int b1, int b2)
+template<typename T>
+inline bool leq(T a1, T a2, T b1, T b2)
 {
     return (a1 < b1 || (a1 == b1 && a2 <= b2));
 }
 
 // lexic. order for triples
-inline bool leq(int a1, int a2, int a3, int b1, int b2, int b3)
+template<typename T>
+inline bool leq(T a1, T a2, T a3, T b1, T b2, T b3)
 {
     return (a1 < b1 || (a1 == b1 && leq(a2, a3, b2, b3)));
 }
 
+// Below this length construction steps run serially even if more threads are
+// requested. Thread start up would cost more than it saves.
+const int PARALLEL_MIN_LENGTH = 1 << 16;
+
+// Split [0, len) into one contiguous chunk per thread and run
+// lambda(chunk_index, begin, end) for all chunks concurrently.
+template<typename diff_t, typename lambda_t>
+void parallel_chunks(unsigned threads, diff_t len, lambda_t lambda)
+{
+    const diff_t chunk = (len + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for(unsigned i = 1; i < threads; i++)
+        workers.emplace_back(lambda, i, std::min<diff_t>(len, i * chunk),
+                             std::min<diff_t>(len, (i + 1) * chunk));
+    lambda(0u, diff_t(0), std::min(len, chunk));
+    for(auto &worker: workers)
+        worker.join();
+}
+
 // O(2*n + K)
 // stably sort input[0..n-1] to output[0..n-1] with keys in 0..K from r
-static void radixPass(const int *input, int *output, const int *keys,
-                      const int len, const int K)
+template<typename index_t>
+void radixPass(const index_t *input, index_t *output, const index_t *keys,
+               const diff_type_t<index_t> len, const diff_type_t<index_t> K,
+               unsigned threads)
 {
+    typedef diff_type_t<index_t> diff_t;
+
+    // One counter array per thread. Only worth it if the counters are small
+    // compared to the input.
+    if(threads > 1 && len >= PARALLEL_MIN_LENGTH
+       && static_cast<long>(K + 1) * threads <= len) {
+        std::vector<std::vector<diff_t> > counters(threads);
+
+        // count occurences per chunk
+        parallel_chunks(threads, len, [&](unsigned t, diff_t begin,
+                                          diff_t end) {
+                counters[t].assign(K + 1, 0);
+                for(diff_t i = begin; i < end; i++)
+                    counters[t][keys[input[i]]]++;
+            });
+
+        // exclusive prefix sums, chunks of a key in input order to keep the
+        // sort stable
+        for(diff_t i = 0, sum = 0; i <= K; i++)
+            for(unsigned t = 0; t < threads; t++) {
+                const diff_t c = counters[t][i];
+                counters[t][i] = sum;
+                sum += c;
+            }
+
+        // sort
+        parallel_chunks(threads, len, [&](unsigned t, diff_t begin,
+                                          diff_t end) {
+                auto &counter_array = counters[t];
+                for(diff_t i = begin; i < end; i++)
+                    output[counter_array[keys[input[i]]]++] = input[i];
+            });
+        return;
+    }
+
     // use vector since we zero initialise it anyway
-    std::vector<int> counter_array(K + 1, 0);
+    std::vector<diff_t> counter_array(K + 1, 0);
 
     // count occurences
-    for(int i = 0; i < len; i++)
+    for(diff_t i = 0; i < len; i++)
         counter_array[keys[input[i]]]++;
 
     // exclusive prefix sums
-    for(int i = 0, sum = 0; i <= K; i++) {
-        int t = counter_array[i];
+    for(diff_t i = 0, sum = 0; i <= K; i++) {
+        diff_t t = counter_array[i];
         counter_array[i] = sum;
         sum += t;
     }
 
     // sort
-    for(int i = 0; i < len; i++)
+    for(diff_t i = 0; i < len; i++)
         output[counter_array[keys[input[i]]]++] = input[i];
 }
 
@@ -417,103 +931,162 @@ static void radixPass(const int *input, int *output, const int *keys,
 //   source length = n + 3
 //   source[n] = source[n + 1] = source[n + 2] = 0
 //   n >= 2
-void suffixArray(const int *source, int *SA, const int n, const int K)
+// With threads > 1 the radix passes, the naming of triples and the final merge
+// are split across threads. The result is identical to the serial one.
+template<typename index_t>
+void suffixArray(const index_t *source, index_t *SA,
+                 const diff_type_t<index_t> n, const diff_type_t<index_t> K,
+                 unsigned threads)
 {
-    const int n0 = (n + 2) / 3;
-    const int n1 = (n + 1) / 3;
-    const int n2 = n / 3;
-    const int n02 = n0 + n2;
+    typedef diff_type_t<index_t> diff_t;
+
+    const diff_t n0 = (n + 2) / 3;
+    const diff_t n1 = (n + 1) / 3;
+    const diff_t n2 = n / 3;
+    const diff_t n02 = n0 + n2;
 
-    int *s12 = new int[n02 + 3];
+    // recursion levels shrink by 2/3, small ones are not worth the threads
+    if(n < PARALLEL_MIN_LENGTH)
+        threads = 1;
+
+    index_t *s12 = new index_t[n02 + 3];
     s12[n02] = s12[n02 + 1] = s12[n02 + 2] = 0;
-    int *SA12 = new int[n02 + 3];
+    index_t *SA12 = new index_t[n02 + 3];
     SA12[n02] = SA12[n02 + 1] = SA12[n02 + 2] = 0;
 
-    int *s0 = new int[n0];
-    int *SA0 = new int[n0];
+    index_t *s0 = new index_t[n0];
+    index_t *SA0 = new index_t[n0];
 
     //******* Step 0: Construct sample ********
     // generate positions of mod 1 and mod  2 suffixes
     // the "+(n0-n1)" adds a dummy mod 1 suffix if n%3 == 1
-    for(int i = 0, j = 0; i < n + (n0 - n1); i++)
+    for(diff_t i = 0, j = 0; i < n + (n0 - n1); i++)
         if(i % 3 != 0)
             s12[j++] = i;
 
     //******* Step 1: Sort sample suffixes ********
     // lsb radix sort the mod 1 and mod 2 triples
-    radixPass(s12, SA12, source + 2, n02, K);
-    radixPass(SA12, s12, source + 1, n02, K);
-    radixPass(s12, SA12, source, n02, K);
+    radixPass(s12, SA12, source + 2, n02, K, threads);
+    radixPass(SA12, s12, source + 1, n02, K, threads);
+    radixPass(s12, SA12, source, n02, K, threads);
 
     // find lexicographic names of triples
-    int name = 0, c0 = -1, c1 = -1, c2 = -1;
-    for(int i = 0; i < n02; i++) {
-        if(source[SA12[i]] != c0 || source[SA12[i] + 1] != c1
-           || source[SA12[i] + 2] != c2) {
-            name++;
-            c0 = source[SA12[i]];
-            c1 = source[SA12[i] + 1];
-            c2 = source[SA12[i] + 2];
+    const auto new_triple = [source, SA12](diff_t i) {
+        return i == 0 || source[SA12[i]] != source[SA12[i - 1]]
+            || source[SA12[i] + 1] != source[SA12[i - 1] + 1]
+            || source[SA12[i] + 2] != source[SA12[i - 1] + 2];
+    };
+    const auto name_triples = [&](diff_t begin, diff_t end, diff_t name) {
+        for(diff_t i = begin; i < end; i++) {
+            if(new_triple(i))
+                name++;
+
+            // left half
+            if(SA12[i] % 3 == 1)
+                s12[SA12[i] / 3] = name;
+            // right half
+            else
+                s12[SA12[i] / 3 + n0] = name;
         }
-
-        // left half
-        if(SA12[i] % 3 == 1)
-            s12[SA12[i] / 3] = name;
-        // right half
-        else
-            s12[SA12[i] / 3 + n0] = name;
+    };
+    diff_t name = 0;
+    if(threads > 1) {
+        // count new names per chunk, the names of a chunk start after the
+        // sum of all preceding chunks
+        std::vector<diff_t> names(threads, 0);
+        parallel_chunks(threads, n02, [&](unsigned t, diff_t begin,
+                                          diff_t end) {
+                for(diff_t i = begin; i < end; i++)
+                    names[t] += new_triple(i);
+            });
+        std::vector<diff_t> first_name(threads, 0);
+        for(unsigned t = 0; t < threads; t++) {
+            first_name[t] = name;
+            name += names[t];
+        }
+        parallel_chunks(threads, n02, [&](unsigned t, diff_t begin,
+                                          diff_t end) {
+                name_triples(begin, end, first_name[t]);
+            });
+    } else {
+        for(diff_t i = 0; i < n02; i++)
+            name += new_triple(i);
+        name_triples(0, n02, 0);
     }
 
     // recurse if names are not yet unique
     if(name < n02) {
-        suffixArray(s12, SA12, n02, name);
+        suffixArray(s12, SA12, n02, name, threads);
         // store unique names in s12 using the suffix array
-        for(int i = 0; i < n02; i++)
+        for(diff_t i = 0; i < n02; i++)
             s12[SA12[i]] = i + 1;
     } else    // generate the suffix array of s12 directly
-        for(int i = 0; i < n02; i++)
+        for(diff_t i = 0; i < n02; i++)
             SA12[s12[i] - 1] = i;
 
     //******* Step 2: Sort nonsample suffixes ********
     // stably sort the mod 0 suffixes from SA12 by their first character
-    for(int i = 0, j = 0; i < n02; i++)
-        if(SA12[i] < n0)
+    for(diff_t i = 0, j = 0; i < n02; i++)
+        if(static_cast<diff_t>(SA12[i]) < n0)
             s0[j++] = 3 * SA12[i];
-    radixPass(s0, SA0, source, n0, K);
+    radixPass(s0, SA0, source, n0, K, threads);
 
     //******* Step 3: Merge ********
     // merge sorted SA0 suffixes and sorted SA12 suffixes
-    for(int p = 0, t = n0 - n1, k = 0; k < n; k++) {
-#define get_offset_12() (SA12[t] < n0 ? SA12[t] * 3 + 1 : (SA12[t] - n0) * 3 + 2)
+    const auto get_offset_12 = [n0](diff_t sa12) {
+        return sa12 < n0 ? sa12 * 3 + 1 : (sa12 - n0) * 3 + 2;
+    };
 
+    // is suffix SA12[t] smaller than suffix SA0[p]?
+    const auto smaller_12 = [&](diff_t t, diff_t p) {
+        const diff_t sa12 = SA12[t];
         // pos of current offset 12 suffix
-        const int offset_12 = get_offset_12();
+        const diff_t offset_12 = get_offset_12(sa12);
         // pos of current offset 0  suffix
-        const int offset_0 = SA0[p];
-
-        // is suffix from SA12 smaller?
-        if(SA12[t] < n0 ? leq(source[offset_12], s12[SA12[t] + n0],
-                              source[offset_0], s12[offset_0 / 3])
-                        : leq(source[offset_12], source[offset_12 + 1],
-                              s12[SA12[t] - n0 + 1], source[offset_0],
-                              source[offset_0 + 1], s12[offset_0 / 3 + n0])) {
-            SA[k] = offset_12;
-            t++;
-
-            // done --- only SA0 suffixes left
-            if(t == n02)
-                for(k++; p < n0; p++, k++)
-                    SA[k] = SA0[p];
-        } else {
-            SA[k] = offset_0;
-            p++;
+        const diff_t offset_0 = SA0[p];
+
+        return sa12 < n0 ? leq(source[offset_12], s12[sa12 + n0],
+                               source[offset_0], s12[offset_0 / 3])
+                         : leq(source[offset_12], source[offset_12 + 1],
+                               s12[sa12 - n0 + 1], source[offset_0],
+                               source[offset_0 + 1], s12[offset_0 / 3 + n0]);
+    };
 
-            // done --- only SA12 suffixes left
-            if(p == n0)
-                for(k++; t < n02; t++, k++)
-                    SA[k] = get_offset_12();
+    // write SA[k_begin..k_end-1], starting with SA0[p] and SA12[t]
+    const auto merge = [&](diff_t k_begin, diff_t k_end, diff_t p, diff_t t) {
+        for(diff_t k = k_begin; k < k_end; k++) {
+            if(p == n0 || (t < n02 && smaller_12(t, p))) {
+                SA[k] = get_offset_12(SA12[t]);
+                t++;
+            } else {
+                SA[k] = SA0[p];
+                p++;
+            }
         }
-    }
+    };
+
+    // skip the dummy mod 1 suffix
+    const diff_t t0 = n0 - n1;
+    if(threads > 1) {
+        // Split the output evenly. The number of SA0 suffixes among the first
+        // k merged ones is found by binary search along the merge path.
+        const diff_t n12 = n02 - t0;
+        parallel_chunks(threads, n, [&](unsigned, diff_t k_begin,
+                                        diff_t k_end) {
+                diff_t lo = std::max<diff_t>(0, k_begin - n12);
+                diff_t hi = std::min(k_begin, n0);
+                while(lo < hi) {
+                    const diff_t p = lo + (hi - lo) / 2;
+                    if(!smaller_12(t0 + k_begin - p - 1, p))
+                        lo = p + 1;
+                    else
+                        hi = p;
+                }
+                merge(k_begin, k_end, lo, t0 + k_begin - lo);
+            });
+    } else
+        merge(0, n, 0, t0);
+
     delete[] s12;
     delete[] SA12;
     delete[] SA0;
@@ -522,10 +1095,12 @@ void suffixArray(const int *source, int *SA, const int n, const int K)
 
 }
 
-std::vector<std::size_t> libaan::search::sarr_dc3::search(const std::string &pattern)
+template<typename index_t>
+std::vector<std::size_t>
+libaan::search::basic_sarr_dc3<index_t>::search(const std::string &pattern)
 {
     std::vector<std::size_t> matches;
-    const int pattern_length = pattern.length();
+    const diff_type pattern_length = pattern.length();
     if((size_t)pattern_length > input_text.length() || pattern_length == 0)
         return matches;
 
@@ -540,7 +1115,7 @@ std::vector<std::size_t> libaan::search::sarr_dc3::search(const std::string &pat
                                 pattern_length);
         if(res == 0) {
             matches.push_back(suffix_array[mid]);
-            int idx = mid;
+            diff_type idx = mid;
             do {
                 ++idx;
                 if((size_t)idx >= input_text.size())
@@ -584,7 +1159,9 @@ std::vector<std::size_t> libaan::search::sarr_dc3::search(const std::string &pat
     return matches;
 }
 
-void libaan::search::sarr_dc3::search_and_dump_all(const std::string &pattern)
+template<typename index_t>
+void libaan::search::basic_sarr_dc3<index_t>::search_and_dump_all(
+    const std::string &pattern)
 {
     const auto matches = search(pattern);
     if(matches.empty()) {
@@ -596,7 +1173,8 @@ void libaan::search::sarr_dc3::search_and_dump_all(const std::string &pattern)
               << "\"\n";
 }
 
-void libaan::search::sarr_dc3::dump_suffix_array()
+template<typename index_t>
+void libaan::search::basic_sarr_dc3<index_t>::dump_suffix_array()
 {
     if(!suffix_array)
         return;
@@ -611,10 +1189,520 @@ void libaan::search::sarr_dc3::dump_suffix_array()
     std::cout << "\n";
 }
 
-void libaan::search::sarr_dc3::create()
+template<typename index_t>
+void libaan::search::basic_sarr_dc3<index_t>::create(unsigned threads)
 {
     create_source_array(input_text, input_text_padded, max_key);
     suffix_array = create_suffix_array_buffer(input_text_padded);
-    suffixArray(&input_text_padded[0], suffix_array.get(), input_text.length(),
-                max_key);
+    suffixArray(&input_text_padded[0], suffix_array.get(),
+                static_cast<diff_type>(input_text.length()), max_key,
+                std::max(1u, threads));
+}
+
+namespace {
+
+/*
+SA-IS from Nong, Zhang, Chan: "Two Efficient Algorithms for Linear Time Suffix
+Array Construction". The sentinel is virtual: it is neither stored in the text
+nor in the suffix array, so the caller can supply a buffer of exactly n
+elements. The free space in that buffer is reused for the reduced problem and,
+if large enough, for the bucket counters of the recursion levels (see
+https://sites.google.com/site/yuta256/sais).
+Empty entries hold the largest index_t value, which is -1 for signed types.
+*/
+
+// Fill bkt[0..K-1] with the start or end offsets of all character buckets.
+template<typename char_t, typename index_t>
+void sais_buckets(const char_t *s, diff_type_t<index_t> n,
+                  diff_type_t<index_t> K, index_t *bkt, bool end)
+{
+    typedef diff_type_t<index_t> diff_t;
+
+    std::fill(bkt, bkt + K, 0);
+    for(diff_t i = 0; i < n; i++)
+        bkt[s[i]]++;
+    for(diff_t i = 0, sum = 0; i < K; i++) {
+        const diff_t count = bkt[i];
+        sum += count;
+        bkt[i] = end ? sum : sum - count;
+    }
+}
+
+// Induce the order of L- and S-type suffixes from the LMS suffixes already
+// placed at the end of their buckets.
+template<typename char_t, typename index_t>
+void sais_induce(const char_t *s, index_t *SA, diff_type_t<index_t> n,
+                 diff_type_t<index_t> K, const std::vector<bool> &stype,
+                 index_t *bkt)
+{
+    typedef diff_type_t<index_t> diff_t;
+    const diff_t empty = static_cast<diff_t>(static_cast<index_t>(-1));
+
+    // L-type suffixes, left to right. The virtual sentinel is the smallest
+    // suffix and induces the last suffix, which is always L-type.
+    sais_buckets(s, n, K, bkt, false);
+    SA[bkt[s[n - 1]]++] = n - 1;
+    for(diff_t i = 0; i < n; i++) {
+        const diff_t j = static_cast<diff_t>(SA[i]) - 1;
+        if(j >= 0 && j != empty - 1 && !stype[j])
+            SA[bkt[s[j]]++] = j;
+    }
+
+    // S-type suffixes, right to left.
+    sais_buckets(s, n, K, bkt, true);
+    for(diff_t i = n - 1; i >= 0; i--) {
+        const diff_t j = static_cast<diff_t>(SA[i]) - 1;
+        if(j >= 0 && j != empty - 1 && stype[j])
+            SA[--bkt[s[j]]] = j;
+    }
+}
+
+// Find the suffix array SA of s[0..n-1] in keyspace {0..K-1}^n.
+// requires:
+//   SA length = n + fs, SA[n..n+fs-1] may be used as scratch space
+template<typename char_t, typename index_t>
+void sais(const char_t *s, index_t *SA, diff_type_t<index_t> fs,
+          diff_type_t<index_t> n, diff_type_t<index_t> K)
+{
+    typedef diff_type_t<index_t> diff_t;
+    const index_t empty = static_cast<index_t>(-1);
+
+    if(n <= 1) {
+        if(n == 1)
+            SA[0] = 0;
+        return;
+    }
+
+    // The last character is L-type since the sentinel follows it.
+    std::vector<bool> stype(n, false);
+    for(diff_t i = n - 2; i >= 0; i--)
+        stype[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && stype[i + 1]);
+    const auto is_lms = [&stype](diff_t i) {
+        return i > 0 && stype[i] && !stype[i - 1];
+    };
+
+    std::vector<index_t> bkt_heap;
+    const auto acquire_buckets = [&]() {
+        if(K <= fs)
+            return SA + n;
+        bkt_heap.resize(K);
+        return &bkt_heap[0];
+    };
+    index_t *bkt = acquire_buckets();
+
+    //******* Step 1: Sort LMS substrings ********
+    sais_buckets(s, n, K, bkt, true);
+    std::fill(SA, SA + n, empty);
+    for(diff_t i = 1; i < n; i++)
+        if(is_lms(i))
+            SA[--bkt[s[i]]] = i;
+    sais_induce(s, SA, n, K, stype, bkt);
+
+    // compact the sorted LMS substrings into the first n1 items, induced
+    // sorting has filled all entries
+    diff_t n1 = 0;
+    for(diff_t i = 0; i < n; i++)
+        if(is_lms(SA[i]))
+            SA[n1++] = SA[i];
+
+    // find lexicographic names of LMS substrings. LMS positions are at least
+    // two apart, so pos / 2 is unique and fits into SA[n1..n-1].
+    std::fill(SA + n1, SA + n, empty);
+    diff_t name = 0;
+    for(diff_t i = 0, prev = -1; i < n1; i++) {
+        const diff_t pos = SA[i];
+        bool diff = prev == -1;
+        for(diff_t d = 0; !diff; d++) {
+            // only the substring ending at the sentinel may reach n
+            if(pos + d == n || prev + d == n || s[pos + d] != s[prev + d]
+               || stype[pos + d] != stype[prev + d])
+                diff = true;
+            else if(d > 0 && (is_lms(pos + d) || is_lms(prev + d)))
+                break;
+        }
+        if(diff) {
+            name++;
+            prev = pos;
+        }
+        SA[n1 + pos / 2] = name - 1;
+    }
+    for(diff_t i = n - 1, j = n - 1; i >= n1; i--)
+        if(SA[i] != empty)
+            SA[j--] = SA[i];
+
+    //******* Step 2: Sort LMS suffixes ********
+    // reduced string s1 lives at the end, its suffix array at the start
+    index_t *SA1 = SA;
+    index_t *s1 = SA + n - n1;
+    if(name < n1) {
+        std::vector<index_t>().swap(bkt_heap);
+        sais(static_cast<const index_t *>(s1), SA1, n - n1 - n1, n1, name);
+        bkt = acquire_buckets();
+    } else    // generate the suffix array of s1 directly
+        for(diff_t i = 0; i < n1; i++)
+            SA1[s1[i]] = i;
+
+    //******* Step 3: Induce all suffixes ********
+    for(diff_t i = 1, j = 0; i < n; i++)
+        if(is_lms(i))
+            s1[j++] = i;
+    for(diff_t i = 0; i < n1; i++)
+        SA1[i] = s1[SA1[i]];
+    std::fill(SA + n1, SA + n, empty);
+
+    sais_buckets(s, n, K, bkt, true);
+    for(diff_t i = n1 - 1; i >= 0; i--) {
+        const diff_t j = SA[i];
+        SA[i] = empty;
+        SA[--bkt[s[j]]] = j;
+    }
+    sais_induce(s, SA, n, K, stype, bkt);
+}
+
+// Compare pattern with the first m characters of the suffix at off. Unlike
+// strncmp this does not stop at NUL characters. A suffix shorter than the
+// pattern compares less if it is a prefix of the pattern.
+inline int compare_suffix(const char *txt, std::size_t n, std::size_t off,
+                          const char *pattern, std::size_t m)
+{
+    const auto l = std::min(m, n - off);
+    const auto res = std::memcmp(pattern, txt + off, l);
+    return res != 0 ? res : (l < m ? 1 : 0);
+}
+
+}
+
+template<typename index_t>
+libaan::search::basic_sarr_sais<index_t>::basic_sarr_sais(
+    const char *txt, diff_type n, index_t *suffix_array_buffer)
+    : txt(txt), n(n), suffixes(suffix_array_buffer)
+{
+    assert(static_cast<std::uint64_t>(n)
+           <= sarr_index_traits<index_t>::max_size());
+    sais(reinterpret_cast<const unsigned char *>(txt), suffixes, 0, n, 256);
+}
+
+template<typename index_t>
+std::vector<std::size_t>
+libaan::search::basic_sarr_sais<index_t>::search(const std::string &pattern)
+{
+    std::vector<std::size_t> matches;
+    const auto m = pattern.length();
+    if(m > static_cast<std::size_t>(n) || m == 0)
+        return matches;
+
+    // lower bound of the interval of suffixes starting with pattern
+    diff_type left = 0, right = n;
+    while(left < right) {
+        const diff_type mid = left + (right - left) / 2;
+        if(compare_suffix(txt, n, suffixes[mid], pattern.data(), m) > 0)
+            left = mid + 1;
+        else
+            right = mid;
+    }
+    const diff_type first = left;
+
+    // upper bound
+    right = n;
+    while(left < right) {
+        const diff_type mid = left + (right - left) / 2;
+        if(compare_suffix(txt, n, suffixes[mid], pattern.data(), m) >= 0)
+            left = mid + 1;
+        else
+            right = mid;
+    }
+
+    matches.assign(suffixes + first, suffixes + left);
+    return matches;
+}
+
+template<typename index_t>
+void libaan::search::basic_sarr_sais<index_t>::print()
+{
+    for(diff_type i = 0; i < n; i++)
+        std::cout << i << ": \"" << std::string(txt + suffixes[i], n - suffixes[i])
+                  << "\"\n";
+    std::cout << "\n";
+}
+
+template<typename index_t>
+void libaan::search::lcp_kasai(const char *txt, diff_type_t<index_t> n,
+                               const index_t *suffixes, index_t *lcp,
+                               index_t *rank)
+{
+    typedef diff_type_t<index_t> diff_t;
+
+    for(diff_t i = 0; i < n; i++)
+        rank[suffixes[i]] = i;
+
+    // lcp of the suffix at i + 1 is at least the one at i minus 1
+    for(diff_t i = 0, h = 0; i < n; i++) {
+        const diff_t r = rank[i];
+        if(r == 0) {
+            lcp[0] = h = 0;
+            continue;
+        }
+        const diff_t j = suffixes[r - 1];
+        while(i + h < n && j + h < n && txt[i + h] == txt[j + h])
+            h++;
+        lcp[r] = h;
+        if(h > 0)
+            h--;
+    }
+}
+
+namespace {
+
+// Binary search runs on the open interval (-1, n). -1 and n are virtual
+// borders sharing no prefix with anything. Every index is the middle of
+// exactly one interval.
+template<typename index_t>
+diff_type_t<index_t> fill_interval_lcp(const index_t *lcp,
+                                       diff_type_t<index_t> n,
+                                       diff_type_t<index_t> left,
+                                       diff_type_t<index_t> right,
+                                       index_t *left_lcp, index_t *right_lcp)
+{
+    typedef diff_type_t<index_t> diff_t;
+
+    if(right - left == 1)
+        return left < 0 || right >= n ? 0 : static_cast<diff_t>(lcp[right]);
+
+    const diff_t mid = left + (right - left) / 2;
+    const diff_t l = fill_interval_lcp(lcp, n, left, mid, left_lcp,
+                                       right_lcp);
+    const diff_t r = fill_interval_lcp(lcp, n, mid, right, left_lcp,
+                                       right_lcp);
+    left_lcp[mid] = l;
+    right_lcp[mid] = r;
+    return std::min(l, r);
+}
+
+}
+
+template<typename index_t>
+libaan::search::basic_sarr_lcp<index_t>::basic_sarr_lcp(
+    const char *txt, diff_type n, const index_t *suffixes)
+    : txt(txt), n(n), suffixes(suffixes),
+      // in size_t, 3 * n overflows int long before max_size()
+      lcp_buffer(3 * static_cast<size_t>(n)), lcp(nullptr),
+      left_lcp(nullptr), right_lcp(nullptr)
+{
+    if(n == 0)
+        return;
+    index_t *lcp_out = &lcp_buffer[0];
+    index_t *left_lcp_out = lcp_out + n;
+    index_t *right_lcp_out = left_lcp_out + n;
+
+    // left_lcp is the scratch buffer for the ranks
+    lcp_kasai(txt, n, suffixes, lcp_out, left_lcp_out);
+    fill_interval_lcp(lcp_out, n, static_cast<diff_type>(-1), n,
+                      left_lcp_out, right_lcp_out);
+
+    lcp = lcp_out;
+    left_lcp = left_lcp_out;
+    right_lcp = right_lcp_out;
+}
+
+template<typename index_t>
+libaan::search::basic_sarr_lcp<index_t>::basic_sarr_lcp(
+    const char *txt, diff_type n, const index_t *suffixes,
+    const index_t *lcp, const index_t *left_lcp, const index_t *right_lcp)
+    : txt(txt), n(n), suffixes(suffixes), lcp(lcp), left_lcp(left_lcp),
+      right_lcp(right_lcp)
+{
 }
+
+// Index of the first suffix whose first m characters compare greater or
+// equal (greater if upper is set) to pattern.
+// Invariant: suffix left < pattern <= suffix right (<= and < for upper),
+// l and r are the lcps of pattern with them. Characters of pattern already
+// matched against a border are never compared again.
+template<typename index_t>
+typename libaan::search::basic_sarr_lcp<index_t>::diff_type
+libaan::search::basic_sarr_lcp<index_t>::lower_bound(const char *pattern,
+                                                     diff_type m,
+                                                     bool upper) const
+{
+    if(!left_lcp || !right_lcp)
+        return lower_bound(pattern, m, upper, -1, n);
+
+    diff_type left = -1, right = n;
+    diff_type l = 0, r = 0;
+    while(right - left > 1) {
+        const diff_type mid = left + (right - left) / 2;
+        const diff_type l_mid = left_lcp[mid];
+        const diff_type r_mid = right_lcp[mid];
+
+        // suffix mid shares more with a border than pattern does: it is on
+        // the same side as that border. Shares less: it is on the other side.
+        if(l >= r && l_mid != l) {
+            if(l_mid > l)
+                left = mid;
+            else {
+                right = mid;
+                r = l_mid;
+            }
+            continue;
+        }
+        if(r > l && r_mid != r) {
+            if(r_mid > r)
+                right = mid;
+            else {
+                left = mid;
+                l = r_mid;
+            }
+            continue;
+        }
+
+        // compare the rest of pattern with suffix mid
+        diff_type k = std::max(l, r);
+        if(goes_right(pattern, m, suffixes[mid], k, upper)) {
+            right = mid;
+            r = k;
+        } else {
+            left = mid;
+            l = k;
+        }
+    }
+    return right;
+}
+
+// Compare pattern with the suffix at off, the first k characters are known to
+// match. On return k is their lcp. Returns whether the suffix lies right of
+// the searched bound.
+template<typename index_t>
+bool libaan::search::basic_sarr_lcp<index_t>::goes_right(
+    const char *pattern, diff_type m, diff_type off, diff_type &k,
+    bool upper) const
+{
+    while(k < m && off + k < n && pattern[k] == txt[off + k])
+        k++;
+
+    return k == m
+        ? !upper
+        : off + k < n
+              && static_cast<unsigned char>(pattern[k])
+                     < static_cast<unsigned char>(txt[off + k]);
+}
+
+// Same as above, restricted to the open interval (left, right). The interval
+// lcp values only exist for the intervals of a search over (-1, n), so this
+// only skips the characters both borders share with pattern.
+template<typename index_t>
+typename libaan::search::basic_sarr_lcp<index_t>::diff_type
+libaan::search::basic_sarr_lcp<index_t>::lower_bound(
+    const char *pattern, diff_type m, bool upper, diff_type left,
+    diff_type right) const
+{
+    diff_type l = 0, r = 0;
+    while(right - left > 1) {
+        const diff_type mid = left + (right - left) / 2;
+        diff_type k = std::min(l, r);
+        if(goes_right(pattern, m, suffixes[mid], k, upper)) {
+            right = mid;
+            r = k;
+        } else {
+            left = mid;
+            l = k;
+        }
+    }
+    return right;
+}
+
+// Lower bounds of the sorted patterns order[begin..end-1] are monotonic and
+// known to lie in [left + 1, right]. Search the middle pattern, then both
+// halves in the part of the interval up to and from its bound.
+template<typename index_t>
+void libaan::search::basic_sarr_lcp<index_t>::lower_bounds(
+    const std::vector<std::string> &patterns, const int *order, int begin,
+    int end, diff_type left, diff_type right, diff_type *bounds) const
+{
+    while(begin < end) {
+        const int mid = begin + (end - begin) / 2;
+        const auto &pattern = patterns[order[mid]];
+        const diff_type bound = lower_bound(pattern.data(), pattern.length(),
+                                            false, left, right);
+        bounds[mid] = bound;
+        lower_bounds(patterns, order, begin, mid, left, bound, bounds);
+        begin = mid + 1;
+        left = bound - 1;
+    }
+}
+
+template<typename index_t>
+typename libaan::search::basic_sarr_lcp<index_t>::range_type
+libaan::search::basic_sarr_lcp<index_t>::search(
+    const std::string &pattern) const
+{
+    const diff_type m = pattern.length();
+    if(m == 0 || m > n)
+        return range_type { suffixes, suffixes };
+
+    const diff_type first = lower_bound(pattern.data(), m, false);
+    const diff_type last = lower_bound(pattern.data(), m, true);
+    return range_type { suffixes + first, suffixes + last };
+}
+
+template<typename index_t>
+void libaan::search::basic_sarr_lcp<index_t>::search_many(
+    const std::vector<std::string> &patterns, range_type *results,
+    unsigned threads) const
+{
+    const int count = patterns.size();
+    if(count == 0)
+        return;
+    std::vector<int> order(count);
+    std::iota(std::begin(order), std::end(order), 0);
+    std::sort(std::begin(order), std::end(order), [&patterns](int a, int b) {
+            return patterns[a] < patterns[b]; });
+
+    // lower bounds in sorted order
+    std::vector<diff_type> bounds(count);
+
+    const auto search_chunk = [&](unsigned, int begin, int end) {
+        lower_bounds(patterns, order.data(), begin, end, -1, n, bounds.data());
+
+        for(int i = begin; i < end; i++) {
+            const auto &pattern = patterns[order[i]];
+            const diff_type m = pattern.length();
+            auto &result = results[order[i]];
+            if(m == 0 || m > n) {
+                result = range_type { suffixes, suffixes };
+                continue;
+            }
+
+            // If the next pattern does not start with this one, all suffixes
+            // starting with this one are smaller than the next pattern.
+            diff_type right = n;
+            if(i + 1 < end) {
+                const auto &next = patterns[order[i + 1]];
+                if(next.compare(0, m, pattern) != 0)
+                    right = bounds[i + 1];
+            }
+            const diff_type last = lower_bound(pattern.data(), m, true,
+                                               bounds[i] - 1, right);
+            result = range_type { suffixes + bounds[i], suffixes + last };
+        }
+    };
+
+    if(threads > 1 && static_cast<unsigned>(count) >= 2 * threads)
+        parallel_chunks(threads, count, search_chunk);
+    else
+        search_chunk(0, 0, count);
+}
+
+#define LIBAAN_SARR_INSTANTIATE(index_t)                                      \
+    template struct libaan::search::basic_sarr_c<index_t>;                    \
+    template struct libaan::search::basic_sarr_dc3<index_t>;                  \
+    template struct libaan::search::basic_sarr_sais<index_t>;                 \
+    template struct libaan::search::basic_sarr_lcp<index_t>;                  \
+    template void libaan::search::lcp_kasai<index_t>(                         \
+        const char *, diff_type_t<index_t>, const index_t *, index_t *,       \
+        index_t *);
+
+LIBAAN_SARR_INSTANTIATE(int)
+LIBAAN_SARR_INSTANTIATE(std::uint32_t)
+LIBAAN_SARR_INSTANTIATE(std::uint64_t)
+LIBAAN_SARR_INSTANTIATE(libaan::uint40_t)
+#undef LIBAAN_SARR_INSTANTIATE
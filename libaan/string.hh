@@ -1,7 +1,15 @@
 #ifndef _LIBAAN_STRING_HH_
 #define _LIBAAN_STRING_HH_
 
+#include "byte.hh"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -27,10 +35,16 @@ public:
     size_t length() const { return l; }
     const char *data() const { return s; }
 
+    // as std::string::compare: s[pos, pos + count) against str, 0 if equal.
+    // Bytes after a 0 are compared as well.
     int compare(size_t pos, size_t count, const string_type &str) const
     {
-        return (str.length() < count || l < (pos + count))
-                               ? false : strncmp(s + pos, str.s, count) == 0;
+        const size_t n = pos > l ? 0 : std::min(count, l - pos);
+        const size_t common = std::min(n, str.l);
+        const int c = common ? std::memcmp(s + pos, str.s, common) : 0;
+        if(c != 0)
+            return c;
+        return n < str.l ? -1 : (n > str.l ? 1 : 0);
     }
 
 private:
@@ -49,11 +63,307 @@ bool operator==(const string_type &lhs, const string_type &rhs);
 bool operator==(const char *lhs, const string_type &rhs);
 bool operator==(const std::string &lhs, const string_type &rhs);
 
+// 64 bit hash of s[0..n-1] after wyhash (Wang Yi, final version 4), built
+// from 64 x 64 -> 128 bit multiplications. Inputs longer than 48 bytes are
+// mixed in three independent lanes of 16 bytes. Not cryptographic.
+inline uint64_t hash_bytes(const char *s, size_t n, uint64_t seed = 0)
+{
+    __extension__ typedef unsigned __int128 uint128_type;
+    const auto mix = [](uint64_t a, uint64_t b) {
+        const uint128_type r = uint128_type(a) * b;
+        return uint64_t(r) ^ uint64_t(r >> 64);
+    };
+    const auto read8 = [](const char *p) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    };
+    const auto read4 = [](const char *p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return uint64_t(v);
+    };
+    const uint64_t SECRET[] = { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                                0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+
+    seed ^= mix(seed ^ SECRET[0], SECRET[1]);
+    uint64_t a = 0, b = 0;
+    if(n <= 16) {
+        if(n >= 4) {
+            const size_t shift = (n >> 3) << 2;
+            a = read4(s) << 32 | read4(s + shift);
+            b = read4(s + n - 4) << 32 | read4(s + n - 4 - shift);
+        } else if(n > 0) {
+            const auto byte = [&](size_t i) {
+                return uint64_t(static_cast<unsigned char>(s[i]));
+            };
+            a = byte(0) << 16 | byte(n >> 1) << 8 | byte(n - 1);
+        }
+    } else {
+        size_t i = n;
+        const char *p = s;
+        if(i > 48) {
+            uint64_t seed1 = seed, seed2 = seed;
+            do {
+                seed = mix(read8(p) ^ SECRET[1], read8(p + 8) ^ seed);
+                seed1 = mix(read8(p + 16) ^ SECRET[2], read8(p + 24) ^ seed1);
+                seed2 = mix(read8(p + 32) ^ SECRET[3], read8(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while(i > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        for(; i > 16; i -= 16, p += 16)
+            seed = mix(read8(p) ^ SECRET[1], read8(p + 8) ^ seed);
+        a = read8(p + i - 16);
+        b = read8(p + i - 8);
+    }
+    const uint128_type r = uint128_type(a ^ SECRET[1]) * (b ^ seed);
+    return mix(uint64_t(r) ^ SECRET[0] ^ n, uint64_t(r >> 64) ^ SECRET[1]);
+}
+
+// hashes[i] = hash_bytes(tokens[i]) for count tokens. The next tokens are
+// prefetched while one is hashed.
+void hash_all(const string_type *tokens, size_t count, uint64_t *hashes,
+              uint64_t seed = 0);
+inline std::vector<uint64_t> hash_all(const std::vector<string_type> &tokens,
+                                      uint64_t seed = 0)
+{
+    std::vector<uint64_t> hashes(tokens.size());
+    hash_all(tokens.data(), tokens.size(), hashes.data(), seed);
+    return hashes;
+}
+
+// Immutable owning string for hash table keys. Up to 23 bytes are stored
+// inline, longer strings on the heap. The hash is computed once on
+// construction, comparisons check it before the memcmp.
+class owned_string {
+public:
+    owned_string() : owned_string("", 0) {}
+    owned_string(const char *s, size_t l) : h(hash_bytes(s, l))
+    {
+        char *dest;
+        if(l <= MAX_INLINE) {
+            dest = storage.small;
+            storage.small[MAX_INLINE] = static_cast<char>(MAX_INLINE - l);
+        } else {
+            dest = storage.large.ptr = new char[l + 1];
+            storage.large.size = l;
+            storage.small[MAX_INLINE] = HEAP;
+        }
+        std::memcpy(dest, s, l);
+        dest[l] = 0;
+    }
+    owned_string(const string_type &s) : owned_string(s.data(), s.length()) {}
+    owned_string(const std::string &s) : owned_string(s.data(), s.size()) {}
+    owned_string(const char *s) : owned_string(s, std::strlen(s)) {}
+
+    owned_string(const owned_string &other)
+        : owned_string(other.data(), other.size()) {}
+    owned_string(owned_string &&other) noexcept
+        : storage(other.storage), h(other.h)
+    {
+        other.storage.small[0] = 0;
+        other.storage.small[MAX_INLINE] = static_cast<char>(MAX_INLINE);
+        other.h = hash_bytes("", 0);
+    }
+    owned_string &operator=(const owned_string &other)
+    {
+        if(this != &other)
+            *this = owned_string(other);
+        return *this;
+    }
+    owned_string &operator=(owned_string &&other) noexcept
+    {
+        std::swap(storage, other.storage);
+        std::swap(h, other.h);
+        return *this;
+    }
+    ~owned_string()
+    {
+        if(!is_inline())
+            delete[] storage.large.ptr;
+    }
+
+    // 0 terminated
+    const char *data() const
+    {
+        return is_inline() ? storage.small : storage.large.ptr;
+    }
+    const char *c_str() const { return data(); }
+    size_t size() const
+    {
+        return is_inline() ? MAX_INLINE - size_t(storage.small[MAX_INLINE])
+                           : storage.large.size;
+    }
+    size_t length() const { return size(); }
+    uint64_t hash() const { return h; }
+
+    operator string_type() const { return string_type(data(), size()); }
+    std::string str() const { return std::string(data(), size()); }
+
+    friend bool operator==(const owned_string &lhs, const owned_string &rhs)
+    {
+        return lhs.h == rhs.h && lhs.size() == rhs.size()
+            && std::memcmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+    }
+    friend bool operator!=(const owned_string &lhs, const owned_string &rhs)
+    {
+        return !(lhs == rhs);
+    }
+    friend bool operator==(const owned_string &lhs, const string_type &rhs)
+    {
+        return lhs.size() == rhs.length()
+            && std::memcmp(lhs.data(), rhs.data(), rhs.length()) == 0;
+    }
+    friend bool operator==(const string_type &lhs, const owned_string &rhs)
+    {
+        return rhs == lhs;
+    }
+    // literals and std::string convert to both owned_string and
+    // string_type, these overloads avoid the ambiguity
+    friend bool operator==(const owned_string &lhs, const char *rhs)
+    {
+        return lhs == string_type(rhs);
+    }
+    friend bool operator==(const char *lhs, const owned_string &rhs)
+    {
+        return rhs == string_type(lhs);
+    }
+    friend bool operator==(const owned_string &lhs, const std::string &rhs)
+    {
+        return lhs == string_type(rhs.data(), rhs.size());
+    }
+    friend bool operator==(const std::string &lhs, const owned_string &rhs)
+    {
+        return rhs == string_type(lhs.data(), lhs.size());
+    }
+
+private:
+    static const size_t MAX_INLINE = 23;
+    // in the last byte, inline strings store MAX_INLINE - size there, which
+    // is 0 and terminates them at MAX_INLINE
+    static const char HEAP = -1;
+
+    bool is_inline() const { return storage.small[MAX_INLINE] != HEAP; }
+
+    struct heap_type {
+        char *ptr;
+        size_t size;
+    };
+    union storage_type {
+        char small[MAX_INLINE + 1];
+        heap_type large;
+    } storage;
+    uint64_t h;
+};
+
 std::vector<string_type> split(const string_type &input, const string_type &delim);
 std::vector<string_type> split(const string_type &input, char delim);
 
 std::vector<string_type> split2(const std::string &input, const std::string &delim);
 
+// Lazy split(): the tokens of input are found one at a time while iterating,
+// nothing is allocated. Empty tokens are skipped like in split(). Iterators
+// refer to the view, which refers to input and delim.
+//   for(const auto &token: split_view(input, '\n')) ...
+class split_view {
+public:
+    class iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef string_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const string_type *pointer;
+        typedef const string_type &reference;
+
+        reference operator*() const { return token; }
+        pointer operator->() const { return &token; }
+        iterator &operator++() { next(); return *this; }
+        iterator operator++(int) { auto tmp = *this; next(); return tmp; }
+        // the end iterator has no token data
+        bool operator==(const iterator &other) const
+        {
+            return token.data() == other.token.data();
+        }
+        bool operator!=(const iterator &other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        friend class split_view;
+        iterator(const split_view *view, size_t pos)
+            : view(view), pos(pos), token(nullptr, 0) {}
+        void next();
+
+        const split_view *view;
+        // where the search for the next delimiter starts
+        size_t pos;
+        string_type token;
+    };
+
+    split_view(const string_type &input, char delim)
+        : input(input), delim(nullptr), delim_length(1), delim_char(delim) {}
+    split_view(const string_type &input, const string_type &delim)
+        : input(input), delim(delim.data()), delim_length(delim.length()),
+          delim_char(0) {}
+
+    iterator begin() const
+    {
+        iterator it(this, 0);
+        if(delim_length)
+            it.next();
+        return it;
+    }
+    iterator end() const { return iterator(this, 0); }
+
+private:
+    string_type input;
+    // nullptr for delim_char
+    const char *delim;
+    size_t delim_length;
+    char delim_char;
+};
+
+// Bulk split at any character of a delimiter set, e.g. ",\n" for CSV
+// without quoting. Delimiters are searched 64 bytes at a time. With AVX2
+// (if the cpu supports it) by compares for up to 4 delimiters and a nibble
+// table lookup for larger sets, otherwise by SSE2 compares for up to 8
+// delimiters. Their offsets go to a buffer reused by the next tokenize().
+// Unlike split() empty tokens are kept, n delimiters give n + 1 tokens.
+class tokenizer {
+public:
+    explicit tokenizer(const string_type &delims);
+
+    // input must stay valid while its tokens are used
+    void tokenize(const string_type &input);
+
+    size_t size() const { return count + 1; }
+    string_type operator[](size_t i) const
+    {
+        const size_t begin = i == 0 ? 0 : offsets[i - 1] + 1;
+        const size_t end = i == count ? input.length() : offsets[i];
+        return string_type(input.data() + begin, end - begin);
+    }
+
+    // offsets of the delimiters in input
+    const size_t *get_offsets() const { return offsets.data(); }
+    size_t delimiter_count() const { return count; }
+
+private:
+    std::string delims;
+    // 1 for delimiters
+    std::array<unsigned char, 256> table;
+    // bit h of nibbles[l] (nibbles[l + 16]) is set if (h << 4 | l)
+    // ((h + 8) << 4 | l) is a delimiter
+    std::array<unsigned char, 32> nibbles;
+
+    string_type input;
+    std::vector<size_t> offsets;
+    size_t count;
+};
+
 template<typename T>
 inline std::string to_hex_string(const T &value)
 {
@@ -68,8 +378,88 @@ namespace search {
 // https://sites.google.com/site/yuta256/sais
 
 
+// Offset of the first occurence of pattern[0..m-1] in txt[0..n-1] at or
+// after pos, std::string::npos if there is none. NUL is an ordinary
+// character. Candidates are positions where the first and the last pattern
+// character match, tested 16 (SSE2) or 32 (AVX2, if the cpu supports it)
+// positions at a time and verified with memcmp.
+size_t find(const char *txt, size_t n, const char *pattern, size_t m,
+            size_t pos = 0);
+
+// offsets of all, possibly overlapping, occurences of pattern in txt
 std::vector<std::size_t> stl_search_all(const std::string &pattern, const std::string &txt);
 
+// Aho-Corasick automaton (Aho, Corasick: "Efficient string matching: an aid
+// to bibliographic search") finding all occurences of many patterns in one
+// pass. The trie is a double array (Aoe: "An efficient digital search
+// algorithm by using a double-array structure") over the characters that
+// occur in the patterns: the child of state s for character code c is
+// t = base[s] + c if check[t] == s. Characters are coded by frequency, so
+// the array stays dense.
+class aho_corasick {
+public:
+    // Empty patterns never match. Of identical patterns only the first one
+    // is reported.
+    explicit aho_corasick(const std::vector<std::string> &patterns);
+
+    // Calls callback(pattern index, offset) for all occurences in txt,
+    // ordered by their end. Does not allocate.
+    template<typename callback_t>
+    void scan(const string_type &txt, callback_t callback) const
+    {
+        const auto s = reinterpret_cast<const unsigned char *>(txt.data());
+        uint32_t state = ROOT;
+        for(size_t i = 0; i < txt.length(); i++) {
+            const uint32_t c = code[s[i]];
+            if(c == 0) {
+                state = ROOT;
+                continue;
+            }
+            for(;;) {
+                const uint32_t next = cells[state].base + c;
+                if(cells[next].check == state) {
+                    state = next;
+                    break;
+                }
+                if(state == ROOT)
+                    break;
+                state = states[state].fail;
+            }
+            for(auto o = states[state].output; o != NONE;
+                o = states[states[o].fail].output) {
+                const auto pattern = states[o].pattern;
+                callback(size_t(pattern), i + 1 - lengths[pattern]);
+            }
+        }
+    }
+
+    // number of states, including unused double array cells
+    size_t size() const { return cells.size(); }
+    size_t size_in_bytes() const;
+
+private:
+    static const uint32_t ROOT = 0;
+    static const uint32_t NONE = 0xffffffff;
+
+    struct cell {
+        uint32_t base;
+        uint32_t check;
+    };
+    struct state_info {
+        uint32_t fail;
+        // first state on the failure chain ending a pattern, or NONE
+        uint32_t output;
+        // pattern ending at this state, or NONE
+        uint32_t pattern;
+    };
+
+    // 0 for characters not in any pattern
+    std::array<uint32_t, 256> code;
+    std::vector<cell> cells;
+    std::vector<state_info> states;
+    std::vector<uint32_t> lengths;
+};
+
 
 // suffix array implementations
 
@@ -94,12 +484,44 @@ private:
     const size_t input_length;
 };
 
-struct sarr_c {
+// Element types of suffix arrays: int for texts up to 2 GiB, uint32_t up to
+// 4 GiB, uint64_t or the packed uint40_t (5 bytes, up to 1 TiB) beyond that.
+template<typename index_t>
+struct sarr_index_traits {
+    // signed type offsets into the suffix array are computed in
+    typedef std::int64_t diff_type;
+    // Longest text, the largest value is reserved as empty marker during
+    // construction.
+    static std::uint64_t max_size()
+    {
+        return static_cast<std::uint64_t>(static_cast<index_t>(~0ull)) - 1u;
+    }
+};
+
+template<>
+struct sarr_index_traits<int> {
+    typedef int diff_type;
+    static std::uint64_t max_size() { return std::numeric_limits<int>::max(); }
+};
+
+template<>
+struct sarr_index_traits<std::uint64_t> {
+    typedef std::int64_t diff_type;
+    static std::uint64_t max_size()
+    {
+        return std::numeric_limits<std::int64_t>::max();
+    }
+};
+
+template<typename index_t>
+struct basic_sarr_c {
+    typedef typename sarr_index_traits<index_t>::diff_type diff_type;
 
     // This is the main function that takes a string 'txt' of size n as an
     // argument, builds and return the suffix array for the given string
-    sarr_c(const char *txt, int n);
-    sarr_c(const std::string &txt) : sarr_c(txt.c_str(), txt.length()) {}
+    basic_sarr_c(const char *txt, diff_type n);
+    basic_sarr_c(const std::string &txt)
+        : basic_sarr_c(txt.c_str(), static_cast<diff_type>(txt.length())) {}
 
     // O(m * log(n)) <- according to webpage
     // A suffix array based search function to search a given pattern
@@ -110,21 +532,26 @@ struct sarr_c {
     void print();
 
 #ifdef UNITTEST
-    const std::vector<int> &get_suffixes() const { return suffixes; }
+    const std::vector<index_t> &get_suffixes() const { return suffixes; }
 #endif
 
 private:
-    std::vector<int> suffixes;
+    std::vector<index_t> suffixes;
     const char *txt;
-    const int n;
+    const diff_type n;
 };
 
+typedef basic_sarr_c<int> sarr_c;
 
-struct sarr_dc3 {
-    sarr_dc3(const std::string &input_txt)
+
+template<typename index_t>
+struct basic_sarr_dc3 {
+    // With threads > 1 construction is split across that many threads. The
+    // suffix array is the same as the one built serially.
+    basic_sarr_dc3(const std::string &input_txt, unsigned threads = 1)
         : input_text(input_txt), max_key(-1)
     {
-        create();
+        create(threads);
     }
 
     // Iterative search is not feasible atm. searching all occurences at
@@ -143,24 +570,146 @@ struct sarr_dc3 {
     void search_and_dump_all(const std::string &pattern);
     void dump_suffix_array();
 
+    const index_t *get_suffix_array() const { return suffix_array.get(); }
+
 #ifdef UNITTEST
-    const std::pair<int *, size_t> &get_suffixes() const { return std::make_pair(suffix_array, input_text_padded.size()); }
+    std::pair<const index_t *, size_t> get_suffixes() const { return std::make_pair(suffix_array.get(), input_text.size()); }
 #endif
 
 private:
-    void create();
+    typedef typename sarr_index_traits<index_t>::diff_type diff_type;
+
+    void create(unsigned threads);
 
 private:
     const std::string &input_text;
 
     // suffix_array length = input_text.length() + 3
-    std::unique_ptr<int[]> suffix_array;
+    std::unique_ptr<index_t[]> suffix_array;
 
     // input_text_padded length = input_text.length() + 3
-    std::vector<int> input_text_padded;
-    int max_key;
+    std::vector<index_t> input_text_padded;
+    diff_type max_key;
 };
 
+typedef basic_sarr_dc3<int> sarr_dc3;
+
+// Suffix array construction by induced sorting (SA-IS), O(n) time.
+// The suffix array is built in the caller supplied buffer, which must provide
+// room for n elements. Recursion levels keep their reduced problem inside this
+// buffer, so apart from it only one type bit per character and the bucket
+// counters are allocated.
+// Characters are compared as unsigned char and the text may contain NUL
+// characters.
+template<typename index_t>
+struct basic_sarr_sais {
+    typedef typename sarr_index_traits<index_t>::diff_type diff_type;
+
+    basic_sarr_sais(const char *txt, diff_type n, index_t *suffix_array_buffer);
+
+    // O(m * log(n)), result is ordered like the suffix array.
+    std::vector<std::size_t> search(const std::string &pattern);
+    void print();
+
+private:
+    const char *txt;
+    const diff_type n;
+    index_t *suffixes;
+};
+
+typedef basic_sarr_sais<int> sarr_sais;
+
+// Contiguous range of suffix array entries. Valid as long as the suffix array
+// it points into.
+template<typename index_t>
+struct basic_sarr_range {
+    const index_t *first;
+    const index_t *last;
+
+    const index_t *begin() const { return first; }
+    const index_t *end() const { return last; }
+    std::size_t size() const { return static_cast<std::size_t>(last - first); }
+    bool empty() const { return first == last; }
+};
+
+typedef basic_sarr_range<int> sarr_range;
+
+// Kasai et al.: lcp[i] = length of the longest common prefix of the suffixes
+// suffixes[i - 1] and suffixes[i], lcp[0] = 0. O(n), rank is a scratch buffer
+// of n elements.
+template<typename index_t>
+void lcp_kasai(const char *txt,
+               typename sarr_index_traits<index_t>::diff_type n,
+               const index_t *suffixes, index_t *lcp, index_t *rank);
+
+// Enhanced suffix array: an existing suffix array of txt plus its LCP array
+// and the LCP values of all binary search intervals (Manber, Myers: "Suffix
+// arrays: a new method for on-line string searches"). Text and suffix array
+// are not copied and must outlive this object.
+template<typename index_t>
+struct basic_sarr_lcp {
+    typedef typename sarr_index_traits<index_t>::diff_type diff_type;
+    typedef basic_sarr_range<index_t> range_type;
+
+    // Build the LCP information. Needs 3 * n additional elements.
+    basic_sarr_lcp(const char *txt, diff_type n, const index_t *suffixes);
+
+    // Use precomputed LCP information, e.g. from a mapped sarr_file. It is not
+    // copied. Without it (nullptr) searches are plain binary searches which
+    // only skip the prefix the pattern shares with both interval borders.
+    basic_sarr_lcp(const char *txt, diff_type n, const index_t *suffixes,
+                   const index_t *lcp, const index_t *left_lcp,
+                   const index_t *right_lcp);
+
+    basic_sarr_lcp(const basic_sarr_lcp &) = delete;
+
+    // O(m + log(n)), O(m * log(n)) without LCP information
+    // Returns the interval of the suffix array holding all suffixes starting
+    // with pattern. Nothing is copied, the range is ordered like the suffix
+    // array.
+    range_type search(const std::string &pattern) const;
+
+    // Search all patterns, results[i] receives the range for patterns[i].
+    // Patterns are searched in sorted order, so that the bounds found for one
+    // pattern narrow the binary search of its neighbours. With threads > 1
+    // the sorted patterns are split into one chunk per thread.
+    void search_many(const std::vector<std::string> &patterns,
+                     range_type *results, unsigned threads = 1) const;
+
+    const char *get_text() const { return txt; }
+    diff_type size() const { return n; }
+    const index_t *get_suffix_array() const { return suffixes; }
+    // nullptr if there is no LCP information
+    const index_t *get_lcp() const { return lcp; }
+    const index_t *get_left_lcp() const { return left_lcp; }
+    const index_t *get_right_lcp() const { return right_lcp; }
+
+private:
+    bool goes_right(const char *pattern, diff_type m, diff_type off,
+                    diff_type &k, bool upper) const;
+    diff_type lower_bound(const char *pattern, diff_type m, bool upper) const;
+    diff_type lower_bound(const char *pattern, diff_type m, bool upper,
+                          diff_type left, diff_type right) const;
+    void lower_bounds(const std::vector<std::string> &patterns,
+                      const int *order, int begin, int end, diff_type left,
+                      diff_type right, diff_type *bounds) const;
+
+private:
+    const char *txt;
+    const diff_type n;
+    const index_t *suffixes;
+
+    // 3 * n elements if the LCP information is built by this object
+    std::vector<index_t> lcp_buffer;
+    const index_t *lcp;
+    // lcp of suffix mid with the left/right border of the binary search
+    // interval mid is the middle of
+    const index_t *left_lcp;
+    const index_t *right_lcp;
+};
+
+typedef basic_sarr_lcp<int> sarr_lcp;
+
 }
 
 template<typename string_t, typename string2_t>
@@ -177,4 +726,25 @@ inline bool endswith(const string_t &s, const string2_t &suffix)
 
 }
 
+namespace std {
+
+// Unordered containers of string_type compare the viewed strings.
+template<>
+struct hash<libaan::string_type> {
+    size_t operator()(const libaan::string_type &s) const
+    {
+        return libaan::hash_bytes(s.data(), s.length());
+    }
+};
+
+template<>
+struct hash<libaan::owned_string> {
+    size_t operator()(const libaan::owned_string &s) const
+    {
+        return s.hash();
+    }
+};
+
+}
+
 #endif
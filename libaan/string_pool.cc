@@ -0,0 +1,139 @@
+#include "string_pool.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+const libaan::string_pool::id_type libaan::string_pool::NONE;
+
+libaan::string_pool::string_pool(size_t block_size)
+    : block_size(std::max<size_t>(64, block_size))
+{
+}
+
+libaan::string_pool::id_type
+libaan::string_pool::lookup(const string_type &s, uint64_t hash,
+                            size_t &index) const
+{
+    if(table.empty())
+        return NONE;
+    const size_t mask = table.size() - 1;
+    const auto upper = static_cast<uint32_t>(hash >> 32);
+    for(index = hash & mask;; index = (index + 1) & mask) {
+        const auto &t = table[index];
+        if(t.id == NONE)
+            return NONE;
+        if(t.hash != upper)
+            continue;
+        const auto &e = entries[t.id];
+        if(e.length == s.length()
+           && std::memcmp(e.data, s.data(), s.length()) == 0)
+            return t.id;
+    }
+}
+
+void libaan::string_pool::grow_table()
+{
+    std::vector<slot> old(std::max<size_t>(16, table.size() * 2),
+                          { 0, NONE });
+    table.swap(old);
+    const size_t mask = table.size() - 1;
+    for(const auto &t: old) {
+        if(t.id == NONE)
+            continue;
+        size_t index = entries[t.id].hash & mask;
+        while(table[index].id != NONE)
+            index = (index + 1) & mask;
+        table[index] = t;
+    }
+}
+
+char *libaan::string_pool::allocate(size_t n)
+{
+    // the current block stays current, it does not have to be the last one
+    if(n > block_size / 4) {
+        blocks.emplace_back(new char[n]);
+        block_bytes += n;
+        return blocks.back().get();
+    }
+    if(n > remaining) {
+        blocks.emplace_back(new char[block_size]);
+        block_bytes += block_size;
+        current = blocks.back().get();
+        remaining = block_size;
+    }
+    char *p = current;
+    current += n;
+    remaining -= n;
+    return p;
+}
+
+libaan::string_pool::id_type libaan::string_pool::intern(const string_type &s)
+{
+    const uint64_t hash = hash_bytes(s.data(), s.length());
+    size_t index;
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(mutex);
+        const auto id = lookup(s, hash, index);
+        if(id != NONE)
+            return id;
+    }
+
+    std::unique_lock<std::shared_timed_mutex> lock(mutex);
+    // another thread may have inserted it meanwhile
+    auto id = lookup(s, hash, index);
+    if(id != NONE)
+        return id;
+    if((entries.size() + 1) * 2 > table.size()) {
+        grow_table();
+        lookup(s, hash, index);
+    }
+
+    char *p = allocate(s.length() + 1);
+    std::memcpy(p, s.data(), s.length());
+    p[s.length()] = 0;
+    id = static_cast<id_type>(entries.size());
+    entries.push_back({ p, s.length(), hash });
+    table[index] = { static_cast<uint32_t>(hash >> 32), id };
+    return id;
+}
+
+libaan::string_pool::id_type
+libaan::string_pool::find(const string_type &s) const
+{
+    const uint64_t hash = hash_bytes(s.data(), s.length());
+    size_t index;
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    return lookup(s, hash, index);
+}
+
+libaan::string_type libaan::string_pool::get(id_type id) const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    const auto &e = entries[id];
+    return string_type(e.data, e.length);
+}
+
+size_t libaan::string_pool::size() const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    return entries.size();
+}
+
+size_t libaan::string_pool::size_in_bytes() const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    return block_bytes + entries.capacity() * sizeof(entry)
+        + table.capacity() * sizeof(slot);
+}
+
+void libaan::string_pool::clear()
+{
+    std::unique_lock<std::shared_timed_mutex> lock(mutex);
+    blocks.clear();
+    block_bytes = 0;
+    current = nullptr;
+    remaining = 0;
+    entries.clear();
+    table.clear();
+}
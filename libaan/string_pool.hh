@@ -0,0 +1,75 @@
+#ifndef _LIBAAN_STRING_POOL_HH_
+#define _LIBAAN_STRING_POOL_HH_
+
+#include "string.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+namespace libaan {
+
+// Interns strings: each distinct string is copied once into large arena
+// blocks and gets an id, counting from 0 in order of insertion. Lookups use
+// an open addressing hash table with linear probing. All strings are
+// released at once with clear() or on destruction.
+// All functions may be called concurrently, readers share a lock. intern()
+// only takes the exclusive lock for strings not in the pool yet.
+class string_pool {
+public:
+    typedef uint32_t id_type;
+    static const id_type NONE = 0xffffffff;
+
+    // Strings longer than a quarter of block_size get their own block.
+    explicit string_pool(size_t block_size = 64 * 1024);
+
+    // id of s, s is copied into the pool if it is not in it yet
+    id_type intern(const string_type &s);
+    // id of s or NONE
+    id_type find(const string_type &s) const;
+    // Pooled string, 0 terminated. Valid until clear() or destruction.
+    string_type get(id_type id) const;
+
+    size_t size() const;
+    // arena blocks and hash table
+    size_t size_in_bytes() const;
+
+    // releases all strings, ids and views become invalid
+    void clear();
+
+private:
+    struct entry {
+        const char *data;
+        size_t length;
+        uint64_t hash;
+    };
+    struct slot {
+        // upper half of the hash, compared before the entry
+        uint32_t hash;
+        id_type id;
+    };
+
+    // With the lock held: id of s or NONE, index is set to the slot of s or
+    // to the empty slot where it would be inserted.
+    id_type lookup(const string_type &s, uint64_t hash, size_t &index) const;
+    void grow_table();
+    char *allocate(size_t n);
+
+    size_t block_size;
+    std::vector<std::unique_ptr<char[]> > blocks;
+    size_t block_bytes{0};
+    // free part of the current block
+    char *current{nullptr};
+    size_t remaining{0};
+
+    std::vector<entry> entries;
+    // size is a power of 2, at most half full
+    std::vector<slot> table;
+    mutable std::shared_timed_mutex mutex;
+};
+
+}
+
+#endif
@@ -0,0 +1,177 @@
+#include "libaan/base64.hh"
+
+#include <gtest/gtest.h>
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string encode(const std::string &s,
+                   libaan::base64_alphabet alphabet = libaan::BASE64_STANDARD,
+                   bool padding = true)
+{
+    std::string out(libaan::base64_encoded_size(s.size(), padding), '\0');
+    const auto src = reinterpret_cast<const unsigned char *>(s.data());
+    EXPECT_EQ(out.size(), libaan::base64_encode(src, s.size(), &out[0],
+                                                alphabet, padding));
+    return out;
+}
+
+bool decode(const std::string &s, std::string &out,
+            libaan::base64_alphabet alphabet = libaan::BASE64_STANDARD)
+{
+    std::vector<unsigned char> buffer(libaan::base64_decoded_size(s.size()));
+    size_t written;
+    if(!libaan::base64_decode(s.data(), s.size(), buffer.data(), written,
+                              alphabet))
+        return false;
+    out.assign(buffer.begin(), buffer.begin() + long(written));
+    return true;
+}
+
+std::string random_bytes(std::mt19937 &gen, size_t n)
+{
+    std::string s(n, '\0');
+    for(auto &c: s)
+        c = static_cast<char>(gen());
+    return s;
+}
+
+}
+
+TEST(base64_hh, rfc4648) {
+    const std::vector<std::pair<std::string, std::string> > vectors = {
+        { "", "" }, { "f", "Zg==" }, { "fo", "Zm8=" }, { "foo", "Zm9v" },
+        { "foob", "Zm9vYg==" }, { "fooba", "Zm9vYmE=" },
+        { "foobar", "Zm9vYmFy" }
+    };
+    for(const auto &v: vectors) {
+        EXPECT_EQ(v.second, encode(v.first));
+        std::string out;
+        EXPECT_TRUE(decode(v.second, out));
+        EXPECT_EQ(v.first, out);
+        // without padding
+        const auto unpadded = v.second.substr(0, v.second.find('='));
+        EXPECT_EQ(unpadded, encode(v.first, libaan::BASE64_STANDARD, false));
+        EXPECT_TRUE(decode(unpadded, out));
+        EXPECT_EQ(v.first, out);
+    }
+}
+
+TEST(base64_hh, round_trip) {
+    std::mt19937 gen(0);
+    for(size_t n = 0; n < 300; n++) {
+        const auto s = random_bytes(gen, n);
+
+        // compare with OpenSSL
+        std::string expected(libaan::base64_encoded_size(n) + 1, '\0');
+        EVP_EncodeBlock(reinterpret_cast<unsigned char *>(&expected[0]),
+                        reinterpret_cast<const unsigned char *>(s.data()),
+                        static_cast<int>(n));
+        expected.pop_back();
+        const auto standard = encode(s);
+        EXPECT_EQ(expected, standard);
+
+        auto url = standard;
+        std::replace(url.begin(), url.end(), '+', '-');
+        std::replace(url.begin(), url.end(), '/', '_');
+        EXPECT_EQ(url, encode(s, libaan::BASE64_URL));
+
+        std::string out;
+        EXPECT_TRUE(decode(standard, out));
+        EXPECT_EQ(s, out);
+        EXPECT_TRUE(decode(url, out, libaan::BASE64_URL));
+        EXPECT_EQ(s, out);
+        if(standard != url) {
+            EXPECT_FALSE(decode(url, out));
+            EXPECT_FALSE(decode(standard, out, libaan::BASE64_URL));
+        }
+    }
+}
+
+TEST(base64_hh, invalid) {
+    std::string out;
+    for(const char *s: { "Z", "Zg=", "Zg===", "Z===", "=", "==", "Zm9=v",
+                         "Zh==", "Zm9=", "Zm8 ", " Zm8=", "Zm8=\n",
+                         "Zm9vYg==Zm9v", "Zm9vY" })
+        EXPECT_FALSE(decode(s, out)) << s;
+
+    // an invalid character at every position of a long input
+    std::mt19937 gen(1);
+    const auto valid = encode(random_bytes(gen, 3 * 100));
+    for(size_t i = 0; i < valid.size(); i++)
+        for(const char c: { '\0', '=', '.', '@', '[', '`', '{', ':', '\x80',
+                            '\xff', '-', '_' }) {
+            // may be valid padding
+            if(c == '=' && i + 2 >= valid.size())
+                continue;
+            auto s = valid;
+            s[i] = c;
+            EXPECT_FALSE(decode(s, out)) << i << " " << int(c);
+        }
+}
+
+TEST(base64_hh, streaming) {
+    std::mt19937 gen(2);
+    for(unsigned round = 0; round < 200; round++) {
+        const auto s = random_bytes(gen, gen() % 1000);
+        const auto src = reinterpret_cast<const unsigned char *>(s.data());
+
+        libaan::base64_encoder encoder(libaan::BASE64_URL, round % 2 == 0);
+        std::string encoded;
+        for(size_t i = 0; i < s.size();) {
+            const size_t n = std::min<size_t>(gen() % 70, s.size() - i);
+            std::string out(libaan::base64_encoded_size(n + 2), '\0');
+            out.resize(encoder.update(src + i, n, &out[0]));
+            encoded += out;
+            i += n;
+        }
+        char tail[4];
+        encoded.append(tail, encoder.final(tail));
+        EXPECT_EQ(encode(s, libaan::BASE64_URL, round % 2 == 0), encoded);
+
+        libaan::base64_decoder decoder(libaan::BASE64_URL);
+        std::string decoded;
+        for(size_t i = 0; i < encoded.size();) {
+            const size_t n = std::min<size_t>(gen() % 90, encoded.size() - i);
+            std::vector<unsigned char> out(libaan::base64_decoded_size(n + 4));
+            size_t written;
+            EXPECT_TRUE(decoder.update(encoded.data() + i, n, out.data(),
+                                       written));
+            decoded.append(out.begin(), out.begin() + long(written));
+            i += n;
+        }
+        unsigned char last[3];
+        size_t written;
+        EXPECT_TRUE(decoder.final(last, written));
+        decoded.append(last, last + written);
+        EXPECT_EQ(s, decoded);
+    }
+
+    // padding followed by more input
+    libaan::base64_decoder decoder;
+    unsigned char out[16];
+    size_t written;
+    EXPECT_TRUE(decoder.update("Zg==", 4, out, written));
+    EXPECT_FALSE(decoder.update("Zg==", 4, out, written));
+    EXPECT_FALSE(decoder.final(out, written));
+}
+
+TEST(base64_hh, legacy) {
+    char out[16];
+    EXPECT_EQ(8u, libaan::base64encode("foobar", 6, out, sizeof(out)));
+    EXPECT_EQ("Zm9vYmFy", std::string(out, 8));
+    EXPECT_EQ(6u, libaan::base64decode("Zm9vYmFy", 8, out, sizeof(out)));
+    EXPECT_EQ("foobar", std::string(out, 6));
+    // truncated to out_len
+    EXPECT_EQ(4u, libaan::base64encode("foobar", 6, out, 4));
+    EXPECT_EQ("Zm9v", std::string(out, 4));
+    EXPECT_EQ(2u, libaan::base64decode("Zm9vYmFy", 8, out, 2));
+    EXPECT_EQ("fo", std::string(out, 2));
+    EXPECT_EQ(0u, libaan::base64decode("Zm9v!mFy", 8, out, sizeof(out)));
+}
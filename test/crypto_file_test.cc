@@ -1,8 +1,13 @@
 #include "libaan/crypto_file.hh"
+#include "libaan/crypto.hh"
 #include "libaan/file.hh"
 
 #include <gtest/gtest.h>
 
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+
 /*
 
 #include <cstdlib>
@@ -50,3 +55,181 @@ TEST(crypto_file_hh, a) {
     libaan::crypto_file crypt(path);
     
 }
+
+TEST(crypto_file_hh, kdf) {
+    const auto path = libaan::temp_file_path();
+    EXPECT_FALSE(path.empty());
+    const std::string plain(1000, 'x');
+    const auto argon2 = libaan::kdf_params::argon2id(2, 256, 2);
+    {
+        libaan::crypto_file crypt(path);
+        EXPECT_EQ(libaan::crypto_file::NO_ERROR, crypt.read("pw"));
+        EXPECT_TRUE(crypt.get_kdf() == libaan::kdf_params());
+        crypt.set_kdf(argon2);
+        crypt.get_decrypted_buffer() = plain;
+        EXPECT_EQ(libaan::crypto_file::NO_ERROR, crypt.write("pw"));
+    }
+    {
+        // the parameters come from the header
+        libaan::crypto_file crypt(path);
+        EXPECT_EQ(libaan::crypto_file::NO_ERROR, crypt.read("pw"));
+        EXPECT_TRUE(crypt.get_kdf() == argon2);
+        EXPECT_EQ(plain, crypt.get_decrypted_buffer());
+    }
+
+    // the parameters are part of the hmac: 3 passes instead of 2
+    std::string content;
+    {
+        std::ifstream in(path, std::ios_base::binary);
+        content.assign(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+    }
+    ASSERT_LT(size_t(81), content.size());
+    ASSERT_EQ('\x02', content[68 + 4]);
+    content[68 + 4] ^= 1;
+    {
+        std::ofstream out(path, std::ios_base::binary | std::ios_base::trunc);
+        out << content;
+    }
+    libaan::crypto_file crypt(path);
+    EXPECT_NE(libaan::crypto_file::NO_ERROR, crypt.read("pw"));
+    unlink(path.c_str());
+}
+
+TEST(crypto_file_hh, kdf_limits) {
+    const auto path = libaan::temp_file_path();
+    EXPECT_FALSE(path.empty());
+    {
+        libaan::crypto_file crypt(path);
+        EXPECT_EQ(libaan::crypto_file::NO_ERROR, crypt.read("pw"));
+        crypt.set_kdf(libaan::kdf_params::argon2id(1, 256));
+        crypt.get_decrypted_buffer() = std::string(1000, 'x');
+        EXPECT_EQ(libaan::crypto_file::NO_ERROR, crypt.write("pw"));
+    }
+    std::string content;
+    {
+        std::ifstream in(path, std::ios_base::binary);
+        content.assign(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+    }
+    ASSERT_LT(libaan::HEADER_SIZE, content.size());
+
+    // parameters at offset 68 that would run for hours or allocate
+    // terabytes are rejected before any key derivation
+    const std::string forged[] = {
+        std::string("\x03\xff\xff\xff\xff\x00\x00\x01\x00\x00\x00\x00\x01",
+                    13),
+        std::string("\x03\x00\x00\x00\x01\xff\xff\xff\xff\x00\x00\x00\x01",
+                    13),
+        std::string("\x02\x00\x00\x00\x00\x80\x00\x00\x00\x00\x00\x00\x01",
+                    13),
+        std::string("\x01\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x01",
+                    13)
+    };
+    for(const auto &kdf: forged) {
+        content.replace(68, kdf.size(), kdf);
+        {
+            std::ofstream out(path, std::ios_base::binary
+                                        | std::ios_base::trunc);
+            out << content;
+        }
+        libaan::crypto_file crypt(path);
+        EXPECT_EQ(libaan::crypto_file::NO_HEADER_IN_FILE, crypt.read("pw"));
+    }
+    unlink(path.c_str());
+}
+
+TEST(crypto_file_hh, hmac_key) {
+    const auto path = libaan::temp_file_path();
+    EXPECT_FALSE(path.empty());
+    const std::string plain(1000, 'x');
+    const auto argon2 = libaan::kdf_params::argon2id(1, 256);
+    {
+        libaan::crypto_file crypt(path);
+        EXPECT_EQ(libaan::crypto_file::NO_ERROR, crypt.read("pw"));
+        crypt.set_kdf(argon2);
+        crypt.get_decrypted_buffer() = plain;
+        EXPECT_EQ(libaan::crypto_file::NO_ERROR, crypt.write("pw"));
+    }
+    std::string content;
+    {
+        std::ifstream in(path, std::ios_base::binary);
+        content.assign(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+    }
+    ASSERT_LT(libaan::HEADER_SIZE, content.size());
+    // salt at 8, hmac at 40, timestamp and kdf parameters at 60
+    const std::string salt = content.substr(8, 16);
+    const std::string stored = content.substr(40, 20);
+    const std::string data = content.substr(60, 8 + 13)
+        + content.substr(libaan::HEADER_SIZE);
+
+    // 0030: not keyed with the password, but with the hmac key expanded
+    // from the derived master key
+    libaan::hash h;
+    std::string mac;
+    EXPECT_TRUE(h.sha1_hmac(data, "pw", mac));
+    EXPECT_NE(stored, mac);
+    std::string master(32, '\0'), mac_key;
+    EXPECT_TRUE(libaan::derive_key(argon2, "pw", salt, master));
+    libaan::keyed_hmac expand(master, EVP_sha256());
+    EXPECT_TRUE(expand.update(std::string("libaan crypto_file hmac\x01")));
+    EXPECT_TRUE(expand.finish(mac_key));
+    EXPECT_TRUE(h.sha1_hmac(data, mac_key, mac));
+    EXPECT_EQ(stored, mac);
+
+    // 0020 files are still read: password as hmac key, no kdf parameters
+    libaan::camellia_256 cipher;
+    EXPECT_TRUE(cipher.init());
+    std::string encrypted;
+    EXPECT_TRUE(cipher.encrypt("pw", plain, encrypted));
+    const std::string timestamp = content.substr(60, 8);
+    EXPECT_TRUE(h.sha1_hmac(timestamp + encrypted, "pw", mac));
+    std::string header = libaan::MAGIC + libaan::VERSION_0020 + cipher.salt
+        + cipher.iv + mac + timestamp;
+    header.resize(libaan::HEADER_SIZE);
+    {
+        std::ofstream out(path, std::ios_base::binary | std::ios_base::trunc);
+        out << header << encrypted;
+    }
+    {
+        libaan::crypto_file crypt(path);
+        EXPECT_EQ(libaan::crypto_file::NO_ERROR, crypt.read("pw"));
+        EXPECT_EQ(plain, crypt.get_decrypted_buffer());
+        EXPECT_TRUE(crypt.get_kdf() == libaan::kdf_params());
+    }
+    libaan::crypto_file crypt(path);
+    EXPECT_NE(libaan::crypto_file::NO_ERROR, crypt.read("wrong"));
+    unlink(path.c_str());
+}
+
+TEST(crypto_file_hh, key_cache) {
+    const auto path = libaan::temp_file_path();
+    EXPECT_FALSE(path.empty());
+    const std::string plain(1000, 'x');
+    libaan::key_cache cache;
+    {
+        libaan::crypto_file crypt(path);
+        crypt.set_key_cache(&cache);
+        EXPECT_EQ(libaan::crypto_file::NO_ERROR, crypt.read("pw"));
+        crypt.set_kdf(libaan::kdf_params::argon2id(1, 256));
+        crypt.get_decrypted_buffer() = plain;
+        EXPECT_EQ(libaan::crypto_file::NO_ERROR, crypt.write("pw"));
+        EXPECT_EQ(libaan::crypto_file::NO_ERROR, crypt.read("pw"));
+        EXPECT_EQ(plain, crypt.get_decrypted_buffer());
+        EXPECT_EQ(libaan::crypto_file::NO_ERROR, crypt.write("pw"));
+    }
+    if(cache.locked()) {
+        EXPECT_EQ(size_t(1), cache.size());
+    }
+    {
+        // a wrong password does not match the cached key
+        libaan::crypto_file crypt(path);
+        crypt.set_key_cache(&cache);
+        EXPECT_NE(libaan::crypto_file::NO_ERROR, crypt.read("wrong"));
+    }
+    libaan::crypto_file crypt(path);
+    EXPECT_EQ(libaan::crypto_file::NO_ERROR, crypt.read("pw"));
+    EXPECT_EQ(plain, crypt.get_decrypted_buffer());
+    unlink(path.c_str());
+}
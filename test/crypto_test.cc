@@ -5,6 +5,8 @@
 
 #include <gtest/gtest.h>
 
+#include <thread>
+
 TEST(crypto_hh, read_random_bytes_noblock) {
     for(auto count: { 0u, 1u, 10u, 4096u }) {
         std::string b1;
@@ -132,11 +134,250 @@ TEST(crypto_hh, hmac) {
 }
 
 TEST(crypto_hh, hash) {
-    // TODO
+    // FIPS 180 "abc"
+    std::string md;
+    EXPECT_TRUE(libaan::hash().sha1("abc", md));
+    EXPECT_EQ("a9993e364706816aba3e25717850c26c9cd0d89d", libaan::bin2hex(convert(md)));
+
+    const std::vector<std::pair<libaan::digest::algorithm_type, std::string> >
+        abc = {
+        { libaan::digest::SHA1, "a9993e364706816aba3e25717850c26c9cd0d89d" },
+        { libaan::digest::SHA256, "ba7816bf8f01cfea414140de5dae2223"
+                                  "b00361a396177a9cb410ff61f20015ad" },
+        { libaan::digest::SHA512, "ddaf35a193617abacc417349ae204131"
+                                  "12e6fa4e89a97ea20a9eeee64b55d39a"
+                                  "2192992a274fc1a836ba3c23a3feebbd"
+                                  "454d4423643ce80e2a9ac94fa54ca49f" },
+        { libaan::digest::BLAKE2B512, "ba80a53f981c4d0d6a2797b69f12f6e9"
+                                      "4c212f14685ac4b74b12bb6fdbffa2d1"
+                                      "7d87c5392aab792dc252d5de4533cc95"
+                                      "18d38aa8dbf1925ab92386edd4009923" },
+        { libaan::digest::BLAKE2S256, "508c5e8c327c14e2e1a72ba34eeb452f"
+                                      "37458b209ed63a294d999b4c86675982" }
+    };
+    std::string input;
+    EXPECT_TRUE(libaan::read_random_bytes_noblock(100000, input));
+    for(const auto &v: abc) {
+        libaan::digest d(v.first);
+        if(!libaan::digest::get_md(v.first)) {
+            EXPECT_FALSE(d.state);
+            EXPECT_FALSE(d.finish(md));
+            continue;
+        }
+        EXPECT_EQ(v.second.size() / 2, d.size());
+        // the context is reused for every message
+        for(unsigned round = 0; round < 3; round++) {
+            EXPECT_TRUE(d.update("a", 1));
+            EXPECT_TRUE(d.update(std::string("bc")));
+            EXPECT_TRUE(d.finish(md));
+            EXPECT_EQ(v.second, libaan::bin2hex(convert(md)));
+        }
+        EXPECT_TRUE(d.update("x", 1));
+        EXPECT_TRUE(d.reset());
+        EXPECT_TRUE(d.update("abc", 3));
+        EXPECT_TRUE(d.finish(md));
+        EXPECT_EQ(v.second, libaan::bin2hex(convert(md)));
+
+        // chunked input
+        std::string expected;
+        EXPECT_TRUE(d.update(input));
+        EXPECT_TRUE(d.finish(expected));
+        for(size_t i = 0; i < input.size(); i += 777)
+            EXPECT_TRUE(d.update(input.data() + i,
+                                 std::min<size_t>(777, input.size() - i)));
+        EXPECT_TRUE(d.finish(md));
+        EXPECT_EQ(expected, md);
+    }
+}
+
+TEST(crypto_hh, hash_batch) {
+    // lengths around the padding boundaries and some longer ones
+    std::vector<std::string> messages;
+    for(size_t length = 0; length < 300; length++) {
+        std::string m;
+        EXPECT_TRUE(libaan::read_random_bytes_noblock(length, m));
+        messages.push_back(m);
+    }
+    for(const size_t length: { 1000u, 5000u, 100000u, 3u }) {
+        std::string m;
+        EXPECT_TRUE(libaan::read_random_bytes_noblock(length, m));
+        messages.push_back(m);
+    }
+
+    for(const auto algorithm: { libaan::digest::SHA256, libaan::digest::SHA1,
+                                libaan::digest::SHA512 }) {
+        libaan::hash_batch batch(algorithm);
+        libaan::digest d(algorithm);
+        EXPECT_EQ(d.size(), batch.size());
+        // fewer messages than lanes, too
+        for(const size_t count: { messages.size(), size_t(1), size_t(5) }) {
+            const std::vector<std::string> part(messages.begin(),
+                                                messages.begin() + long(count));
+            std::vector<std::string> digests;
+            EXPECT_TRUE(batch.run(part, digests));
+            ASSERT_EQ(count, digests.size());
+            for(size_t i = 0; i < count; i++) {
+                std::string expected;
+                EXPECT_TRUE(d.update(part[i]));
+                EXPECT_TRUE(d.finish(expected));
+                EXPECT_EQ(expected, digests[i]) << i;
+            }
+        }
+    }
+
+    // every SHA-256 kernel the cpu has
+    for(const auto kernel: { libaan::hash_batch::AUTO,
+                             libaan::hash_batch::DIGEST,
+                             libaan::hash_batch::SHA_NI,
+                             libaan::hash_batch::AVX2 }) {
+        libaan::hash_batch batch;
+        if(!batch.set_kernel(kernel)) {
+            std::cout << "hash_batch kernel " << kernel << " not supported\n";
+            continue;
+        }
+        std::vector<std::string> digests;
+        EXPECT_TRUE(batch.run(messages, digests));
+        ASSERT_EQ(messages.size(), digests.size());
+        libaan::digest d(libaan::digest::SHA256);
+        for(size_t i = 0; i < messages.size(); i++) {
+            std::string expected;
+            EXPECT_TRUE(d.update(messages[i]));
+            EXPECT_TRUE(d.finish(expected));
+            EXPECT_EQ(expected, digests[i]) << kernel << " " << i;
+        }
+    }
+    EXPECT_FALSE(libaan::hash_batch(libaan::digest::SHA1).set_kernel(
+                     libaan::hash_batch::AVX2));
+
+    std::vector<std::string> digests;
+    EXPECT_TRUE(libaan::hash_batch().run(std::vector<std::string>(), digests));
+    EXPECT_TRUE(digests.empty());
+}
+
+TEST(crypto_hh, keyed_hmac) {
+    std::string mac;
+    {
+        libaan::keyed_hmac h("key");
+        EXPECT_TRUE(h.state);
+        EXPECT_EQ(20u, h.size());
+        // the key is reused for every message
+        for(unsigned round = 0; round < 3; round++) {
+            EXPECT_TRUE(h.update("The quick brown fox ", 20));
+            EXPECT_TRUE(h.update(std::string("jumps over the lazy dog")));
+            EXPECT_TRUE(h.finish(mac));
+            EXPECT_EQ("de7c9b85b8b78aa6bc8a7a36f70a90701c9db4d9",
+                      libaan::bin2hex(convert(mac)));
+        }
+    }
+
+    // RFC 4231 test cases 1, 2 and 6 (key longer than a block)
+    const std::vector<std::pair<std::pair<std::string, std::string>,
+                                std::string> > rfc4231 = {
+        { { std::string(20, '\x0b'), "Hi There" },
+          "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7" },
+        { { "Jefe", "what do ya want for nothing?" },
+          "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843" },
+        { { std::string(131, '\xaa'),
+            "Test Using Larger Than Block-Size Key - Hash Key First" },
+          "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54" }
+    };
+    for(const auto &v: rfc4231) {
+        libaan::keyed_hmac h(v.first.first, EVP_sha256());
+        EXPECT_TRUE(h.update("x", 1));
+        EXPECT_TRUE(h.reset());
+        EXPECT_TRUE(h.update(v.first.second));
+        EXPECT_TRUE(h.finish(mac));
+        EXPECT_EQ(v.second, libaan::bin2hex(convert(mac)));
+    }
+
+    // same as the one-shot HMAC for keys around the block sizes
+    std::string message;
+    EXPECT_TRUE(libaan::read_random_bytes_noblock(1000, message));
+    for(const auto md: { EVP_sha1(), EVP_sha256(), EVP_sha512() }) {
+        for(const size_t key_length: { 0u, 1u, 64u, 65u, 128u, 129u, 200u }) {
+            std::string key;
+            EXPECT_TRUE(libaan::read_random_bytes_noblock(key_length, key));
+            libaan::keyed_hmac h(key, md);
+            for(const size_t length: { 0u, 55u, 64u, 1000u }) {
+                unsigned char expected[EVP_MAX_MD_SIZE];
+                unsigned int expected_length;
+                HMAC(md, key.data(), int(key.size()),
+                     reinterpret_cast<const unsigned char *>(message.data()),
+                     length, expected, &expected_length);
+                EXPECT_TRUE(h.update(message.data(), length));
+                EXPECT_TRUE(h.finish(mac));
+                EXPECT_EQ(std::string(reinterpret_cast<char *>(expected),
+                                      expected_length), mac);
+            }
+        }
+    }
+
+    // one clone per thread
+    libaan::keyed_hmac keyed("Jefe", EVP_sha256());
+    std::vector<std::string> macs(4);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < macs.size(); t++)
+        threads.emplace_back([&, t]() {
+                libaan::keyed_hmac h(keyed);
+                for(unsigned i = 0; i < 1000; i++) {
+                    h.update(rfc4231[1].first.second);
+                    h.finish(macs[t]);
+                }
+            });
+    for(auto &t: threads)
+        t.join();
+    for(const auto &m: macs)
+        EXPECT_EQ(rfc4231[1].second, libaan::bin2hex(convert(m)));
+    libaan::keyed_hmac assigned("other");
+    assigned = keyed;
+    EXPECT_TRUE(assigned.update(rfc4231[1].first.second));
+    EXPECT_TRUE(assigned.finish(mac));
+    EXPECT_EQ(rfc4231[1].second, libaan::bin2hex(convert(mac)));
+
+    libaan::keyed_hmac invalid("key", nullptr);
+    EXPECT_FALSE(invalid.state);
+    EXPECT_FALSE(invalid.update("x", 1));
+    EXPECT_FALSE(invalid.finish(mac));
+    EXPECT_TRUE(mac.empty());
+}
+
+namespace {
+struct pbkdf2_vector {
+    std::string password;
+    std::string salt;
+    unsigned int iterations;
+    std::string key;
+};
+
+// RFC 6070
+const std::vector<pbkdf2_vector> rfc6070 = {
+    { "password", "salt", 1, "0c60c80f961f0e71f3a9b524af6012062fe037a6" },
+    { "password", "salt", 2, "ea6c014dc72d6f8ccd1ed92ace1d41f0d8de8957" },
+    { "password", "salt", 4096, "4b007901b765489abead49d926f721d065a429c1" },
+    { "passwordPASSWORDpassword", "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096,
+      "3d2eec4fe41c849b80c8d83662c0e44a8b291a964cf2f07038" },
+    { std::string("pass\0word", 9), std::string("sa\0lt", 5), 4096,
+      "56fa6aa75548099dcc37d7f03425e0c3" }
+};
 }
 
 TEST(crypto_hh, pkcs5) {
-    // TODO
+    for(const auto &v: rfc6070) {
+        // blocks of the reference implementation, it runs ic + 1 iterations
+        std::vector<unsigned char> key(
+            (v.key.size() / 2 + libaan::PRF_OUTPUT_LENGTH - 1)
+            / libaan::PRF_OUTPUT_LENGTH * libaan::PRF_OUTPUT_LENGTH);
+        for(size_t block = 0; block * libaan::PRF_OUTPUT_LENGTH < key.size();
+            block++)
+            libaan::pkcs5_F(
+                reinterpret_cast<const unsigned char *>(v.password.data()),
+                v.password.size(),
+                reinterpret_cast<const unsigned char *>(v.salt.data()),
+                v.salt.size(), v.iterations - 1, block + 1,
+                &key[block * libaan::PRF_OUTPUT_LENGTH]);
+        key.resize(v.key.size() / 2);
+        EXPECT_EQ(v.key, libaan::bin2hex(key));
+    }
 }
 
 /*
@@ -161,13 +402,150 @@ bool get_key(const std::string & pw, std::string & key)
 */
 
 TEST(crypto_hh, pbkdf2) {
-    // TODO
+    for(const auto &v: rfc6070) {
+        std::string key(v.key.size() / 2, '\0');
+        EXPECT_TRUE(libaan::pbkdf2(v.password, v.salt, v.iterations, key));
+        EXPECT_EQ(v.key, libaan::bin2hex(convert(key)));
+    }
+
+    // RFC 7914
+    std::string key(64, '\0');
+    EXPECT_TRUE(libaan::pbkdf2("passwd", "salt", 1, key,
+                               libaan::digest::SHA256));
+    EXPECT_EQ("55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc"
+              "49ca9cccf179b645991664b39d77ef317c71b845b1e30bd509112041d3a19783",
+              libaan::bin2hex(convert(key)));
+
+    // same as OpenSSL for passwords around the block sizes and keys of
+    // several blocks
+    std::string salt;
+    EXPECT_TRUE(libaan::read_random_bytes_noblock(16, salt));
+    for(const auto prf: { libaan::digest::SHA1, libaan::digest::SHA256,
+                          libaan::digest::SHA512,
+                          libaan::digest::BLAKE2B512 }) {
+        const EVP_MD *md = libaan::digest::get_md(prf);
+        if(!md) {
+            EXPECT_FALSE(libaan::pbkdf2("pw", salt, 1, key, prf));
+            continue;
+        }
+        for(const size_t password_length: { 0u, 64u, 65u, 128u, 129u }) {
+            std::string password;
+            EXPECT_TRUE(libaan::read_random_bytes_noblock(password_length,
+                                                          password));
+            for(const size_t key_length: { 1u, 20u, 33u, 150u }) {
+                std::string expected(key_length, '\0');
+                key.assign(key_length, '\0');
+                EXPECT_EQ(1, PKCS5_PBKDF2_HMAC(
+                              password.data(), int(password.size()),
+                              reinterpret_cast<const unsigned char *>(salt.data()),
+                              int(salt.size()), 3, md, int(key_length),
+                              reinterpret_cast<unsigned char *>(&expected[0])));
+                EXPECT_TRUE(libaan::pbkdf2(password, salt, 3, key, prf));
+                EXPECT_EQ(expected, key) << prf << " " << password_length
+                                         << " " << key_length;
+            }
+        }
+
+        // blocks in parallel, also more threads than blocks
+        std::string serial(130, '\0');
+        EXPECT_TRUE(libaan::pbkdf2("pw", salt, 100, serial, prf));
+        for(unsigned threads: { 2u, 3u, 8u, 100u }) {
+            key.assign(serial.size(), '\0');
+            EXPECT_TRUE(libaan::pbkdf2("pw", salt, 100, key, prf, threads));
+            EXPECT_EQ(serial, key) << prf << " " << threads;
+        }
+    }
 }
 
 TEST(crypto_hh, camellia_256) {
     // TODO
 }
 
+TEST(crypto_hh, aead_cipher) {
+    const auto from_hex = [](const char *h) {
+        const auto b = libaan::hex2bin(h);
+        return std::string(b.second.begin(), b.second.end());
+    };
+    struct vector_type {
+        libaan::aead_cipher::algorithm_type algorithm;
+        const char *key;
+        const char *nonce;
+        const char *ad;
+        std::string plain;
+        const char *sealed;
+    };
+    const vector_type vectors[] = {
+        // NIST GCM test case 16
+        { libaan::aead_cipher::AES_256_GCM,
+          "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308",
+          "cafebabefacedbaddecaf888", "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+          from_hex("d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d"
+                   "8a318a721c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657"
+                   "ba637b39"),
+          "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+          "8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662"
+          "76fc6ece0f4e1768cddf8853bb2d551b" },
+        // RFC 8439 2.8.2
+        { libaan::aead_cipher::CHACHA20_POLY1305,
+          "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f",
+          "070000004041424344454647", "50515253c0c1c2c3c4c5c6c7",
+          "Ladies and Gentlemen of the class of '99: If I could offer you "
+          "only one tip for the future, sunscreen would be it.",
+          "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+          "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+          "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+          "3ff4def08e4b7a9de576d26586cec64b6116"
+          "1ae10b594f09e26a7e902ecbd0600691" }
+    };
+    for(const auto &v: vectors) {
+        libaan::aead_cipher c(v.algorithm);
+        if(!libaan::aead_cipher::get_cipher(v.algorithm)) {
+            // ChaCha20-Poly1305 before OpenSSL 1.1
+            EXPECT_FALSE(c.state);
+            continue;
+        }
+        EXPECT_TRUE(c.state);
+        const std::string key = from_hex(v.key);
+        const std::string nonce = from_hex(v.nonce);
+        const std::string ad = from_hex(v.ad);
+        std::string sealed, plain;
+        EXPECT_TRUE(c.encrypt(key, nonce, ad, v.plain, sealed));
+        EXPECT_EQ(v.sealed, libaan::bin2hex(convert(sealed)));
+        EXPECT_TRUE(c.decrypt(key, nonce, ad, sealed, plain));
+        EXPECT_EQ(v.plain, plain);
+
+        // any change of ciphertext, tag, associated data or nonce
+        for(const size_t i: { size_t(0), sealed.size() - 1 }) {
+            std::string tampered = sealed;
+            tampered[i] ^= 1;
+            EXPECT_FALSE(c.decrypt(key, nonce, ad, tampered, plain));
+            EXPECT_TRUE(plain.empty());
+        }
+        EXPECT_FALSE(c.decrypt(key, nonce, ad + "x", sealed, plain));
+        std::string other_nonce = nonce;
+        other_nonce[0] ^= 1;
+        EXPECT_FALSE(c.decrypt(key, other_nonce, ad, sealed, plain));
+        EXPECT_FALSE(c.decrypt(key, nonce, ad, sealed.substr(0, 15), plain));
+
+        // empty plain text and associated data, the context is reused
+        EXPECT_TRUE(c.encrypt(key, nonce, "", "", sealed));
+        EXPECT_EQ(libaan::aead_cipher::TAG_SIZE, sealed.size());
+        plain = "x";
+        EXPECT_TRUE(c.decrypt(key, nonce, "", sealed, plain));
+        EXPECT_TRUE(plain.empty());
+
+        // round trip of random data, also longer than a gcm counter block
+        std::string data;
+        EXPECT_TRUE(libaan::read_random_bytes_noblock(100000, data));
+        EXPECT_TRUE(c.encrypt(key, nonce, ad, data, sealed));
+        EXPECT_TRUE(c.decrypt(key, nonce, ad, sealed, plain));
+        EXPECT_EQ(data, plain);
+
+        EXPECT_FALSE(c.encrypt(key.substr(1), nonce, ad, data, sealed));
+        EXPECT_FALSE(c.encrypt(key, nonce + "x", ad, data, sealed));
+    }
+}
+
 TEST(crypto_hh, lion) {
     // TODO
 
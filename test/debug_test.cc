@@ -2,7 +2,11 @@
 
 #include <gtest/gtest.h>
 
+#include <cctype>
+#include <cstdio>
 #include <cstring>
+#include <random>
+#include <vector>
 
 void t(const char *a)
 {
@@ -36,3 +40,54 @@ TEST(debug_hh, hex2bin) {
     t("de7c9b85b8b78aa6bc8a7a36f70a90701c9db4d9");
     t("fbdb1d1b18aa6c08324b7d64b71fb76370690e1d");
 }
+
+TEST(debug_hh, hex_buffers) {
+    std::mt19937 gen(16);
+    std::uniform_int_distribution<int> dist(0, 255);
+    for(size_t n = 0; n < 300; n += n < 70 ? 1 : 37) {
+        std::vector<unsigned char> in(n);
+        for(auto &c: in)
+            c = static_cast<unsigned char>(dist(gen));
+        std::string expected;
+        for(const auto c: in) {
+            char pair[3];
+            snprintf(pair, sizeof(pair), "%02x", c);
+            expected += pair;
+        }
+
+        std::string hex(2 * n, '\0');
+        libaan::bin2hex(in.data(), n, &hex[0]);
+        EXPECT_EQ(expected, hex);
+        EXPECT_EQ(expected, libaan::bin2hex(in));
+
+        std::vector<unsigned char> out(n);
+        EXPECT_TRUE(libaan::hex2bin(hex.data(), hex.size(), out.data()));
+        EXPECT_EQ(in, out);
+        // upper case
+        for(auto &c: hex)
+            c = static_cast<char>(std::toupper(c));
+        EXPECT_TRUE(libaan::hex2bin(hex.data(), hex.size(), out.data()));
+        EXPECT_EQ(in, out);
+
+        // an invalid character anywhere
+        for(size_t i = 0; i < hex.size(); i += 5) {
+            for(const char bad: { 'g', 'G', '/', ':', '@', '`', '\0', '\xff' }) {
+                const char good = hex[i];
+                hex[i] = bad;
+                EXPECT_FALSE(libaan::hex2bin(hex.data(), hex.size(), out.data()))
+                    << n << " " << i << " " << int(bad);
+                hex[i] = good;
+            }
+        }
+    }
+    unsigned char out[2];
+    EXPECT_FALSE(libaan::hex2bin("abc", 3, out));
+    EXPECT_TRUE(libaan::hex2bin("", 0, out));
+
+    const auto odd = libaan::hex2bin("abc");
+    EXPECT_FALSE(odd.first);
+    EXPECT_EQ(std::vector<unsigned char>({ 0xab }), odd.second);
+    const auto invalid = libaan::hex2bin("abxy");
+    EXPECT_FALSE(invalid.first);
+    EXPECT_TRUE(invalid.second.empty());
+}
@@ -0,0 +1,132 @@
+#include "libaan/fm_index.hh"
+#include "libaan/file.hh"
+#include "libaan/string.hh"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+TEST(fm_index_hh, rank_bit_vector) {
+    std::minstd_rand rng(3);
+    for(size_t n: { 0u, 1u, 63u, 64u, 511u, 512u, 513u, 5000u }) {
+        libaan::search::rank_bit_vector bits(n);
+        std::vector<bool> reference(n);
+        for(size_t i = 0; i < n; i++)
+            if(rng() % 3 == 0) {
+                bits.set(i);
+                reference[i] = true;
+            }
+        bits.build();
+
+        size_t ones = 0;
+        for(size_t i = 0; i <= n; i++) {
+            EXPECT_EQ(ones, bits.rank1(i));
+            EXPECT_EQ(i - ones, bits.rank0(i));
+            if(i < n) {
+                EXPECT_EQ(reference[i], bits.get(i));
+                if(reference[i])
+                    EXPECT_EQ(i, bits.select1(ones));
+                else
+                    EXPECT_EQ(i, bits.select0(i - ones));
+                ones += reference[i];
+            }
+        }
+    }
+}
+
+TEST(fm_index_hh, wavelet_matrix) {
+    std::minstd_rand rng(5);
+    std::vector<unsigned char> symbols(3000);
+    for(auto &c: symbols)
+        c = static_cast<unsigned char>(rng() % 2 ? rng() % 4 : rng() % 256);
+    const libaan::search::wavelet_matrix wm(symbols);
+    EXPECT_EQ(symbols.size(), wm.size());
+
+    std::vector<size_t> counts(256, 0);
+    for(size_t i = 0; i < symbols.size(); i++) {
+        const auto c = symbols[i];
+        EXPECT_EQ(c, wm.access(i));
+        size_t rank;
+        EXPECT_EQ(c, wm.inverse_select(i, rank));
+        EXPECT_EQ(counts[c], rank);
+        EXPECT_EQ(counts[c], wm.rank(c, i));
+        EXPECT_EQ(counts['\x1'], wm.rank(1, i, symbols.size()).first);
+        EXPECT_EQ(i, wm.select(c, counts[c]));
+        counts[c]++;
+    }
+    for(unsigned c = 0; c < 256; c++)
+        EXPECT_EQ(counts[c], wm.rank(static_cast<unsigned char>(c),
+                                     symbols.size()));
+}
+
+namespace {
+
+void check_fm_index(const std::string &in,
+                    const std::vector<std::string> &patterns)
+{
+    std::vector<int> suffixes(in.size());
+    libaan::search::sarr_sais(in.data(), static_cast<int>(in.size()),
+                              suffixes.data());
+    const libaan::search::sarr_lcp sarr(in.data(), static_cast<int>(in.size()),
+                                        suffixes.data());
+
+    for(unsigned sample_rate: { 1u, 4u, 32u }) {
+        const libaan::search::fm_index fm(in.data(), in.size(),
+                                          suffixes.data(), sample_rate);
+        EXPECT_EQ(in.size(), fm.size());
+        for(const auto &p: patterns) {
+            const auto expected = sarr.search(p);
+            EXPECT_EQ(expected.size(), fm.count(p)) << p;
+            const auto located = fm.locate(p);
+            EXPECT_TRUE(std::equal(expected.begin(), expected.end(),
+                                   std::begin(located),
+                                   [](int a, size_t b) {
+                                       return static_cast<size_t>(a) == b; }))
+                << p;
+        }
+    }
+}
+
+}
+
+TEST(fm_index_hh, fm_index) {
+    std::string words;
+    libaan::read_file(WORDSFILE, words);
+    ASSERT_FALSE(words.empty());
+    const libaan::search::fm_index fm(words);
+    EXPECT_EQ(1, fm.count("1080"));
+    EXPECT_EQ(std::vector<size_t> { 0 }, fm.locate("1080"));
+    EXPECT_EQ(std::vector<size_t> { 14 }, fm.locate("10th"));
+    EXPECT_EQ(0, fm.count(""));
+    EXPECT_EQ(0, fm.count(words + "x"));
+    // a fraction of the memory of the int suffix array
+    EXPECT_LT(fm.size_in_bytes(), words.size() * sizeof(int) / 2);
+
+    check_fm_index(words.substr(0, 20000),
+                   { "10", "th", "\n", "ing\n", "e", "zzz", "1080\n10-point" });
+
+    for(const auto &in: std::vector<std::string> { "banana", "mississippi",
+                "aaaaaaaa", "a", "", std::string("a\0b\0a\0", 6),
+                std::string("\0\0\0", 3), std::string("\xff\x01\xff\x80\x7f", 5) })
+        check_fm_index(in, { "a", "an", "ana", "b", "ss", "issi", "aaa",
+                    std::string("\0", 1), std::string("a\0", 2),
+                    std::string("\0\0", 2), "\xff", "\x80\x7f", "x" });
+
+    std::minstd_rand rng(11);
+    for(int i = 0; i < 50; i++) {
+        std::string in(rng() % 300, 'a');
+        for(auto &c: in)
+            c = static_cast<char>(rng() % 3);
+        std::vector<std::string> patterns;
+        for(int j = 0; j < 20; j++) {
+            std::string p(1 + rng() % 5, 'a');
+            for(auto &c: p)
+                c = static_cast<char>(rng() % 3);
+            patterns.push_back(p);
+        }
+        check_fm_index(in, patterns);
+    }
+}
@@ -0,0 +1,225 @@
+#include "libaan/kdf.hh"
+#include "libaan/crypto.hh"
+#include "libaan/debug.hh"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace {
+std::string hex(const std::string &s)
+{
+    return libaan::bin2hex(std::vector<unsigned char>(s.begin(), s.end()));
+}
+}
+
+TEST(kdf_hh, params) {
+    const std::vector<libaan::kdf_params> valid = {
+        libaan::kdf_params(),
+        libaan::kdf_params::pbkdf2(100000),
+        libaan::kdf_params::scrypt(1 << 16, 2),
+        libaan::kdf_params::argon2id(3, 1 << 16, 4),
+        // at the cost limits
+        libaan::kdf_params::pbkdf2(libaan::kdf_params::MAX_ITERATIONS),
+        libaan::kdf_params::scrypt(libaan::kdf_params::MAX_MEMORY_KIB),
+        libaan::kdf_params::argon2id(libaan::kdf_params::MAX_PASSES,
+                                     libaan::kdf_params::MAX_MEMORY_KIB,
+                                     libaan::kdf_params::MAX_PARALLELISM)
+    };
+    for(const auto &params: valid) {
+        EXPECT_TRUE(params.valid());
+        const std::string s = params.serialize();
+        EXPECT_EQ(libaan::kdf_params::SERIALIZED_SIZE, s.size());
+        libaan::kdf_params read;
+        read.threads = 3;
+        EXPECT_TRUE(read.deserialize(s));
+        EXPECT_TRUE(params == read);
+        // threads is not stored
+        EXPECT_EQ(3u, read.threads);
+    }
+    EXPECT_EQ(std::string("\x03\x00\x00\x00\x03\x00\x01\x00\x00\x00\x00\x00\x04",
+                          13), valid[3].serialize());
+
+    const std::vector<libaan::kdf_params> invalid = {
+        libaan::kdf_params::pbkdf2(0),
+        libaan::kdf_params::scrypt(1000),
+        libaan::kdf_params::scrypt(1),
+        libaan::kdf_params::scrypt(1024, 0),
+        libaan::kdf_params::argon2id(0, 1024),
+        libaan::kdf_params::argon2id(1, 31, 4),
+        libaan::kdf_params::argon2id(1, 1024, 0),
+        // cost limits
+        libaan::kdf_params::pbkdf2(0xffffffff),
+        libaan::kdf_params::pbkdf2(libaan::kdf_params::MAX_ITERATIONS + 1,
+                                   libaan::kdf_params::PBKDF2_SHA1),
+        libaan::kdf_params::scrypt(1u << 31),
+        libaan::kdf_params::scrypt(libaan::kdf_params::MAX_MEMORY_KIB, 2),
+        libaan::kdf_params::scrypt(1024, libaan::kdf_params::MAX_PARALLELISM
+                                   + 1),
+        libaan::kdf_params::argon2id(0xffffffff, 1024),
+        libaan::kdf_params::argon2id(1, 0xffffffff),
+        libaan::kdf_params::argon2id(1, 1 << 16,
+                                     libaan::kdf_params::MAX_PARALLELISM + 1)
+    };
+    for(const auto &params: invalid) {
+        EXPECT_FALSE(params.valid());
+        libaan::kdf_params read;
+        EXPECT_FALSE(read.deserialize(params.serialize()));
+        EXPECT_TRUE(read == libaan::kdf_params());
+        std::string key(32, '\0');
+        EXPECT_FALSE(libaan::derive_key(params, "pw", "saltsalt", key));
+    }
+    libaan::kdf_params read;
+    EXPECT_FALSE(read.deserialize(std::string("\x04\x00\x00\x00\x01\x00\x00"
+                                              "\x00\x00\x00\x00\x00\x01", 13)));
+    EXPECT_FALSE(read.deserialize(valid[1].serialize().substr(1)));
+}
+
+TEST(kdf_hh, derive_key) {
+    // the default is what camellia_256 always used
+    const std::string salt(16, 's');
+    std::string key(32, '\0'), expected(32, '\0');
+    EXPECT_TRUE(libaan::derive_key(libaan::kdf_params(), "pw", salt, key));
+    EXPECT_TRUE(libaan::pbkdf2("pw", salt, 1001, expected));
+    EXPECT_EQ(expected, key);
+
+    EXPECT_TRUE(libaan::derive_key(libaan::kdf_params::pbkdf2(10), "pw", salt,
+                                   key));
+    EXPECT_TRUE(libaan::pbkdf2("pw", salt, 10, expected,
+                               libaan::digest::SHA256));
+    EXPECT_EQ(expected, key);
+
+    EXPECT_TRUE(libaan::derive_key(libaan::kdf_params::scrypt(64, 2), "pw",
+                                   salt, key));
+    EXPECT_TRUE(libaan::scrypt("pw", salt, 64, 8, 2, expected));
+    EXPECT_EQ(expected, key);
+
+    EXPECT_TRUE(libaan::derive_key(libaan::kdf_params::argon2id(2, 64, 2),
+                                   "pw", salt, key));
+    EXPECT_TRUE(libaan::argon2id("pw", salt, 2, 64, 2, expected));
+    EXPECT_EQ(expected, key);
+
+    key.clear();
+    EXPECT_FALSE(libaan::derive_key(libaan::kdf_params(), "pw", salt, key));
+}
+
+TEST(kdf_hh, scrypt) {
+    // RFC 7914
+    std::string key(64, '\0');
+    EXPECT_TRUE(libaan::scrypt("", "", 16, 1, 1, key));
+    EXPECT_EQ("77d6576238657b203b19ca42c18a0497f16b4844e3074ae8dfdffa3fede2144"
+              "2fcd0069ded0948f8326a753a0fc81f17e8d3e0fb2e0d3628cf35e20c38d18906",
+              hex(key));
+    for(const unsigned threads: { 1u, 4u, 16u, 20u }) {
+        key.assign(64, '\0');
+        EXPECT_TRUE(libaan::scrypt("password", "NaCl", 1024, 8, 16, key,
+                                   threads));
+        EXPECT_EQ("fdbabe1c9d3472007856e7190d01e9fe7c6ad7cbc8237830e7737663"
+                  "4b3731622eaf30d92e22a3886ff109279d9830dac727afb94a83ee6d"
+                  "8360cbdfa2cc0640", hex(key)) << threads;
+    }
+
+    EXPECT_FALSE(libaan::scrypt("pw", "salt", 1000, 8, 1, key));
+    EXPECT_FALSE(libaan::scrypt("pw", "salt", 1024, 0, 1, key));
+    EXPECT_FALSE(libaan::scrypt("pw", "salt", 1024, 8, 0, key));
+    EXPECT_FALSE(libaan::scrypt("pw", "salt", uint64_t(1) << 62, 8, 1, key));
+}
+
+TEST(kdf_hh, argon2id) {
+    // RFC 9106 5.3
+    std::string key(32, '\0');
+    for(const unsigned threads: { 1u, 2u, 4u }) {
+        EXPECT_TRUE(libaan::argon2id(std::string(32, '\x01'),
+                                     std::string(16, '\x02'), 3, 32, 4, key,
+                                     threads, std::string(8, '\x03'),
+                                     std::string(12, '\x04')));
+        EXPECT_EQ("0d640df58d78766c08c037a34a8b53c9d01ef0452d75b65eb52520e96b01e659",
+                  hex(key)) << threads;
+    }
+
+    // reference implementation
+    EXPECT_TRUE(libaan::argon2id("password", "somesalt", 2, 65536, 1, key));
+    EXPECT_EQ("09316115d5cf24ed5a15a31a3ba326e5cf32edc24702987c02b6566f61913cf7",
+              hex(key));
+    key.assign(40, '\0');
+    EXPECT_TRUE(libaan::argon2id("password", "somesalt", 3, 64, 4, key, 3));
+    EXPECT_EQ("6f520152a6513727497ff1b59786a5e64a7e0664ec6fc70346c5cedb17054b3e"
+              "1d27cedf6dcd3e3d", hex(key));
+    // memory not a multiple of 4 * lanes, long tag
+    key.assign(64, '\0');
+    EXPECT_TRUE(libaan::argon2id("pw", "saltsaltsalt", 1, 100, 3, key, 2));
+    EXPECT_EQ("f264813e259b15f646e26d653c56e26e9a0818b41706ac0ee12746309b14d21e"
+              "7954114820569eebfa0de6fbb02c7045d67ed982ce99290ba8967deebd56b393",
+              hex(key));
+
+    EXPECT_FALSE(libaan::argon2id("pw", "saltsalt", 0, 64, 1, key));
+    EXPECT_FALSE(libaan::argon2id("pw", "saltsalt", 1, 7, 1, key));
+    EXPECT_FALSE(libaan::argon2id("pw", "short", 1, 64, 1, key));
+    key.resize(3);
+    EXPECT_FALSE(libaan::argon2id("pw", "saltsalt", 1, 64, 1, key));
+}
+
+TEST(kdf_hh, key_cache) {
+    const auto params = libaan::kdf_params::pbkdf2(10);
+    const std::string salt(16, 's');
+    std::string key(32, '\0'), expected(32, '\0');
+    EXPECT_TRUE(libaan::derive_key(params, "pw", salt, expected));
+
+    libaan::key_cache cache(std::chrono::minutes(1), 2);
+    if(!cache.locked()) {
+        // RLIMIT_MEMLOCK too low, nothing is cached
+        EXPECT_FALSE(cache.get(params, "pw", salt, key));
+        return;
+    }
+    EXPECT_EQ(size_t(0), cache.size());
+    EXPECT_FALSE(cache.get(params, "pw", salt, key));
+    cache.put(params, "pw", salt, expected);
+    EXPECT_EQ(size_t(1), cache.size());
+    EXPECT_TRUE(cache.get(params, "pw", salt, key));
+    EXPECT_EQ(expected, key);
+
+    // every part of the id
+    EXPECT_FALSE(cache.get(params, "pw2", salt, key));
+    EXPECT_FALSE(cache.get(params, "pw", std::string(16, 't'), key));
+    EXPECT_FALSE(cache.get(libaan::kdf_params::pbkdf2(11), "pw", salt, key));
+    std::string short_key(16, '\0');
+    EXPECT_FALSE(cache.get(params, "pw", salt, short_key));
+    std::string long_key(libaan::key_cache::MAX_KEY_SIZE + 1, '\0');
+    cache.put(params, "pw", salt, long_key);
+    EXPECT_FALSE(cache.get(params, "pw", salt, long_key));
+    EXPECT_EQ(size_t(1), cache.size());
+
+    // the entry that expires first is replaced
+    cache.put(params, "a", salt, std::string(32, 'a'));
+    cache.put(params, "b", salt, std::string(32, 'b'));
+    EXPECT_EQ(size_t(2), cache.size());
+    EXPECT_FALSE(cache.get(params, "pw", salt, key));
+    EXPECT_TRUE(cache.get(params, "b", salt, key));
+    EXPECT_EQ(std::string(32, 'b'), key);
+    cache.put(params, "b", salt, std::string(32, 'c'));
+    EXPECT_TRUE(cache.get(params, "b", salt, key));
+    EXPECT_EQ(std::string(32, 'c'), key);
+    EXPECT_EQ(size_t(0), cache.purge_expired());
+    cache.purge();
+    EXPECT_EQ(size_t(0), cache.size());
+    EXPECT_FALSE(cache.get(params, "b", salt, key));
+
+    // derive_key fills the cache and takes keys from it
+    key.assign(32, '\0');
+    EXPECT_TRUE(libaan::derive_key(params, "pw", salt, key, &cache));
+    EXPECT_EQ(expected, key);
+    EXPECT_EQ(size_t(1), cache.size());
+    cache.put(params, "pw", salt, std::string(32, 'x'));
+    EXPECT_TRUE(libaan::derive_key(params, "pw", salt, key, &cache));
+    EXPECT_EQ(std::string(32, 'x'), key);
+
+    libaan::key_cache expiring(std::chrono::milliseconds(20));
+    expiring.put(params, "pw", salt, expected);
+    EXPECT_TRUE(expiring.get(params, "pw", salt, key));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    EXPECT_FALSE(expiring.get(params, "pw", salt, key));
+    expiring.put(params, "pw", salt, expected);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    EXPECT_EQ(size_t(1), expiring.purge_expired());
+    EXPECT_EQ(size_t(0), expiring.size());
+}
@@ -0,0 +1,162 @@
+#include "libaan/sarr_file.hh"
+#include "libaan/file.hh"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+namespace {
+
+std::vector<int> to_vector(const libaan::search::sarr_range &r)
+{
+    return std::vector<int>(r.begin(), r.end());
+}
+
+}
+
+TEST(sarr_file_hh, round_trip) {
+    const std::string in = "mississippi banana ananas missing";
+    const auto n = static_cast<int>(in.size());
+    std::vector<int> suffixes(in.size());
+    libaan::search::sarr_sais(in.c_str(), n, suffixes.data());
+
+    libaan::search::sarr_lcp sarr(in.c_str(), n, suffixes.data());
+    libaan::search::sarr_lcp sarr_plain(in.c_str(), n, suffixes.data(),
+                                        nullptr, nullptr, nullptr);
+    const std::vector<std::string> patterns
+        = { "ss", "ana", "i", "mis", "x", "", "missing", "s ", in, in + "a" };
+
+    for(const auto *s: { &sarr, &sarr_plain }) {
+        const auto path = libaan::temp_file_path();
+        ASSERT_FALSE(path.empty());
+        EXPECT_EQ(libaan::search::sarr_file::NO_ERROR,
+                  libaan::search::sarr_file::write(path, *s));
+
+        libaan::search::sarr_file file;
+        ASSERT_EQ(libaan::search::sarr_file::NO_ERROR, file.open(path));
+        ASSERT_NE(nullptr, file.get());
+        EXPECT_EQ(n, file.get()->size());
+        EXPECT_EQ(in, std::string(file.get()->get_text()));
+        EXPECT_EQ(s->get_lcp() == nullptr, file.get()->get_lcp() == nullptr);
+        EXPECT_EQ(suffixes, std::vector<int>(file.get()->get_suffix_array(),
+                                             file.get()->get_suffix_array()
+                                                 + n));
+
+        for(const auto &p: patterns)
+            EXPECT_EQ(to_vector(sarr.search(p)), to_vector(file.search(p)))
+                << p;
+
+        file.close();
+        EXPECT_EQ(nullptr, file.get());
+        std::remove(path.c_str());
+    }
+}
+
+TEST(sarr_file_hh, bad_files) {
+    libaan::search::sarr_file file;
+    EXPECT_EQ(libaan::search::sarr_file::OPEN_FAILED,
+              file.open("/nonexistent/sarr_file"));
+    EXPECT_EQ(libaan::search::sarr_file::OPEN_FAILED, file.get_last_error());
+
+    const std::string in = "abracadabra";
+    const auto n = static_cast<int>(in.size());
+    std::vector<int> suffixes(in.size());
+    libaan::search::sarr_sais(in.c_str(), n, suffixes.data());
+    libaan::search::sarr_lcp sarr(in.c_str(), n, suffixes.data());
+
+    const auto path = libaan::temp_file_path();
+    ASSERT_FALSE(path.empty());
+    {
+        std::ofstream fp(path, std::ios_base::binary | std::ios_base::trunc);
+        fp << "too short";
+    }
+    EXPECT_EQ(libaan::search::sarr_file::NO_HEADER_IN_FILE, file.open(path));
+
+    // wrong version
+    ASSERT_EQ(libaan::search::sarr_file::NO_ERROR,
+              libaan::search::sarr_file::write(path, sarr));
+    {
+        std::fstream fp(path, std::ios_base::binary | std::ios_base::in
+                                  | std::ios_base::out);
+        fp.seekp(4);
+        fp.put('\x7');
+    }
+    EXPECT_EQ(libaan::search::sarr_file::NO_HEADER_IN_FILE, file.open(path));
+    EXPECT_EQ(nullptr, file.get());
+
+    // file size does not match the header
+    ASSERT_EQ(libaan::search::sarr_file::NO_ERROR,
+              libaan::search::sarr_file::write(path, sarr));
+    {
+        std::ofstream fp(path, std::ios_base::binary | std::ios_base::app);
+        fp << "trailing garbage";
+    }
+    EXPECT_EQ(libaan::search::sarr_file::FILE_LENGTH, file.open(path));
+    EXPECT_EQ("FILE_LENGTH",
+              libaan::search::sarr_file::error_string(file.get_last_error()));
+
+    // crafted offsets: wrapping sums and arrays overlapping the header
+    const std::pair<std::streamoff, uint64_t> crafted[] = {
+        { 40, ~uint64_t(0) - 7 },   // text_offset + n + 1 wraps
+        { 32, ~uint64_t(0) - 7 },   // lcp_offset + 3 * array_size wraps
+        { 24, ~uint64_t(0) - 7 },   // suffix_array_offset + array_size wraps
+        { 24, 0 },                  // suffix array on the header
+        { 40, 8 }                   // text in the header
+    };
+    for(const auto &field: crafted) {
+        ASSERT_EQ(libaan::search::sarr_file::NO_ERROR,
+                  libaan::search::sarr_file::write(path, sarr));
+        {
+            std::fstream fp(path, std::ios_base::binary | std::ios_base::in
+                                      | std::ios_base::out);
+            fp.seekp(field.first);
+            fp.write(reinterpret_cast<const char *>(&field.second),
+                     sizeof(field.second));
+        }
+        EXPECT_EQ(libaan::search::sarr_file::FILE_LENGTH, file.open(path))
+            << field.first;
+        EXPECT_EQ(nullptr, file.get());
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST(sarr_file_hh, index_types) {
+    typedef libaan::search::basic_sarr_file<libaan::uint40_t> sarr_file40;
+    const std::string in = "she sells sea shells by the sea shore";
+    const auto n = static_cast<int64_t>(in.size());
+    std::vector<libaan::uint40_t> suffixes(in.size());
+    libaan::search::basic_sarr_sais<libaan::uint40_t>(in.c_str(), n,
+                                                      suffixes.data());
+    libaan::search::basic_sarr_lcp<libaan::uint40_t> sarr(in.c_str(), n,
+                                                          suffixes.data());
+
+    const auto path = libaan::temp_file_path();
+    ASSERT_FALSE(path.empty());
+    ASSERT_EQ(sarr_file40::NO_ERROR, sarr_file40::write(path, sarr));
+
+    sarr_file40 file;
+    ASSERT_EQ(sarr_file40::NO_ERROR, file.open(path));
+    for(const std::string p: { "s", "sea", "shells", "e", "she", "x" }) {
+        const auto expected = sarr.search(p);
+        const auto r = file.search(p);
+        EXPECT_EQ(expected.size(), r.size()) << p;
+        EXPECT_TRUE(std::equal(expected.begin(), expected.end(), r.begin(),
+                               [](const libaan::uint40_t &a,
+                                  const libaan::uint40_t &b) {
+                                   return static_cast<uint64_t>(a)
+                                       == static_cast<uint64_t>(b); }))
+            << p;
+    }
+
+    // must be opened with the index type it was written with
+    libaan::search::sarr_file file32;
+    EXPECT_EQ(libaan::search::sarr_file::ELEMENT_SIZE, file32.open(path));
+    libaan::search::basic_sarr_file<uint64_t> file64;
+    EXPECT_EQ(libaan::search::basic_sarr_file<uint64_t>::ELEMENT_SIZE,
+              file64.open(path));
+
+    std::remove(path.c_str());
+}
@@ -0,0 +1,92 @@
+#include "libaan/split_stream.hh"
+#include "libaan/file.hh"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+std::vector<std::string> read_all(libaan::split_stream &stream)
+{
+    std::vector<std::string> tokens;
+    libaan::string_type token("");
+    while(stream.next(token))
+        tokens.push_back(token);
+    return tokens;
+}
+
+std::vector<std::string> expected(const std::string &in,
+                                  const std::string &delim)
+{
+    std::vector<std::string> tokens;
+    for(const auto &t: libaan::split(in, libaan::string_type(delim)))
+        tokens.push_back(t);
+    return tokens;
+}
+
+}
+
+TEST(split_stream_hh, fd_and_region) {
+    std::mt19937 gen(12);
+    std::uniform_int_distribution<int> dist(0, 3);
+    std::string in(5000, 0);
+    for(auto &c: in)
+        c = static_cast<char>("ab;\n"[dist(gen)]);
+    // a token longer than the chunks
+    in.replace(100, 300, std::string(300, 'x'));
+
+    const auto path = libaan::temp_file_path();
+    ASSERT_FALSE(path.empty());
+    {
+        std::ofstream fp(path, std::ios_base::binary | std::ios_base::trunc);
+        fp << in;
+    }
+
+    for(const std::string delim: { "\n", ";", ";\n", "a;b" }) {
+        const auto tokens = expected(in, delim);
+        ASSERT_FALSE(tokens.empty());
+        for(const size_t chunk_size: { 1u, 7u, 64u, 4096u, 1u << 20 }) {
+            const int fd = open(path.c_str(), O_RDONLY);
+            ASSERT_NE(-1, fd);
+            libaan::split_stream stream(fd, delim, chunk_size);
+            EXPECT_EQ(tokens, read_all(stream)) << delim << " " << chunk_size;
+            EXPECT_FALSE(stream.error());
+            close(fd);
+        }
+
+        libaan::split_stream region(in.data(), in.size(), delim);
+        EXPECT_EQ(tokens, read_all(region)) << delim;
+    }
+
+    const int fd = open(path.c_str(), O_RDONLY);
+    ASSERT_NE(-1, fd);
+    libaan::split_stream lines(fd, '\n', 16);
+    libaan::string_type token("");
+    ASSERT_TRUE(lines.next(token));
+    EXPECT_EQ(expected(in, "\n").front(), std::string(token));
+    close(fd);
+    std::remove(path.c_str());
+}
+
+TEST(split_stream_hh, edge_cases) {
+    libaan::split_stream empty("", 0, ',');
+    EXPECT_TRUE(read_all(empty).empty());
+
+    libaan::split_stream no_delim("a,b", 3, "");
+    EXPECT_TRUE(read_all(no_delim).empty());
+
+    libaan::split_stream region(",,a,,b,", 7, ',');
+    EXPECT_EQ(std::vector<std::string>({ "a", "b" }), read_all(region));
+
+    libaan::split_stream bad_fd(-1, ',');
+    EXPECT_TRUE(read_all(bad_fd).empty());
+    EXPECT_TRUE(bad_fd.error());
+}
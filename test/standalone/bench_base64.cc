@@ -0,0 +1,159 @@
+// Base64 encoding and decoding, bulk and for many 32 byte keys.
+//
+// Usage: bench_base64
+
+#include "libaan/base64.hh"
+#include "libaan/time.hh"
+
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// the BIO chain base64encode and base64decode used before
+size_t bio_encode(const void *in, size_t in_len, char *out, size_t out_len)
+{
+    BIO *b64 = BIO_new(BIO_f_base64());
+    BIO *mem = BIO_new(BIO_s_mem());
+    BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
+    mem = BIO_push(b64, mem);
+    BIO_write(mem, in, static_cast<int>(in_len));
+    (void)BIO_flush(mem);
+    char *p;
+    const auto length = static_cast<size_t>(BIO_get_mem_data(mem, &p));
+    const size_t written = std::min(length, out_len);
+    std::memcpy(out, p, written);
+    BIO_free_all(mem);
+    return written;
+}
+
+size_t bio_decode(const void *in, size_t in_len, char *out, size_t out_len)
+{
+    BIO *b64 = BIO_new(BIO_f_base64());
+    BIO *mem = BIO_new_mem_buf(in, static_cast<int>(in_len));
+    BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
+    mem = BIO_push(b64, mem);
+    const int length = BIO_read(mem, out, static_cast<int>(out_len));
+    BIO_free_all(mem);
+    return length > 0 ? static_cast<size_t>(length) : 0;
+}
+
+// Runs lambda rounds times, bytes is the binary size of one round.
+template<typename lambda_t>
+void run(const char *name, size_t bytes, unsigned rounds, lambda_t lambda)
+{
+    size_t check = 0;
+    libaan::timer_ms t;
+    for(unsigned r = 0; r < rounds; r++)
+        check += lambda();
+    const auto ms = std::max<decltype(t.duration())>(1, t.duration());
+    std::cout << name << ": " << ms << "ms, "
+              << double(bytes) * rounds / 1e6 / double(ms) << " GB/s ("
+              << check << ")\n";
+}
+
+}
+
+int main()
+{
+    std::mt19937 gen(0);
+    std::vector<unsigned char> bin(48 << 20);
+    for(auto &c: bin)
+        c = static_cast<unsigned char>(gen());
+    std::string text(libaan::base64_encoded_size(bin.size()), '\0');
+    libaan::base64_encode(bin.data(), bin.size(), &text[0]);
+    std::vector<char> text_out(text.size());
+    std::vector<unsigned char> bin_out(libaan::base64_decoded_size(text.size()));
+
+    std::cout << bin.size() / (1 << 20) << " MiB:\n";
+    run("encode (BIO)", bin.size(), 2, [&]() {
+            return bio_encode(bin.data(), bin.size(), text_out.data(),
+                              text_out.size());
+        });
+    run("encode (EVP_EncodeBlock)", bin.size(), 5, [&]() {
+            return size_t(EVP_EncodeBlock(
+                              reinterpret_cast<unsigned char *>(text_out.data()),
+                              bin.data(), static_cast<int>(bin.size())));
+        });
+    run("base64_encode", bin.size(), 20, [&]() {
+            return libaan::base64_encode(bin.data(), bin.size(),
+                                         text_out.data());
+        });
+    run("base64_encoder (64 KiB chunks)", bin.size(), 20, [&]() {
+            const size_t CHUNK = 1 << 16;
+            libaan::base64_encoder encoder;
+            size_t written = 0;
+            for(size_t i = 0; i < bin.size(); i += CHUNK)
+                written += encoder.update(
+                    bin.data() + i, std::min(CHUNK, bin.size() - i),
+                    text_out.data() + written);
+            return written + encoder.final(text_out.data() + written);
+        });
+    run("decode (BIO)", bin.size(), 2, [&]() {
+            return bio_decode(text.data(), text.size(),
+                              reinterpret_cast<char *>(bin_out.data()),
+                              bin_out.size());
+        });
+    run("decode (EVP_DecodeBlock)", bin.size(), 5, [&]() {
+            return size_t(EVP_DecodeBlock(
+                              bin_out.data(),
+                              reinterpret_cast<const unsigned char *>(text.data()),
+                              static_cast<int>(text.size())));
+        });
+    run("base64_decode", bin.size(), 20, [&]() {
+            size_t written;
+            libaan::base64_decode(text.data(), text.size(), bin_out.data(),
+                                  written);
+            return written;
+        });
+
+    // 256 bit keys
+    const size_t KEY = 32;
+    const size_t count = 1 << 20;
+    const size_t KEY_TEXT = libaan::base64_encoded_size(KEY);
+    std::cout << "\n" << count << " keys of " << KEY << " bytes:\n";
+    run("encode (BIO)", count * KEY, 1, [&]() {
+            char out[64];
+            size_t sum = 0;
+            for(size_t i = 0; i < count; i++)
+                sum += bio_encode(bin.data() + i * KEY, KEY, out, sizeof(out));
+            return sum;
+        });
+    run("base64_encode", count * KEY, 1, [&]() {
+            char out[64];
+            size_t sum = 0;
+            for(size_t i = 0; i < count; i++)
+                sum += libaan::base64_encode(bin.data() + i * KEY, KEY, out);
+            return sum;
+        });
+    std::vector<std::string> keys;
+    for(size_t i = 0; i < count; i++)
+        keys.emplace_back(text_out.data(), libaan::base64_encode(
+                              bin.data() + i * KEY, KEY, text_out.data()));
+    run("decode (BIO)", count * KEY, 1, [&]() {
+            char out[64];
+            size_t sum = 0;
+            for(const auto &k: keys)
+                sum += bio_decode(k.data(), KEY_TEXT, out, sizeof(out));
+            return sum;
+        });
+    run("base64_decode", count * KEY, 1, [&]() {
+            unsigned char out[64];
+            size_t sum = 0;
+            for(const auto &k: keys) {
+                size_t written;
+                libaan::base64_decode(k.data(), KEY_TEXT, out, written);
+                sum += written;
+            }
+            return sum;
+        });
+
+    return 0;
+}
@@ -0,0 +1,286 @@
+// Digests and HMACs of many small records, PBKDF2 iterations, key
+// derivation latency, bulk encryption.
+//
+// Usage: bench_crypto
+
+#include "libaan/crypto.hh"
+#include "libaan/time.hh"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// what hash::do_hash did: a new context for every message
+bool sha256_per_call(const unsigned char *p, size_t n, unsigned char *out)
+{
+    EVP_MD_CTX *ctx = EVP_MD_CTX_create();
+    unsigned int length;
+    const bool ok = EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) == 1
+        && EVP_DigestUpdate(ctx, p, n) == 1
+        && EVP_DigestFinal_ex(ctx, out, &length) == 1;
+    EVP_MD_CTX_destroy(ctx);
+    return ok;
+}
+
+// Runs lambda once for count units.
+template<typename lambda_t>
+void run(const char *name, size_t count, const char *unit, lambda_t lambda)
+{
+    libaan::timer_ms t;
+    const auto check = lambda();
+    const auto ms = std::max<decltype(t.duration())>(1, t.duration());
+    std::cout << "  " << name << ": " << ms << "ms, "
+              << double(count) / 1e3 / double(ms) << " M " << unit << "/s ("
+              << check << ")\n";
+}
+
+}
+
+int main()
+{
+    std::mt19937 gen(0);
+    const size_t COUNT = 1 << 20;
+    const std::string key(32, 'k');
+    for(const size_t length: { 16u, 64u, 256u, 1024u }) {
+        std::vector<unsigned char> data(COUNT * length);
+        for(auto &c: data)
+            c = static_cast<unsigned char>(gen());
+        std::vector<const unsigned char *> records(COUNT);
+        const std::vector<size_t> lengths(COUNT, length);
+        for(size_t i = 0; i < COUNT; i++)
+            records[i] = data.data() + i * length;
+        std::vector<unsigned char> out(COUNT * 32);
+
+        std::cout << COUNT << " records of " << length << " bytes:\n";
+        run("hash::sha1", COUNT, "records", [&]() {
+                libaan::hash h;
+                std::string in, md;
+                size_t sum = 0;
+                for(size_t i = 0; i < COUNT; i++) {
+                    in.assign(reinterpret_cast<const char *>(records[i]), length);
+                    h.sha1(in, md);
+                    sum += static_cast<unsigned char>(md[0]);
+                }
+                return sum;
+            });
+        run("SHA-256, context per call", COUNT, "records", [&]() {
+                size_t sum = 0;
+                for(size_t i = 0; i < COUNT; i++) {
+                    sha256_per_call(records[i], length, &out[i * 32]);
+                    sum += out[i * 32];
+                }
+                return sum;
+            });
+        run("SHA-256, digest", COUNT, "records", [&]() {
+                libaan::digest d(libaan::digest::SHA256);
+                size_t sum = 0;
+                for(size_t i = 0; i < COUNT; i++) {
+                    d.update(records[i], length);
+                    d.finish(&out[i * 32]);
+                    sum += out[i * 32];
+                }
+                return sum;
+            });
+        run("SHA-256, hash_batch", COUNT, "records", [&]() {
+                libaan::hash_batch batch(libaan::digest::SHA256);
+                batch.run(records.data(), lengths.data(), COUNT, out.data());
+                size_t sum = 0;
+                for(size_t i = 0; i < COUNT; i++)
+                    sum += out[i * 32];
+                return sum;
+            });
+        run("HMAC-SHA1, hash::sha1_hmac", COUNT, "records", [&]() {
+                libaan::hash h;
+                std::string in, mac;
+                size_t sum = 0;
+                for(size_t i = 0; i < COUNT; i++) {
+                    in.assign(reinterpret_cast<const char *>(records[i]), length);
+                    h.sha1_hmac(in, key, mac);
+                    sum += static_cast<unsigned char>(mac[0]);
+                }
+                return sum;
+            });
+        run("HMAC-SHA256, key per message", COUNT, "records", [&]() {
+                size_t sum = 0;
+                for(size_t i = 0; i < COUNT; i++) {
+                    unsigned int mac_length;
+                    HMAC(EVP_sha256(), key.data(), int(key.size()), records[i],
+                         length, &out[i * 32], &mac_length);
+                    sum += out[i * 32];
+                }
+                return sum;
+            });
+        run("HMAC-SHA256, keyed_hmac", COUNT, "records", [&]() {
+                libaan::keyed_hmac h(key, EVP_sha256());
+                size_t sum = 0;
+                for(size_t i = 0; i < COUNT; i++) {
+                    h.update(records[i], length);
+                    h.finish(&out[i * 32]);
+                    sum += out[i * 32];
+                }
+                return sum;
+            });
+    }
+
+    // one 32 byte key, as camellia_256 derives it
+    const std::string password("correct horse battery staple"),
+        salt("0123456789abcdef");
+    const unsigned int ITERATIONS = 1 << 18;
+    std::cout << "PBKDF2, " << ITERATIONS << " iterations, 32 byte key:\n";
+    run("HMAC-SHA1, pkcs5_F", 2 * ITERATIONS, "iterations", [&]() {
+            // the former pbkdf2(): two blocks, pkcs5_F runs ic + 1 iterations
+            unsigned char key[2 * libaan::PRF_OUTPUT_LENGTH];
+            for(size_t block = 1; block <= 2; block++)
+                libaan::pkcs5_F(
+                    reinterpret_cast<const unsigned char *>(password.data()),
+                    password.size(),
+                    reinterpret_cast<const unsigned char *>(salt.data()),
+                    salt.size(), ITERATIONS - 1, block,
+                    key + (block - 1) * libaan::PRF_OUTPUT_LENGTH);
+            return size_t(key[0]);
+        });
+    run("HMAC-SHA1, PKCS5_PBKDF2_HMAC", 2 * ITERATIONS, "iterations", [&]() {
+            unsigned char key[32];
+            PKCS5_PBKDF2_HMAC(
+                password.data(), int(password.size()),
+                reinterpret_cast<const unsigned char *>(salt.data()),
+                int(salt.size()), ITERATIONS, EVP_sha1(), sizeof(key), key);
+            return size_t(key[0]);
+        });
+    const std::pair<const char *, libaan::digest::algorithm_type> prfs[] = {
+        { "HMAC-SHA1, pbkdf2", libaan::digest::SHA1 },
+        { "HMAC-SHA256, pbkdf2", libaan::digest::SHA256 },
+        { "HMAC-SHA512, pbkdf2", libaan::digest::SHA512 }
+    };
+    for(const auto &prf: prfs) {
+        // blocks needed for the key
+        const size_t blocks = prf.second == libaan::digest::SHA1 ? 2 : 1;
+        run(prf.first, blocks * ITERATIONS, "iterations", [&]() {
+                std::string key(32, '\0');
+                libaan::pbkdf2(password, salt, ITERATIONS, key, prf.second);
+                return size_t(static_cast<unsigned char>(key[0]));
+            });
+    }
+
+    // unlock latency of a long key, one thread per block
+    const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "PBKDF2, " << ITERATIONS << " iterations, 128 byte key, "
+              << threads << " threads:\n";
+    for(const unsigned t: { 1u, threads }) {
+        const std::string name = "HMAC-SHA256, pbkdf2, " + std::to_string(t)
+            + " thread(s)";
+        run(name.c_str(), 4 * ITERATIONS, "iterations", [&]() {
+                std::string key(128, '\0');
+                libaan::pbkdf2(password, salt, ITERATIONS, key,
+                               libaan::digest::SHA256, t);
+                return size_t(static_cast<unsigned char>(key[0]));
+            });
+    }
+
+    // unlock latency of a camellia_256 key
+    std::cout << "derive_key, 32 byte key:\n";
+    const std::pair<const char *, libaan::kdf_params> kdfs[] = {
+        { "PBKDF2-HMAC-SHA1, 1001 (default)", libaan::kdf_params() },
+        { "PBKDF2-HMAC-SHA256, 600000",
+          libaan::kdf_params::pbkdf2(600000) },
+        { "scrypt, 16 MiB, p = 1", libaan::kdf_params::scrypt(1 << 14) },
+        { "scrypt, 64 MiB, p = 1", libaan::kdf_params::scrypt(1 << 16) },
+        { "Argon2id, 64 MiB, t = 3, 4 lanes",
+          libaan::kdf_params::argon2id(3, 1 << 16, 4) },
+        { "Argon2id, 256 MiB, t = 2, 4 lanes",
+          libaan::kdf_params::argon2id(2, 1 << 18, 4) }
+    };
+    for(const auto &kdf: kdfs) {
+        for(const unsigned t: { 1u, threads }) {
+            auto params = kdf.second;
+            params.threads = t;
+            const std::string name = std::string(kdf.first) + ", "
+                + std::to_string(t) + " thread(s)";
+            libaan::timer_ms timer;
+            std::string key(32, '\0');
+            libaan::derive_key(params, password, salt, key);
+            std::cout << "  " << name << ": " << timer.duration() << "ms\n";
+            if(threads == 1)
+                break;
+        }
+    }
+
+    // read() and write() of a crypto_file derive the same key twice
+    std::cout << "derive_key twice, Argon2id, 64 MiB, t = 3:\n";
+    const auto argon2 = libaan::kdf_params::argon2id(3, 1 << 16, 4);
+    libaan::key_cache cache;
+    for(libaan::key_cache *c: { static_cast<libaan::key_cache *>(nullptr),
+                                &cache }) {
+        libaan::timer_ms timer;
+        std::string key(32, '\0');
+        libaan::derive_key(argon2, password, salt, key, c);
+        libaan::derive_key(argon2, password, salt, key, c);
+        std::cout << "  " << (c ? "with key_cache" : "without cache")
+                  << (c && !cache.locked() ? " (not locked)" : "") << ": "
+                  << timer.duration() << "ms\n";
+    }
+
+    // what crypto_file does per write() and read(): camellia_256 CBC and a
+    // second pass for the HMAC, against one pass of an AEAD
+    const size_t BULK = size_t(64) << 20;
+    std::string plain;
+    libaan::read_random_bytes_noblock(BULK, plain);
+    std::cout << "encrypt and authenticate " << (BULK >> 20) << " MiB:\n";
+    const auto bulk = [BULK](const std::string &name, bool ok, double ms) {
+        ms = std::max(1.0, ms);
+        std::cout << "  " << name << ": " << ms << "ms, "
+                  << double(BULK) / 1e6 / double(ms) << " GB/s"
+                  << (ok ? "" : " (failed)") << "\n";
+    };
+    {
+        libaan::camellia_256 camellia;
+        camellia.init();
+        std::string sealed, mac, opened, check;
+        libaan::timer_ms encrypt_timer;
+        bool ok = camellia.encrypt(password, plain, sealed);
+        {
+            libaan::hmac h(password, mac);
+            h.update(sealed);
+        }
+        bulk("camellia_256 CBC + HMAC-SHA1, encrypt", ok && !mac.empty(),
+             encrypt_timer.duration());
+        libaan::timer_ms decrypt_timer;
+        {
+            libaan::hmac h(password, check);
+            h.update(sealed);
+        }
+        ok = check == mac && camellia.decrypt(password, sealed, opened);
+        bulk("camellia_256 CBC + HMAC-SHA1, decrypt", ok,
+             decrypt_timer.duration());
+    }
+    const std::pair<const char *, libaan::aead_cipher::algorithm_type>
+        aeads[] = {
+        { "AES-256-GCM", libaan::aead_cipher::AES_256_GCM },
+        { "ChaCha20-Poly1305", libaan::aead_cipher::CHACHA20_POLY1305 }
+    };
+    for(const auto &aead: aeads) {
+        libaan::aead_cipher c(aead.second);
+        if(!c.state) {
+            std::cout << "  " << aead.first << ": not supported\n";
+            continue;
+        }
+        std::string nonce, sealed, opened;
+        libaan::read_random_bytes_noblock(libaan::aead_cipher::NONCE_SIZE,
+                                          nonce);
+        libaan::timer_ms encrypt_timer;
+        bool ok = c.encrypt(key, nonce, salt, plain, sealed);
+        bulk(std::string(aead.first) + ", encrypt", ok,
+             encrypt_timer.duration());
+        libaan::timer_ms decrypt_timer;
+        ok = c.decrypt(key, nonce, salt, sealed, opened) && opened == plain;
+        bulk(std::string(aead.first) + ", decrypt", ok,
+             decrypt_timer.duration());
+    }
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+// Substring search throughput on the WORDSFILE corpus.
+//
+// Usage: bench_find [corpus]
+
+#include "libaan/file.hh"
+#include "libaan/string.hh"
+#include "libaan/time.hh"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Runs lambda(pattern) for all patterns, each scans the whole corpus.
+template<typename lambda_t>
+void run(const char *name, const std::string &input,
+         const std::vector<std::string> &patterns, lambda_t lambda)
+{
+    const unsigned ROUNDS = 20;
+    size_t matches = 0;
+    libaan::timer_ms t;
+    for(unsigned i = 0; i < ROUNDS; i++)
+        for(const auto &p: patterns)
+            matches += lambda(p);
+    const auto ms = std::max<decltype(t.duration())>(1, t.duration());
+    const double bytes = double(input.size()) * ROUNDS * patterns.size();
+    std::cout << name << ": " << ms << "ms, " << bytes / 1e6 / double(ms)
+              << " GB/s (" << matches / ROUNDS << " matches)\n";
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const char *corpus = argc > 1 ? argv[1] : WORDSFILE;
+    std::string input;
+    libaan::read_file(corpus, input);
+    if(input.empty()) {
+        std::cerr << "Failed to read \"" << corpus << "\".\n";
+        return 1;
+    }
+    std::cout << corpus << ": " << input.size() << " bytes\n";
+
+    // rare and frequent, short and long
+    const std::vector<std::string> patterns = {
+        "ing\n", "qu", "zzz", "tion", "\nun", "ness\nun", "xylophone",
+        "abcdefghijklmnop" };
+
+    run("std::string::find", input, patterns, [&](const std::string &p) {
+            size_t matches = 0;
+            for(size_t pos = input.find(p); pos != std::string::npos;
+                pos = input.find(p, pos + 1))
+                matches++;
+            return matches;
+        });
+    run("memmem", input, patterns, [&](const std::string &p) {
+            size_t matches = 0;
+            const char *end = input.data() + input.size();
+            for(auto pos = input.data();; pos++) {
+                pos = static_cast<const char *>(
+                    memmem(pos, size_t(end - pos), p.data(), p.size()));
+                if(!pos)
+                    break;
+                matches++;
+            }
+            return matches;
+        });
+    run("search::find", input, patterns, [&](const std::string &p) {
+            size_t matches = 0;
+            for(size_t pos = 0;; pos++) {
+                pos = libaan::search::find(input.data(), input.size(),
+                                           p.data(), p.size(), pos);
+                if(pos == std::string::npos)
+                    break;
+                matches++;
+            }
+            return matches;
+        });
+    run("search::stl_search_all", input, patterns, [&](const std::string &p) {
+            return libaan::search::stl_search_all(p, input).size();
+        });
+    run("split", input, { "\n", "ing\n" }, [&](const std::string &p) {
+            return libaan::split(libaan::string_type(input),
+                                 libaan::string_type(p)).size();
+        });
+
+    run("split_view", input, { "\n", "ing\n" }, [&](const std::string &p) {
+            size_t tokens = 0;
+            for(const auto &token: libaan::split_view(input, p)) {
+                (void)token;
+                tokens++;
+            }
+            return tokens;
+        });
+    run("split (char)", input, { "\n" }, [&](const std::string &) {
+            return libaan::split(input, '\n').size();
+        });
+    run("split_view (char)", input, { "\n" }, [&](const std::string &) {
+            size_t tokens = 0;
+            for(const auto &token: libaan::split_view(input, '\n')) {
+                (void)token;
+                tokens++;
+            }
+            return tokens;
+        });
+
+    // scan of the whole input for a missing character as reference
+    run("memchr", input, { "\x01" }, [&](const std::string &p) {
+            return size_t(memchr(input.data(), p[0], input.size()) != nullptr);
+        });
+    libaan::tokenizer tokens("");
+    const std::vector<std::pair<const char *, const char *> > sets = {
+        { "\n", "\\n" }, { ",\t\n", ",\\t\\n" }, { "aeiou\n", "aeiou\\n" } };
+    for(const auto &delims: sets) {
+        tokens = libaan::tokenizer(delims.first);
+        const auto name = std::string("tokenizer \"") + delims.second + "\"";
+        run(name.c_str(), input, { "" }, [&](const std::string &) {
+                tokens.tokenize(input);
+                return tokens.size();
+            });
+    }
+
+    // dictionary of every 10th word
+    std::vector<std::string> keywords;
+    const auto lines = libaan::split(input, '\n');
+    for(size_t i = 0; i < lines.size(); i += 10)
+        keywords.push_back(lines[i]);
+    std::cout << "\n" << keywords.size() << " keywords:\n";
+    libaan::timer_ms t;
+    const libaan::search::aho_corasick ac(keywords);
+    std::cout << "aho_corasick construction: " << t.duration() << "ms, "
+              << ac.size_in_bytes() / 1024 << " KiB\n";
+    run("aho_corasick::scan", input, { "" }, [&](const std::string &) {
+            size_t matches = 0;
+            ac.scan(input, [&](size_t, size_t) { matches++; });
+            return matches;
+        });
+    // one pass per keyword, only the first 100
+    const std::vector<std::string> first(keywords.begin(),
+                                         keywords.begin() + 100);
+    run("search::stl_search_all (100 keywords)", input, first,
+        [&](const std::string &p) {
+            return libaan::search::stl_search_all(p, input).size();
+        });
+
+    return 0;
+}
@@ -0,0 +1,206 @@
+// Hash table keys and string hashing on the WORDSFILE corpus.
+//
+// Usage: bench_hash [corpus]
+
+#include "libaan/file.hh"
+#include "libaan/string.hh"
+#include "libaan/string_pool.hh"
+#include "libaan/time.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+// reference: 64 bit FNV-1a
+uint64_t fnv1a(const char *s, size_t n)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for(size_t i = 0; i < n; i++)
+        h = (h ^ static_cast<unsigned char>(s[i])) * 0x100000001b3ull;
+    return h;
+}
+
+template<typename lambda_t>
+void run(const char *name, lambda_t lambda)
+{
+    libaan::timer_ms t;
+    const auto result = lambda();
+    std::cout << name << ": " << t.duration() << "ms (" << result << ")\n";
+}
+
+// insertions and lookups of all words with key_t as key
+template<typename key_t>
+void run_map(const char *name, const std::vector<libaan::string_type> &words)
+{
+    const unsigned ROUNDS = 10;
+    const std::vector<key_t> keys(words.begin(), words.end());
+    std::unordered_map<key_t, size_t> map;
+    run((std::string(name) + " insert").c_str(), [&]() {
+            for(size_t i = 0; i < keys.size(); i++)
+                map.emplace(keys[i], i);
+            return map.size();
+        });
+    run((std::string(name) + " find").c_str(), [&]() {
+            size_t sum = 0;
+            for(unsigned r = 0; r < ROUNDS; r++)
+                for(const auto &k: keys)
+                    sum += map.find(k)->second;
+            return sum;
+        });
+    // key constructed from a string_type for every lookup
+    run((std::string(name) + " find (string_type)").c_str(), [&]() {
+            size_t sum = 0;
+            for(unsigned r = 0; r < ROUNDS; r++)
+                for(const auto &w: words)
+                    sum += map.find(key_t(w))->second;
+            return sum;
+        });
+}
+
+}
+
+// Hashes 256 MiB in pieces of length bytes.
+template<typename lambda_t>
+void run_throughput(const char *name, const std::string &buffer,
+                    size_t length, lambda_t lambda)
+{
+    const size_t TOTAL = 256u << 20;
+    const size_t pieces = buffer.size() / length;
+    uint64_t sum = 0;
+    libaan::timer_ms t;
+    for(size_t done = 0; done < TOTAL; done += pieces * length)
+        for(size_t i = 0; i < pieces; i++)
+            sum += lambda(buffer.data() + i * length, length);
+    const auto ms = std::max<decltype(t.duration())>(1, t.duration());
+    std::cout << "  " << name << ": " << double(TOTAL) / 1e6 / double(ms)
+              << " GB/s (" << (sum & 0xff) << ")\n";
+}
+
+// Collisions of the full hashes and of their lower 32 bits, and the chi
+// square statistic of the lower 16 bits as bucket index (about 65535 for a
+// uniform hash).
+template<typename lambda_t>
+void run_quality(const char *name, const std::vector<std::string> &keys,
+                 lambda_t lambda)
+{
+    std::vector<uint64_t> hashes;
+    for(const auto &k: keys)
+        hashes.push_back(lambda(k));
+    std::vector<uint64_t> low(hashes.size());
+    std::transform(hashes.begin(), hashes.end(), low.begin(),
+                   [](uint64_t h) { return h & 0xffffffff; });
+    const auto collisions = [](std::vector<uint64_t> &v) {
+        std::sort(v.begin(), v.end());
+        return v.size() - size_t(std::unique(v.begin(), v.end()) - v.begin());
+    };
+    std::vector<size_t> buckets(1 << 16);
+    for(const auto h: hashes)
+        buckets[h & 0xffff]++;
+    const double expected = double(keys.size()) / double(buckets.size());
+    double chi2 = 0;
+    for(const auto b: buckets)
+        chi2 += (double(b) - expected) * (double(b) - expected) / expected;
+    std::cout << "  " << name << ": " << collisions(hashes)
+              << " 64 bit collisions, " << collisions(low)
+              << " 32 bit collisions, chi2 " << std::lround(chi2) << "\n";
+}
+
+int main(int argc, char *argv[])
+{
+    const char *corpus = argc > 1 ? argv[1] : WORDSFILE;
+    std::string input;
+    libaan::read_file(corpus, input);
+    if(input.empty()) {
+        std::cerr << "Failed to read \"" << corpus << "\".\n";
+        return 1;
+    }
+    const auto words = libaan::split(input, '\n');
+    std::cout << corpus << ": " << words.size() << " words\n";
+
+    run_map<std::string>("std::string", words);
+    run_map<libaan::owned_string>("owned_string", words);
+
+    std::cout << "\ndeduplication:\n";
+    run("std::unordered_set<std::string>", [&]() {
+            std::unordered_set<std::string> set;
+            for(const auto &w: words)
+                set.insert(w);
+            return set.size();
+        });
+    run("string_pool", [&]() {
+            libaan::string_pool pool;
+            for(const auto &w: words)
+                pool.intern(w);
+            return pool.size();
+        });
+
+    std::cout << "\nthroughput:\n";
+    std::string buffer(1 << 20, 0);
+    for(size_t i = 0; i < buffer.size(); i++)
+        buffer[i] = input[i % input.size()];
+    for(const size_t length: { 8u, 16u, 32u, 64u, 256u, 4096u, 1u << 20 }) {
+        std::cout << length << " bytes:\n";
+        run_throughput("hash_bytes", buffer, length, [](const char *p, size_t n) {
+                return libaan::hash_bytes(p, n);
+            });
+        run_throughput("fnv1a", buffer, length, fnv1a);
+        std::vector<std::string> strings;
+        for(size_t i = 0; i + length <= buffer.size(); i += length)
+            strings.emplace_back(buffer.data() + i, length);
+        size_t next = 0;
+        run_throughput("std::hash<std::string>", buffer, length,
+                       [&](const char *, size_t) {
+                           const auto h = std::hash<std::string>()(strings[next]);
+                           next = next + 1 == strings.size() ? 0 : next + 1;
+                           return h;
+                       });
+    }
+
+    std::cout << "\nbulk:\n";
+    std::vector<uint64_t> hashes(words.size());
+    run("hash_bytes loop", [&]() {
+            uint64_t sum = 0;
+            for(unsigned r = 0; r < 10; r++)
+                for(size_t i = 0; i < words.size(); i++)
+                    sum += hashes[i] = libaan::hash_bytes(words[i].data(),
+                                                          words[i].length());
+            return sum;
+        });
+    run("hash_all", [&]() {
+            uint64_t sum = 0;
+            for(unsigned r = 0; r < 10; r++) {
+                libaan::hash_all(words.data(), words.size(), hashes.data());
+                sum += hashes.back();
+            }
+            return sum;
+        });
+
+    std::cout << "\nquality:\n";
+    std::vector<std::string> keys(words.begin(), words.end());
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::vector<std::string> numbers;
+    for(size_t i = 0; i < keys.size(); i++)
+        numbers.push_back(std::to_string(i));
+    for(const auto *set: { &keys, &numbers }) {
+        std::cout << set->size() << (set == &keys ? " words" : " numbers")
+                  << ":\n";
+        run_quality("hash_bytes", *set, [](const std::string &k) {
+                return libaan::hash_bytes(k.data(), k.size());
+            });
+        run_quality("fnv1a", *set, [](const std::string &k) {
+                return fnv1a(k.data(), k.size());
+            });
+        run_quality("std::hash<std::string>", *set, [](const std::string &k) {
+                return uint64_t(std::hash<std::string>()(k));
+            });
+    }
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+// Hex encoding and decoding, bulk and for many 20 byte digests.
+//
+// Usage: bench_hex
+
+#include "libaan/debug.hh"
+#include "libaan/time.hh"
+
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// the snprintf and ascii2bin based versions these replaced
+std::string bin2hex_snprintf(const std::vector<unsigned char> &v)
+{
+    std::string s(v.size() * 2 + 1, '\0');
+    for(size_t i = 0; i < v.size(); i++)
+        snprintf(&s[i * 2], 3, "%02x", static_cast<int>(v[i]));
+    s.resize(v.size() * 2);
+    return s;
+}
+
+int ascii2bin(char input)
+{
+    if(input >= '0' && input <= '9')
+        return input - '0';
+    else if(input >= 'A' && input <= 'F')
+        return input - 'A' + 10;
+    else if(input >= 'a' && input <= 'f')
+        return input - 'a' + 10;
+    return -1;
+}
+
+std::vector<unsigned char> hex2bin_push_back(const char *src)
+{
+    std::vector<unsigned char> target;
+    while(*src && src[1]) {
+        const auto a = ascii2bin(*src) * 16;
+        const auto b = ascii2bin(src[1]);
+        if(a < 0 || b < 0)
+            return std::vector<unsigned char>();
+        target.push_back(static_cast<unsigned char>(a + b));
+        src += 2;
+    }
+    return target;
+}
+
+// Runs lambda rounds times, bytes is the binary size of one round.
+template<typename lambda_t>
+void run(const char *name, size_t bytes, unsigned rounds, lambda_t lambda)
+{
+    size_t check = 0;
+    libaan::timer_ms t;
+    for(unsigned r = 0; r < rounds; r++)
+        check += lambda();
+    const auto ms = std::max<decltype(t.duration())>(1, t.duration());
+    std::cout << name << ": " << ms << "ms, "
+              << double(bytes) * rounds / 1e6 / double(ms) << " GB/s ("
+              << check << ")\n";
+}
+
+}
+
+int main()
+{
+    std::mt19937 gen(0);
+    std::vector<unsigned char> bin(64 << 20);
+    for(auto &c: bin)
+        c = static_cast<unsigned char>(gen());
+    const std::string hex = libaan::bin2hex(bin);
+    std::string hex_out(hex.size(), '\0');
+    std::vector<unsigned char> bin_out(bin.size());
+
+    std::cout << bin.size() / (1 << 20) << " MiB:\n";
+    run("bin2hex (snprintf)", bin.size(), 1, [&]() {
+            return bin2hex_snprintf(bin).size();
+        });
+    run("bin2hex (std::string)", bin.size(), 10, [&]() {
+            return libaan::bin2hex(bin).size();
+        });
+    run("bin2hex (buffer)", bin.size(), 10, [&]() {
+            libaan::bin2hex(bin.data(), bin.size(), &hex_out[0]);
+            return size_t(hex_out[0]);
+        });
+    run("hex2bin (push_back)", bin.size(), 1, [&]() {
+            return hex2bin_push_back(hex.c_str()).size();
+        });
+    run("hex2bin (std::vector)", bin.size(), 10, [&]() {
+            return libaan::hex2bin(hex.c_str()).second.size();
+        });
+    run("hex2bin (buffer)", bin.size(), 10, [&]() {
+            return size_t(libaan::hex2bin(hex.data(), hex.size(),
+                                          bin_out.data()));
+        });
+
+    // SHA-1 sized digests
+    const size_t DIGEST = 20;
+    const size_t count = 1 << 20;
+    std::vector<std::vector<unsigned char> > digests(count);
+    for(size_t i = 0; i < count; i++)
+        digests[i].assign(bin.begin() + long(i * DIGEST),
+                          bin.begin() + long((i + 1) * DIGEST));
+    std::cout << "\n" << count << " digests of " << DIGEST << " bytes:\n";
+    run("bin2hex (snprintf)", count * DIGEST, 1, [&]() {
+            size_t sum = 0;
+            for(const auto &d: digests)
+                sum += bin2hex_snprintf(d).size();
+            return sum;
+        });
+    run("bin2hex (std::string)", count * DIGEST, 1, [&]() {
+            size_t sum = 0;
+            for(const auto &d: digests)
+                sum += libaan::bin2hex(d).size();
+            return sum;
+        });
+    run("bin2hex (buffer)", count * DIGEST, 1, [&]() {
+            char out[2 * DIGEST];
+            size_t sum = 0;
+            for(const auto &d: digests) {
+                libaan::bin2hex(d.data(), DIGEST, out);
+                sum += size_t(out[0]);
+            }
+            return sum;
+        });
+    run("hex2bin (push_back)", count * DIGEST, 1, [&]() {
+            size_t sum = 0;
+            for(size_t i = 0; i < count; i++)
+                sum += hex2bin_push_back(
+                    hex.substr(i * 2 * DIGEST, 2 * DIGEST).c_str()).size();
+            return sum;
+        });
+    run("hex2bin (buffer)", count * DIGEST, 1, [&]() {
+            unsigned char out[DIGEST];
+            size_t sum = 0;
+            for(size_t i = 0; i < count; i++)
+                sum += libaan::hex2bin(hex.data() + i * 2 * DIGEST,
+                                       2 * DIGEST, out);
+            return sum;
+        });
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+// Suffix array construction benchmark on the WORDSFILE corpus.
+//
+// Usage: bench_sarr [corpus]
+
+#include "libaan/file.hh"
+#include "libaan/fm_index.hh"
+#include "libaan/string.hh"
+#include "libaan/time.hh"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+template<typename lambda_t>
+void run(const char *name, lambda_t lambda)
+{
+    libaan::timer_ms t;
+    const auto matches = lambda();
+    std::cout << name << ": " << t.duration() << "ms (" << matches
+              << " matches)\n";
+}
+
+// SA-IS and searches with suffix array elements of type index_t
+template<typename index_t>
+void run_index_type(const char *name, const std::string &input,
+                    const std::vector<std::string> &patterns)
+{
+    std::vector<index_t> buffer(input.size());
+    run((std::string("sarr_sais<") + name + ">").c_str(), [&]() {
+            libaan::search::basic_sarr_sais<index_t> sarr(
+                input.data(), input.size(), &buffer[0]);
+            return sarr.search(patterns.front()).size();
+        });
+    const libaan::search::basic_sarr_lcp<index_t> lcp(
+        input.data(), input.size(), &buffer[0]);
+    run((std::string("sarr_lcp<") + name + ">::search").c_str(), [&]() {
+            size_t matches = 0;
+            for(const auto &p: patterns)
+                matches += lcp.search(p).size();
+            return matches;
+        });
+    std::cout << "  " << sizeof(index_t) * input.size() * 4 / 1024
+              << " KiB suffix and lcp arrays\n";
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const char *corpus = argc > 1 ? argv[1] : WORDSFILE;
+    std::string input;
+    libaan::read_file(corpus, input);
+    if(input.empty()) {
+        std::cerr << "Failed to read \"" << corpus << "\".\n";
+        return 1;
+    }
+    std::cout << corpus << ": " << input.size() << " bytes\n";
+
+    const std::string pattern = "ing";
+
+    run("sarr_cx11", [&]() {
+            libaan::search::sarr_cx11 sarr(input);
+            return sarr.search(pattern).size();
+        });
+    run("sarr_c", [&]() {
+            libaan::search::sarr_c sarr(input);
+            return sarr.search(pattern.c_str()).size();
+        });
+    run("sarr_dc3", [&]() {
+            libaan::search::sarr_dc3 sarr(input);
+            return sarr.search(pattern).size();
+        });
+    const unsigned max_threads = std::max(2u, std::thread::hardware_concurrency());
+    for(unsigned threads = 2; threads <= max_threads; threads *= 2) {
+        const auto name = "sarr_dc3 (" + std::to_string(threads) + " threads)";
+        run(name.c_str(), [&]() {
+                libaan::search::sarr_dc3 sarr(input, threads);
+                return sarr.search(pattern).size();
+            });
+    }
+    run("sarr_sais", [&]() {
+            std::vector<int> buffer(input.size());
+            libaan::search::sarr_sais sarr(input.data(), input.size(),
+                                           &buffer[0]);
+            return sarr.search(pattern).size();
+        });
+
+    // every 16th line of the corpus as pattern
+    std::vector<std::string> patterns;
+    const auto lines = libaan::split(input, '\n');
+    for(size_t i = 0; i < lines.size(); i += 16)
+        patterns.push_back(lines[i]);
+    std::cout << "\n" << patterns.size() << " searches:\n";
+
+    libaan::search::sarr_dc3 dc3(input);
+    run("sarr_dc3::search", [&]() {
+            size_t matches = 0;
+            for(const auto &p: patterns)
+                matches += dc3.search(p).size();
+            return matches;
+        });
+    libaan::search::sarr_lcp lcp(input.data(), input.size(),
+                                 dc3.get_suffix_array());
+    run("sarr_lcp::search", [&]() {
+            size_t matches = 0;
+            for(const auto &p: patterns)
+                matches += lcp.search(p).size();
+            return matches;
+        });
+    std::vector<libaan::search::sarr_range> results(patterns.size());
+    run("sarr_lcp::search_many", [&]() {
+            lcp.search_many(patterns, &results[0]);
+            size_t matches = 0;
+            for(const auto &r: results)
+                matches += r.size();
+            return matches;
+        });
+    run("sarr_lcp::search_many (threads)", [&]() {
+            lcp.search_many(patterns, &results[0], max_threads);
+            size_t matches = 0;
+            for(const auto &r: results)
+                matches += r.size();
+            return matches;
+        });
+
+    std::cout << "\nfm_index:\n";
+    libaan::timer_ms t;
+    const libaan::search::fm_index fm(input.data(), input.size(),
+                                      dc3.get_suffix_array());
+    std::cout << "construction: " << t.duration() << "ms, "
+              << fm.size_in_bytes() / 1024 << " KiB (suffix array: "
+              << input.size() * sizeof(int) / 1024 << " KiB)\n";
+    run("fm_index::count", [&]() {
+            size_t matches = 0;
+            for(const auto &p: patterns)
+                matches += fm.count(p);
+            return matches;
+        });
+    run("fm_index::locate", [&]() {
+            size_t matches = 0;
+            for(const auto &p: patterns)
+                matches += fm.locate(p).size();
+            return matches;
+        });
+
+    std::cout << "\nindex types:\n";
+    run_index_type<int>("int", input, patterns);
+    run_index_type<uint32_t>("uint32_t", input, patterns);
+    run_index_type<libaan::uint40_t>("uint40_t", input, patterns);
+    run_index_type<uint64_t>("uint64_t", input, patterns);
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "libaan/string_pool.hh"
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(string_pool_hh, intern) {
+    libaan::string_pool pool(128);
+    EXPECT_EQ(0, pool.size());
+    EXPECT_EQ(libaan::string_pool::NONE, pool.find("a"));
+
+    const std::string long_string(1000, 'l');
+    const std::vector<std::string> in = { "a", "b", "", "a", long_string,
+                                          std::string("a\0b", 3), "b", "ab" };
+    std::vector<libaan::string_pool::id_type> ids;
+    for(const auto &s: in)
+        ids.push_back(pool.intern(s));
+    EXPECT_EQ(std::vector<libaan::string_pool::id_type>({ 0, 1, 2, 0, 3, 4, 1, 5 }),
+              ids);
+    EXPECT_EQ(6, pool.size());
+    for(size_t i = 0; i < in.size(); i++) {
+        EXPECT_EQ(in[i], std::string(pool.get(ids[i])));
+        EXPECT_EQ(0, pool.get(ids[i]).data()[in[i].size()]);
+        EXPECT_EQ(ids[i], pool.find(in[i]));
+    }
+    EXPECT_EQ(libaan::string_pool::NONE, pool.find("c"));
+
+    // views stay valid while the pool grows
+    const auto view = pool.get(0);
+    for(size_t i = 0; i < 10000; i++)
+        pool.intern(std::to_string(i));
+    EXPECT_EQ(view.data(), pool.get(0).data());
+    EXPECT_EQ(10006, pool.size());
+    EXPECT_EQ(7, pool.find("1"));
+    EXPECT_GT(pool.size_in_bytes(), 10000);
+
+    pool.clear();
+    EXPECT_EQ(0, pool.size());
+    EXPECT_EQ(libaan::string_pool::NONE, pool.find("a"));
+    EXPECT_EQ(0, pool.intern("b"));
+}
+
+TEST(string_pool_hh, concurrent) {
+    libaan::string_pool pool;
+    const unsigned THREADS = 4;
+    const unsigned N = 20000;
+    std::vector<std::vector<libaan::string_pool::id_type> > ids(THREADS);
+    std::vector<std::thread> threads;
+    // overlapping ranges of numbers
+    for(unsigned t = 0; t < THREADS; t++)
+        threads.emplace_back([&, t]() {
+                for(unsigned i = 0; i < N; i++)
+                    ids[t].push_back(pool.intern(std::to_string(i + t * N / 2)));
+            });
+    for(auto &t: threads)
+        t.join();
+
+    EXPECT_EQ(N / 2 * (THREADS + 1), pool.size());
+    std::set<libaan::string_pool::id_type> distinct;
+    for(unsigned t = 0; t < THREADS; t++)
+        for(unsigned i = 0; i < N; i++) {
+            EXPECT_EQ(std::to_string(i + t * N / 2),
+                      std::string(pool.get(ids[t][i])));
+            distinct.insert(ids[t][i]);
+        }
+    EXPECT_EQ(pool.size(), distinct.size());
+}
@@ -3,6 +3,9 @@
 #include "libaan/file.hh"
 
 #include <algorithm>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
 #include <gtest/gtest.h>
 
 std::string words;
@@ -78,6 +81,32 @@ TEST(string_hh, stringtype_equality) {
         EXPECT_TRUE(std::get<0>(t).c_str() == libaan::string_type(std::get<0>(t).c_str()));
         EXPECT_TRUE(libaan::string_type(std::get<0>(t)) == std::get<0>(t).c_str());
     }
+
+    // prefixes and embedded 0 bytes are not equal
+    const libaan::string_type ab("ab");
+    const libaan::string_type with_nul("a\0b", 3);
+    EXPECT_FALSE("abc" == ab);
+    EXPECT_FALSE("a" == ab);
+    EXPECT_TRUE("ab" == ab);
+    EXPECT_FALSE("a" == with_nul);
+    EXPECT_FALSE(std::string("a") == with_nul);
+    EXPECT_FALSE(libaan::string_type("a") == with_nul);
+    EXPECT_TRUE(std::string("a\0b", 3) == with_nul);
+
+    EXPECT_EQ(0, ab.compare(0, 2, "ab"));
+    EXPECT_EQ(0, ab.compare(1, 1, "b"));
+    EXPECT_GT(0, ab.compare(0, 2, "abc"));
+    EXPECT_LT(0, ab.compare(0, 2, "a"));
+    EXPECT_LT(0, with_nul.compare(0, 3, libaan::string_type("a\0a", 3)));
+    EXPECT_TRUE(libaan::startswith(ab, libaan::string_type("a")));
+    EXPECT_FALSE(libaan::startswith(ab, libaan::string_type("b")));
+    EXPECT_TRUE(libaan::endswith(ab, libaan::string_type("b")));
+    EXPECT_FALSE(libaan::endswith(ab, libaan::string_type("abc")));
+    EXPECT_TRUE(libaan::startswith(with_nul, libaan::string_type("a\0", 2)));
+    EXPECT_FALSE(libaan::startswith(with_nul,
+                                    libaan::string_type("a\0c", 3)));
+    EXPECT_TRUE(libaan::endswith(with_nul, libaan::string_type("\0b", 2)));
+    EXPECT_FALSE(libaan::endswith(with_nul, libaan::string_type("\0c", 2)));
 }
 
 bool operator==(const std::vector<std::string> &lhs,
@@ -153,6 +182,14 @@ TEST(string_hh, split2_str) {
 
     libaan::string_type s("ababab", 4);
     test_split2(s, "b", { "a", "a" });
+
+    // embedded NULs, delimiter without terminating NUL
+    const std::string nul("a\0b--c\0--", 9);
+    test_split2_c(libaan::string_type(nul.data(), nul.size()),
+                  libaan::string_type("--x", 2),
+                  { std::string("a\0b", 3), std::string("c\0", 2) });
+    test_split2_b(nul, libaan::string_type("--x", 2),
+                  { std::string("a\0b", 3), std::string("c\0", 2) });
 }
 
 TEST(string_hh, split2_char) {
@@ -171,6 +208,295 @@ TEST(string_hh, to_hex_string) {
     init();
 }
 
+TEST(string_hh, split_view) {
+    init();
+    const auto collect = [](const libaan::split_view &view) {
+        std::vector<libaan::string_type> r;
+        for(const auto &token: view)
+            r.push_back(token);
+        return r;
+    };
+    for(const auto &t: test_set_str) {
+        const auto r = collect(libaan::split_view(std::get<0>(t), std::get<1>(t)));
+        EXPECT_EQ(std::get<2>(t).size(), r.size());
+        EXPECT_TRUE(std::get<2>(t) == r) << std::get<0>(t);
+    }
+    for(const auto &t: test_set_char) {
+        const auto r = collect(libaan::split_view(std::get<0>(t), std::get<1>(t)));
+        EXPECT_EQ(std::get<2>(t).size(), r.size());
+        EXPECT_TRUE(std::get<2>(t) == r) << std::get<0>(t);
+    }
+
+    const libaan::split_view view(words, '\n');
+    EXPECT_EQ(libaan::split(words, '\n').size(),
+              size_t(std::distance(view.begin(), view.end())));
+    auto it = view.begin();
+    EXPECT_EQ("1080", *it++);
+    EXPECT_EQ("10-point", *it);
+    EXPECT_EQ(8, it->length());
+    EXPECT_TRUE(view.begin() != it);
+    EXPECT_TRUE(libaan::split_view(words, "").begin()
+                == libaan::split_view(words, "").end());
+}
+
+TEST(string_hh, tokenizer) {
+    init();
+    const auto naive = [](const std::string &txt, const std::string &delims) {
+        std::vector<std::string> r(1);
+        for(const auto c: txt)
+            if(delims.find(c) != std::string::npos)
+                r.emplace_back();
+            else
+                r.back().push_back(c);
+        return r;
+    };
+    const auto tokens = [](const libaan::tokenizer &t) {
+        std::vector<std::string> r;
+        for(size_t i = 0; i < t.size(); i++)
+            r.push_back(t[i]);
+        return r;
+    };
+
+    libaan::tokenizer csv(",\n");
+    EXPECT_EQ(1, csv.size());
+    EXPECT_EQ("", std::string(csv[0]));
+    csv.tokenize("a,b,,c\nd,");
+    EXPECT_EQ(std::vector<std::string>({ "a", "b", "", "c", "d", "" }),
+              tokens(csv));
+    EXPECT_EQ(5, csv.delimiter_count());
+    EXPECT_EQ(1, csv.get_offsets()[0]);
+
+    // inputs across several 64 byte blocks and 64 KiB chunks
+    std::mt19937 gen(11);
+    std::uniform_int_distribution<int> dist(0, 255);
+    for(const auto &delims: { std::string("\n"), std::string(",\t"),
+                std::string("\0\x80\xff a", 5), std::string("abcdefghijk") }) {
+        libaan::tokenizer t(delims);
+        for(const size_t n: { 0u, 63u, 64u, 200u, 200000u }) {
+            std::string txt(n, 0);
+            for(auto &c: txt)
+                c = static_cast<char>(dist(gen) < 64
+                                      ? delims[size_t(dist(gen)) % delims.size()]
+                                      : dist(gen));
+            t.tokenize(txt);
+            EXPECT_EQ(naive(txt, delims), tokens(t)) << delims << " " << n;
+        }
+    }
+
+    libaan::tokenizer lines("\n");
+    lines.tokenize(words);
+    EXPECT_EQ("1080", std::string(lines[0]));
+    EXPECT_EQ("10-point", std::string(lines[1]));
+}
+
+TEST(string_hh, owned_string) {
+    init();
+    const std::string long_string(100, 'x');
+    const std::vector<std::string> inputs = { "", "short", std::string(23, 'a'),
+        std::string(24, 'b'), long_string, std::string("a\0b", 3) };
+    for(const auto &in: inputs) {
+        const libaan::owned_string s(in);
+        EXPECT_EQ(in.size(), s.size());
+        EXPECT_EQ(in, s.str());
+        EXPECT_EQ(0, s.c_str()[s.size()]);
+        EXPECT_EQ(libaan::hash_bytes(in.data(), in.size()), s.hash());
+        EXPECT_TRUE(s == libaan::string_type(in));
+        EXPECT_TRUE(libaan::string_type(in.data(), in.size()) == s);
+        EXPECT_TRUE(s == in);
+        EXPECT_TRUE(in == s);
+        EXPECT_EQ(in, std::string(libaan::string_type(s)));
+
+        libaan::owned_string copy(s);
+        EXPECT_TRUE(copy == s);
+        libaan::owned_string moved(std::move(copy));
+        EXPECT_TRUE(moved == s);
+        EXPECT_EQ(0, copy.size());
+        copy = moved;
+        EXPECT_TRUE(copy == s);
+        moved = libaan::owned_string("other");
+        EXPECT_TRUE(moved != s);
+        EXPECT_EQ("other", moved.str());
+    }
+    EXPECT_TRUE(libaan::owned_string("abc") != libaan::owned_string("abd"));
+    EXPECT_TRUE(libaan::owned_string("abc") != libaan::owned_string("ab"));
+
+    // literals and std::string, length checked
+    const libaan::owned_string abc("abc");
+    EXPECT_TRUE(abc == "abc");
+    EXPECT_TRUE("abc" == abc);
+    EXPECT_FALSE(abc == "ab");
+    EXPECT_FALSE("abcd" == abc);
+    EXPECT_TRUE(abc == std::string("abc"));
+    EXPECT_TRUE(std::string("abc") == abc);
+    EXPECT_FALSE(abc == std::string("abc\0", 4));
+    EXPECT_FALSE(std::string("ab") == abc);
+    const libaan::owned_string with_nul(std::string("a\0b", 3));
+    EXPECT_FALSE(with_nul == "a");
+    EXPECT_TRUE(with_nul == std::string("a\0b", 3));
+
+    // hash of every length up to 40 differs from the one of its prefix
+    std::string prefix;
+    for(size_t i = 0; i < 40; i++) {
+        const auto h = libaan::hash_bytes(prefix.data(), prefix.size());
+        prefix.push_back('a');
+        EXPECT_NE(h, libaan::hash_bytes(prefix.data(), prefix.size()));
+    }
+
+    std::unordered_map<libaan::owned_string, size_t> map;
+    const auto lines = libaan::split(words, '\n');
+    for(size_t i = 0; i < lines.size(); i++)
+        map[lines[i]] = i;
+    EXPECT_EQ(lines.size(), map.size());
+    for(size_t i = 0; i < lines.size(); i++)
+        EXPECT_EQ(i, map.at(lines[i]));
+    EXPECT_EQ(map.end(), map.find("not a word"));
+}
+
+TEST(string_hh, hash) {
+    init();
+    const std::string in("abc\0def", 7);
+    const libaan::string_type s(in.data(), in.size());
+    EXPECT_EQ(libaan::hash_bytes(in.data(), in.size()),
+              std::hash<libaan::string_type>()(s));
+    EXPECT_NE(libaan::hash_bytes(in.data(), in.size()),
+              libaan::hash_bytes(in.data(), in.size(), 1));
+    EXPECT_FALSE(s == libaan::string_type("abc\0deg", 7));
+
+    // all lengths through the 48 byte lanes, every byte matters
+    std::string data(200, 'x');
+    std::unordered_set<uint64_t> hashes;
+    size_t inputs = 0;
+    for(size_t n = 0; n <= data.size(); n++) {
+        hashes.insert(libaan::hash_bytes(data.data(), n));
+        inputs++;
+        for(size_t i = 0; i < n; i += 7) {
+            data[i] = 'y';
+            hashes.insert(libaan::hash_bytes(data.data(), n));
+            inputs++;
+            data[i] = 'x';
+        }
+    }
+    EXPECT_EQ(inputs, hashes.size());
+
+    const auto tokens = libaan::split(words, '\n');
+    const auto bulk = libaan::hash_all(tokens, 5);
+    ASSERT_EQ(tokens.size(), bulk.size());
+    for(size_t i = 0; i < tokens.size(); i++)
+        EXPECT_EQ(libaan::hash_bytes(tokens[i].data(), tokens[i].length(), 5),
+                  bulk[i]);
+
+    std::unordered_set<libaan::string_type> set(tokens.begin(), tokens.end());
+    EXPECT_EQ(tokens.size(), set.size());
+    EXPECT_EQ(1, set.count(tokens.front()));
+    EXPECT_EQ(0, set.count("not a word"));
+}
+
+TEST(string_hh, find) {
+    init();
+    const auto find = [](const std::string &txt, const std::string &pattern,
+                         size_t pos) {
+        return libaan::search::find(txt.data(), txt.size(), pattern.data(),
+                                    pattern.size(), pos);
+    };
+    EXPECT_EQ(0, find("abc", "", 0));
+    EXPECT_EQ(3, find("abc", "", 3));
+    EXPECT_EQ(std::string::npos, find("abc", "", 4));
+    EXPECT_EQ(std::string::npos, find("abc", "abcd", 0));
+    EXPECT_EQ(std::string::npos, find("abc", "c", 5));
+    EXPECT_EQ(std::string("a\0b\0c", 5).find(std::string("\0c", 2)),
+              find(std::string("a\0b\0c", 5), std::string("\0c", 2), 0));
+
+    // small alphabet for many candidates, lengths around the block sizes
+    std::mt19937 gen(8);
+    std::uniform_int_distribution<int> dist(0, 3);
+    for(size_t n = 0; n < 200; n += 7) {
+        std::string txt(n, 0);
+        for(auto &c: txt)
+            c = static_cast<char>("ab\0c"[dist(gen)]);
+        for(size_t m = 1; m < 40; m += 3) {
+            std::string pattern(m, 0);
+            for(auto &c: pattern)
+                c = static_cast<char>("ab\0c"[dist(gen)]);
+            if(m < n && dist(gen) == 0)
+                pattern = txt.substr(n - m);
+            for(size_t pos = 0; pos <= n; pos += 13)
+                EXPECT_EQ(txt.find(pattern, pos), find(txt, pattern, pos))
+                    << n << " " << m << " " << pos;
+        }
+    }
+
+    const std::string pattern = words.substr(words.size() - 20);
+    EXPECT_EQ(words.size() - 20, find(words, pattern, 0));
+}
+
+namespace {
+
+// (pattern, offset) pairs of aho_corasick::scan, sorted
+std::vector<std::pair<size_t, size_t> >
+scan_all(const libaan::search::aho_corasick &ac, const std::string &txt)
+{
+    std::vector<std::pair<size_t, size_t> > r;
+    ac.scan(txt, [&](size_t pattern, size_t offset) {
+            r.emplace_back(pattern, offset);
+        });
+    std::sort(r.begin(), r.end());
+    return r;
+}
+
+std::vector<std::pair<size_t, size_t> >
+search_each(const std::vector<std::string> &patterns, const std::string &txt)
+{
+    std::vector<std::pair<size_t, size_t> > r;
+    for(size_t i = 0; i < patterns.size(); i++) {
+        // identical patterns are reported once
+        if(std::find(patterns.begin(), patterns.begin() + long(i), patterns[i])
+           != patterns.begin() + long(i))
+            continue;
+        for(const auto offset: libaan::search::stl_search_all(patterns[i], txt))
+            r.emplace_back(i, offset);
+    }
+    return r;
+}
+
+}
+
+TEST(string_hh, aho_corasick) {
+    init();
+    {
+        const std::vector<std::string> patterns
+            = { "he", "she", "his", "hers", "", "she", std::string("s\0", 2) };
+        const libaan::search::aho_corasick ac(patterns);
+        const std::string txt("ushers his shes\0 hershe", 23);
+        EXPECT_EQ(search_each(patterns, txt), scan_all(ac, txt));
+        EXPECT_TRUE(scan_all(ac, "").empty());
+        EXPECT_TRUE(scan_all(ac, "xyz").empty());
+    }
+
+    std::mt19937 gen(9);
+    std::uniform_int_distribution<int> dist(0, 3);
+    for(size_t round = 0; round < 20; round++) {
+        std::vector<std::string> patterns(1 + round * 5);
+        for(auto &p: patterns) {
+            p.resize(size_t(1 + dist(gen) + dist(gen)));
+            for(auto &c: p)
+                c = static_cast<char>("abc\0"[dist(gen)]);
+        }
+        std::string txt(500, 0);
+        for(auto &c: txt)
+            c = static_cast<char>("abcd"[dist(gen)]);
+        const libaan::search::aho_corasick ac(patterns);
+        EXPECT_EQ(search_each(patterns, txt), scan_all(ac, txt)) << round;
+    }
+
+    // every 8th word, within the (shortened) words file
+    const auto lines = libaan::split(words, '\n');
+    std::vector<std::string> patterns;
+    for(size_t i = 0; i < lines.size(); i += 8)
+        patterns.push_back(lines[i]);
+    const libaan::search::aho_corasick ac(patterns);
+    EXPECT_EQ(search_each(patterns, words), scan_all(ac, words));
+}
+
 TEST(string_hh, stl_search_all) {
     init();
     std::string patt {"1080" };
@@ -533,3 +859,268 @@ TEST(string_hh, sarr_dc3) {
         EXPECT_EQ(r[1], 1);
     }
 }
+
+namespace {
+std::vector<int> naive_suffix_array(const std::string &in)
+{
+    std::vector<int> sa(in.size());
+    std::iota(std::begin(sa), std::end(sa), 0);
+    std::sort(std::begin(sa), std::end(sa), [&in](int a, int b) {
+            return in.compare(static_cast<size_t>(a), std::string::npos, in,
+                              static_cast<size_t>(b), std::string::npos) < 0; });
+    return sa;
+}
+}
+
+TEST(string_hh, sarr_dc3_threads) {
+    // long enough to take the parallel code paths, small alphabet to recurse
+    std::string in(300000, 'a');
+    std::minstd_rand rng(42);
+    for(auto &c: in)
+        c = static_cast<char>('a' + rng() % 4);
+
+    const libaan::search::sarr_dc3 serial(in);
+    std::vector<int> reference(in.size());
+    libaan::search::sarr_sais sais(in.data(), in.size(), &reference[0]);
+
+    for(unsigned threads: { 2u, 3u, 8u }) {
+        const libaan::search::sarr_dc3 parallel(in, threads);
+        EXPECT_EQ(serial.get_suffixes().second, parallel.get_suffixes().second);
+        EXPECT_TRUE(std::equal(serial.get_suffixes().first,
+                               serial.get_suffixes().first + in.size(),
+                               parallel.get_suffixes().first));
+        EXPECT_TRUE(std::equal(std::begin(reference), std::end(reference),
+                               parallel.get_suffixes().first));
+    }
+}
+
+TEST(string_hh, sarr_sais) {
+    init();
+
+    {
+        std::vector<int> sa(words.size());
+        libaan::search::sarr_sais sarr(words.c_str(), words.size(), &sa[0]);
+        EXPECT_TRUE(sa == naive_suffix_array(words));
+        auto r = sarr.search("1080");
+        EXPECT_EQ(r.size(), 1);
+        if(r.empty())
+            exit(EXIT_FAILURE);
+        EXPECT_EQ(r.front(), 0);
+
+        r = sarr.search("10th");
+        EXPECT_EQ(r.size(), 1);
+        if(r.empty())
+            exit(EXIT_FAILURE);
+        EXPECT_EQ(r.front(), 14);
+    }
+
+    for(const auto &in: std::vector<std::string> { "banana", "mississippi", "abracadabra",
+                "yabbadabbado", "aaaaaaaa", "abababab", "ba", "a",
+                "zyxwvutsrqponmlkjihgfedcba", std::string("a\0b\0a\0", 6),
+                std::string("\xff\x01\xff\x80\x7f", 5) }) {
+        std::vector<int> sa(in.size());
+        libaan::search::sarr_sais sarr(in.data(), in.size(), &sa[0]);
+        EXPECT_TRUE(sa == naive_suffix_array(in));
+    }
+
+    {
+        const std::string in = "abcdefabc";
+        std::vector<int> sa(in.size());
+        libaan::search::sarr_sais sarr(in.data(), in.size(), &sa[0]);
+        auto r = sarr.search("abc");
+
+        EXPECT_EQ(r.size(), 2);
+        if(r.size() != 2)
+            exit(EXIT_FAILURE);
+        std::sort(std::begin(r), std::end(r));
+        EXPECT_EQ(r[0], 0);
+        EXPECT_EQ(r[1], 6);
+
+        r = sarr.search("def");
+        EXPECT_EQ(r.size(), 1);
+        if(r.size() != 1)
+            exit(EXIT_FAILURE);
+        EXPECT_EQ(r[0], 3);
+
+        EXPECT_TRUE(sarr.search("").empty());
+        EXPECT_TRUE(sarr.search("abcdefabcd").empty());
+        EXPECT_TRUE(sarr.search("abd").empty());
+    }
+
+    {
+        libaan::search::sarr_sais sarr("", 0, nullptr);
+        EXPECT_TRUE(sarr.search("def").empty());
+    }
+
+    {
+        const std::string in = "aaa";
+        std::vector<int> sa(in.size());
+        libaan::search::sarr_sais sarr(in.data(), in.size(), &sa[0]);
+        auto r = sarr.search("aa");
+        EXPECT_EQ(2, r.size());
+        if(r.size() != 2)
+            exit(EXIT_FAILURE);
+        std::sort(std::begin(r), std::end(r));
+        EXPECT_EQ(r[0], 0);
+        EXPECT_EQ(r[1], 1);
+    }
+
+    {
+        const std::string in("a\0a\0a", 5);
+        std::vector<int> sa(in.size());
+        libaan::search::sarr_sais sarr(in.data(), in.size(), &sa[0]);
+        auto r = sarr.search(std::string("a\0a", 3));
+        EXPECT_EQ(2, r.size());
+    }
+}
+
+TEST(string_hh, sarr_lcp) {
+    init();
+
+    {
+        libaan::search::sarr_dc3 dc3(words);
+        libaan::search::sarr_lcp sarr(words.c_str(), words.size(),
+                                      dc3.get_suffix_array());
+        auto r = sarr.search("1080");
+        EXPECT_EQ(r.size(), 1);
+        if(r.empty())
+            exit(EXIT_FAILURE);
+        EXPECT_EQ(*r.begin(), 0);
+
+        r = sarr.search("10th");
+        EXPECT_EQ(r.size(), 1);
+        if(r.empty())
+            exit(EXIT_FAILURE);
+        EXPECT_EQ(*r.begin(), 14);
+
+        for(const auto &pattern: { "1", "10", "-point", "\n", "a", "zzz" }) {
+            r = sarr.search(pattern);
+            std::vector<std::size_t> hits(r.begin(), r.end());
+            std::sort(std::begin(hits), std::end(hits));
+            EXPECT_EQ(libaan::search::stl_search_all(pattern, words), hits);
+        }
+    }
+
+    {
+        // "banana": suffix array 5 3 1 0 4 2
+        const std::string in = "banana";
+        std::vector<int> sa(in.size());
+        libaan::search::sarr_sais sais(in.data(), in.size(), &sa[0]);
+        libaan::search::sarr_lcp sarr(in.data(), in.size(), &sa[0]);
+        EXPECT_EQ(std::vector<int>({ 0, 1, 3, 0, 0, 2 }),
+                  std::vector<int>(sarr.get_lcp(), sarr.get_lcp() + in.size()));
+
+        auto r = sarr.search("ana");
+        EXPECT_EQ(r.size(), 2);
+        EXPECT_EQ(r.begin(), &sa[1]);
+        EXPECT_EQ(r.end(), &sa[3]);
+
+        EXPECT_EQ(sarr.search("a").size(), 3);
+        EXPECT_EQ(sarr.search("banana").size(), 1);
+        EXPECT_TRUE(sarr.search("").empty());
+        EXPECT_TRUE(sarr.search("bananas").empty());
+        EXPECT_TRUE(sarr.search("nab").empty());
+        EXPECT_TRUE(sarr.search("c").empty());
+        EXPECT_TRUE(sarr.search("0").empty());
+    }
+
+    {
+        libaan::search::sarr_lcp sarr("", 0, nullptr);
+        EXPECT_TRUE(sarr.search("def").empty());
+    }
+}
+
+TEST(string_hh, sarr_lcp_search_many) {
+    init();
+
+    libaan::search::sarr_dc3 dc3(words);
+    libaan::search::sarr_lcp sarr(words.c_str(), words.size(),
+                                  dc3.get_suffix_array());
+
+    const std::vector<std::string> patterns {
+        "10th", "1", "", "10", "1080", "10", "-point", "\n1", "zzz",
+        "point\n", "t", "th", "\n", "1st", words, words + "x" };
+
+    for(unsigned threads: { 1u, 3u }) {
+        std::vector<libaan::search::sarr_range> results(patterns.size());
+        sarr.search_many(patterns, &results[0], threads);
+        for(size_t i = 0; i < patterns.size(); i++) {
+            const auto expected = sarr.search(patterns[i]);
+            EXPECT_EQ(expected.begin(), results[i].begin());
+            EXPECT_EQ(expected.end(), results[i].end());
+        }
+    }
+
+    sarr.search_many({ }, nullptr);
+}
+
+namespace {
+template<typename index_t>
+void check_index_type(const std::string &in, const std::vector<int> &reference)
+{
+    const auto equal = [&reference](const index_t *sa) {
+        return std::equal(std::begin(reference), std::end(reference), sa,
+                          [](int a, const index_t &b) {
+                              return static_cast<uint64_t>(a)
+                                  == static_cast<uint64_t>(b); });
+    };
+
+    std::vector<index_t> sa(in.size());
+    libaan::search::basic_sarr_sais<index_t> sais(in.data(),
+                                                  static_cast<int64_t>(in.size()),
+                                                  &sa[0]);
+    EXPECT_TRUE(equal(&sa[0]));
+
+    for(unsigned threads: { 1u, 2u }) {
+        const libaan::search::basic_sarr_dc3<index_t> dc3(in, threads);
+        EXPECT_TRUE(equal(dc3.get_suffix_array()));
+    }
+
+    const std::string head = in.substr(0, 5000);
+    const libaan::search::basic_sarr_c<index_t> c(head);
+    const libaan::search::sarr_c c_int(head);
+    EXPECT_TRUE(std::equal(std::begin(c_int.get_suffixes()),
+                           std::end(c_int.get_suffixes()),
+                           std::begin(c.get_suffixes()),
+                           [](int a, const index_t &b) {
+                               return static_cast<uint64_t>(a)
+                                   == static_cast<uint64_t>(b); }));
+
+    const libaan::search::basic_sarr_lcp<index_t> sarr(
+        in.data(), static_cast<int64_t>(in.size()), &sa[0]);
+    const libaan::search::sarr_lcp sarr_int(
+        in.data(), static_cast<int>(in.size()), &reference[0]);
+    EXPECT_TRUE(std::equal(sarr_int.get_lcp(), sarr_int.get_lcp() + in.size(),
+                           sarr.get_lcp(), [](int a, const index_t &b) {
+                               return static_cast<uint64_t>(a)
+                                   == static_cast<uint64_t>(b); }));
+    for(const std::string pattern: { "a", "abc", "dcba", "aaaaaaaaaaaa", "e",
+                                     "" }) {
+        const auto r = sarr.search(pattern);
+        const auto r_int = sarr_int.search(pattern);
+        EXPECT_EQ(r.begin() - &sa[0], r_int.begin() - &reference[0]);
+        EXPECT_EQ(r.size(), r_int.size());
+    }
+}
+}
+
+TEST(string_hh, sarr_index_types) {
+    EXPECT_EQ(sizeof(libaan::uint40_t), 5);
+    const libaan::uint40_t big = (1ull << 40) - 2;
+    EXPECT_EQ(static_cast<uint64_t>(big), (1ull << 40) - 2);
+    EXPECT_EQ(libaan::search::sarr_index_traits<libaan::uint40_t>::max_size(),
+              (1ull << 40) - 2);
+
+    // long enough to take the parallel dc3 paths, small alphabet to recurse
+    std::string in(100000, 'a');
+    std::minstd_rand rng(7);
+    for(auto &c: in)
+        c = static_cast<char>('a' + rng() % 4);
+    std::vector<int> reference(in.size());
+    libaan::search::sarr_sais(in.data(), static_cast<int>(in.size()),
+                              &reference[0]);
+
+    check_index_type<uint32_t>(in, reference);
+    check_index_type<uint64_t>(in, reference);
+    check_index_type<libaan::uint40_t>(in, reference);
+}